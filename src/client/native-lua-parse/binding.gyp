@@ -4,12 +4,20 @@
       "target_name": "lua_parser",
       "sources": [ 
         "src/Main_Node.cpp",
+        "src/Document.cpp",
         "src/AST_Nodes.cpp",
         "src/AutoComplete.cpp",
+        "src/FuzzyMatch.cpp",
         "src/Descent_Parser.cpp",
         "src/Lexer_DFA.cpp",
+        "src/Incremental_Lexer.cpp",
+        "src/Piece_Table.cpp",
         "src/Token.cpp",
         "src/TypeSystem.cpp",
+        "src/Session_Recorder.cpp",
+        "src/Phase_Stats.cpp",
+        "src/Memory_Accounting.cpp",
+        "src/Tracing.cpp",
         "src/Minidump.cpp"
       ],
       "defines": [
@@ -17,35 +25,16 @@
       ],
       'conditions': [
         ['OS=="win"', {
-          'configurations': {
-            'Debug': {
-              'msvs_settings': {
-                'VCCLCompilerTool': {
-                  'RuntimeTypeInfo': 'true',
-                },
-              }
-            }, # Debug
-            'Release': {
-              'msvs_settings': {
-                'VCCLCompilerTool': {
-                  'RuntimeTypeInfo': 'true',
-                },
-              },
-            }, # Release
-          }, # configurations
-
+          # Replacing operator new only stays inside the addon on Windows (see Memory_Accounting.h)
+          'defines': [
+            'MEMORY_ACCOUNTING'
+          ],
           'libraries':[
           '-ldbghelp.lib'
         ],
         }], # OS=="win"
  	     ['OS!="win"', {
-		      'cflags_cc!': [ '-fno-rtti' ],
 		      'cflags_cc+': [ '-std=c++14' ],
-        }],
-		    ['OS=="mac"', {
-          'xcode_settings': {
-            'GCC_ENABLE_CPP_RTTI': 'YES'
-		      }
         }],
       ], # conditions
       'include_dirs': [
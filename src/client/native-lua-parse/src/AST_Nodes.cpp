@@ -1,409 +1,234 @@
 #include "AST_Nodes.h"
+#include <algorithm>
 
-// Walk Functions //
-void AbstractNode::Walk(Visitor* visitor, bool visit)
-{
-  if (visit && visitor->Visit(this) == VisitResult::Stop)
-    return;
-}
-
-void StatementNode::Walk(Visitor* visitor, bool visit)
-{
-  if (visit && visitor->Visit(this) == VisitResult::Stop)
-    return;
-
-  AbstractNode::Walk(visitor, false);
-}
-
-void BlockNode::Walk(Visitor* visitor, bool visit)
-{
-  if (visit && visitor->Visit(this) == VisitResult::Stop)
-    return;
-
-  StatementNode::Walk(visitor, false);
-
-  for (auto &node : this->Statements)
-  {
-    node->Walk(visitor);
-  }
+// Walk //
 
-  if(this->End)
-    this->End->Walk(visitor);
-}
+//Nodes still to be visited, shared by every walk on the thread. A walk started from inside a Visit works on top
+//of the one that's running and leaves the stack the way it found it. A null entry means the node under it has
+//had its children walked and is being left.
+static thread_local std::vector<AbstractNode *> WalkStack;
 
-void TypeNode::Walk(Visitor* visitor, bool visit)
+//Puts the children of node on the stack so the first one is visited first
+static void PushChildren(std::vector<AbstractNode *> &stack, AbstractNode *node)
 {
-  if (visit && visitor->Visit(this) == VisitResult::Stop)
-    return;
-
-  AbstractNode::Walk(visitor, false);
+  size_t first = stack.size();
+  node->Children(stack);
+  std::reverse(stack.begin() + first, stack.end());
 }
 
-void AssignmentNode::Walk(Visitor* visitor, bool visit)
+void AbstractNode::Walk(Visitor* visitor, bool visit)
 {
-  if (visit && visitor->Visit(this) == VisitResult::Stop)
-    return;
-
-  StatementNode::Walk(visitor, false);
+  std::vector<AbstractNode *> &stack = WalkStack;
+  const size_t base = stack.size();
 
-  for (auto &node : this->LeftVariables)
+  //A visitor that throws leaves its part of the stack behind otherwise
+  struct Unwind
   {
-    node->Walk(visitor);
-  }
+    std::vector<AbstractNode *> &stack;
+    size_t base;
+    ~Unwind() { stack.resize(base); }
+  } unwind{ stack, base };
 
-  for (auto &node : this->RightExpressions)
+  if (visit)
+    stack.push_back(this);
+  else
+    PushChildren(stack, this);
+
+  while (stack.size() > base)
   {
-    node->Walk(visitor);
+    AbstractNode *node = stack.back();
+    stack.pop_back();
+
+    if (node == nullptr)
+    {
+      node = stack.back();
+      stack.pop_back();
+      node->Leave(visitor);
+      continue;
+    }
+
+    if (node->Enter(visitor) == VisitResult::Stop)
+      continue;
+
+    stack.push_back(node);
+    stack.push_back(nullptr);
+    PushChildren(stack, node);
   }
 }
 
-void VariableNode::Walk(Visitor* visitor, bool visit)
-{
-  if (visit && visitor->Visit(this) == VisitResult::Stop)
-    return;
-
-  AbstractNode::Walk(visitor, false);
-}
-
-void VariableStatementNode::Walk(Visitor* visitor, bool visit)
+//One switch on the kind picks the visitor's overload for the node's type
+VisitResult AbstractNode::Enter(Visitor* visitor)
 {
-  if (visit && visitor->Visit(this) == VisitResult::Stop)
-    return;
-
-  VariableNode::Walk(visitor, false);
-
-  if(this->Variable)
-    this->Variable->Walk(visitor);
-
-  if (this->Suffix)
-    this->Suffix->Walk(visitor);
-}
-
-void IdentifiedVariableNode::Walk(Visitor* visitor, bool visit)
-{
-  if (visit && visitor->Visit(this) == VisitResult::Stop)
-    return;
-
-  VariableNode::Walk(visitor, false);
-
-  //@REMIND Type node?
-}
-
-void ExpressionVariableNode::Walk(Visitor* visitor, bool visit)
-{
-  if (visit && visitor->Visit(this) == VisitResult::Stop)
-    return;
-
-  VariableNode::Walk(visitor, false);
-
-  this->Expression->Walk(visitor);
+  switch (Kind)
+  {
+#define NODE_ENTER(Class) case NodeKind::Class: return visitor->Visit(static_cast<Class *>(this));
+    AST_NODE_TYPES(NODE_ENTER)
+#undef NODE_ENTER
+  }
 
-  if (this->Suffix)
-    this->Suffix->Walk(visitor);
+  return visitor->Visit(this);
 }
 
-void VariableSuffixNode::Walk(Visitor* visitor, bool visit)
+void AbstractNode::Leave(Visitor* visitor)
 {
-  if (visit && visitor->Visit(this) == VisitResult::Stop)
-    return;
-  AbstractNode::Walk(visitor, false);
-
-  if (this->LeftSuffix)
-    this->LeftSuffix->Walk(visitor);
-
-  for (auto &node : this->CallNodes)
+  switch (Kind)
   {
-    node->Walk(visitor);
+#define NODE_LEAVE(Class) case NodeKind::Class: visitor->Leave(static_cast<Class *>(this)); return;
+    AST_NODE_TYPES(NODE_LEAVE)
+#undef NODE_LEAVE
   }
-
-  if (this->Index)
-    this->Index->Walk(visitor);
 }
 
-void CallNode::Walk(Visitor* visitor, bool visit)
+// Children //
+static void AddChild(std::vector<AbstractNode*> &children, AbstractNode *node)
 {
-  if (visit && visitor->Visit(this) == VisitResult::Stop)
-    return;
-  AbstractNode::Walk(visitor, false);
-
-  if(this->Argument)
-    this->Argument->Walk(visitor);
+  if (node)
+    children.push_back(node);
 }
 
-void MemberCallNode::Walk(Visitor* visitor, bool visit)
+template<typename T>
+static void AddChildren(std::vector<AbstractNode*> &children, const unique_vector<T> &nodes)
 {
-  if (visit && visitor->Visit(this) == VisitResult::Stop)
-    return;
-  CallNode::Walk(visitor, false);
+  for (auto &node : nodes)
+    AddChild(children, node.get());
 }
 
-void ArgumentNode::Walk(Visitor* visitor, bool visit)
+void BlockNode::Children(std::vector<AbstractNode*> &children)
 {
-  if (visit && visitor->Visit(this) == VisitResult::Stop)
-    return;
-  AbstractNode::Walk(visitor, false);
+  AddChildren(children, this->Statements);
+  AddChild(children, this->End.get());
 }
 
-void ExpressionArgumentNode::Walk(Visitor* visitor, bool visit)
+void AssignmentNode::Children(std::vector<AbstractNode*> &children)
 {
-  if (visit && visitor->Visit(this) == VisitResult::Stop)
-    return;
-  ArgumentNode::Walk(visitor, false);
-
-  for (auto &node : this->ExpressionList)
-  {
-    node->Walk(visitor);
-  }
+  AddChildren(children, this->LeftVariables);
+  AddChildren(children, this->RightExpressions);
 }
 
-void TableArgumentNode::Walk(Visitor* visitor, bool visit)
+void VariableStatementNode::Children(std::vector<AbstractNode*> &children)
 {
-  if (visit && visitor->Visit(this) == VisitResult::Stop)
-    return;
-  ArgumentNode::Walk(visitor, false);
-
-  this->Table->Walk(visitor);
+  AddChild(children, this->Variable.get());
+  AddChild(children, this->Suffix.get());
 }
 
-void StringArgumentNode::Walk(Visitor* visitor, bool visit)
+void ExpressionVariableNode::Children(std::vector<AbstractNode*> &children)
 {
-  if (visit && visitor->Visit(this) == VisitResult::Stop)
-    return;
-  ArgumentNode::Walk(visitor, false);
+  AddChild(children, this->Expression.get());
+  AddChild(children, this->Suffix.get());
 }
 
-void IndexNode::Walk(Visitor* visitor, bool visit)
+void VariableSuffixNode::Children(std::vector<AbstractNode*> &children)
 {
-  if (visit && visitor->Visit(this) == VisitResult::Stop)
-    return;
-  AbstractNode::Walk(visitor, false);
+  AddChild(children, this->LeftSuffix.get());
+  AddChildren(children, this->CallNodes);
+  AddChild(children, this->Index.get());
 }
 
-void IdentifiedIndexNode::Walk(Visitor* visitor, bool visit)
+void CallNode::Children(std::vector<AbstractNode*> &children)
 {
-  if (visit && visitor->Visit(this) == VisitResult::Stop)
-    return;
-  IndexNode::Walk(visitor, false);
+  AddChild(children, this->Argument.get());
 }
 
-void ExpressionIndexNode::Walk(Visitor* visitor, bool visit)
+void ExpressionArgumentNode::Children(std::vector<AbstractNode*> &children)
 {
-  if (visit && visitor->Visit(this) == VisitResult::Stop)
-    return;
-  IndexNode::Walk(visitor, false);
-
-  this->Expression->Walk(visitor);
+  AddChildren(children, this->ExpressionList);
 }
 
-void BreakNode::Walk(Visitor* visitor, bool visit)
+void TableArgumentNode::Children(std::vector<AbstractNode*> &children)
 {
-  if (visit && visitor->Visit(this) == VisitResult::Stop)
-    return;
-  StatementNode::Walk(visitor, false);
+  AddChild(children, this->Table.get());
 }
 
-void ReturnNode::Walk(Visitor* visitor, bool visit)
+void ExpressionIndexNode::Children(std::vector<AbstractNode*> &children)
 {
-  if (visit && visitor->Visit(this) == VisitResult::Stop)
-    return;
-  StatementNode::Walk(visitor, false);
-
-  for (auto &node : this->ReturnValues)
-  {
-    node->Walk(visitor);
-  }
+  AddChild(children, this->Expression.get());
 }
 
-void ExpressionNode::Walk(Visitor* visitor, bool visit)
+void ReturnNode::Children(std::vector<AbstractNode*> &children)
 {
-  if (visit && visitor->Visit(this) == VisitResult::Stop)
-    return;
-  StatementNode::Walk(visitor, false);
+  AddChildren(children, this->ReturnValues);
 }
 
-void ValueNode::Walk(Visitor* visitor, bool visit)
+void TableNode::Children(std::vector<AbstractNode*> &children)
 {
-  if (visit && visitor->Visit(this) == VisitResult::Stop)
-    return;
-  ExpressionNode::Walk(visitor, false);
+  AddChildren(children, this->Indicies);
+  AddChildren(children, this->Values);
 }
 
-void TableNode::Walk(Visitor* visitor, bool visit)
+void FunctionExpressionNode::Children(std::vector<AbstractNode*> &children)
 {
-  if (visit && visitor->Visit(this) == VisitResult::Stop)
-    return;
-  ExpressionNode::Walk(visitor, false);
-
-  for (auto &node : this->Indicies)
-  {
-    node->Walk(visitor);
-  }
-
-  for (auto &node : this->Values)
-  {
-    node->Walk(visitor);
-  }
+  AddChild(children, this->Function.get());
 }
 
-void FunctionExpressionNode::Walk(Visitor* visitor, bool visit)
+void FunctionCallNode::Children(std::vector<AbstractNode*> &children)
 {
-  if (visit && visitor->Visit(this) == VisitResult::Stop)
-    return;
-  ExpressionNode::Walk(visitor, false);
-
-  this->Function->Walk(visitor);
+  AddChild(children, this->Variable.get());
+  AddChildren(children, this->Calls);
 }
 
-void FunctionCallNode::Walk(Visitor* visitor, bool visit)
+void PrefixExpressionNode::Children(std::vector<AbstractNode*> &children)
 {
-  if (visit && visitor->Visit(this) == VisitResult::Stop)
-    return;
-  ExpressionNode::Walk(visitor, false);
-
-  this->Variable->Walk(visitor);
-
-  for (auto &node : this->Calls)
-  {
-    node->Walk(visitor);
-  }
+  AddChild(children, this->LeftVar.get());
+  AddChildren(children, this->RightCalls);
 }
 
-void PrefixExpressionNode::Walk(Visitor* visitor, bool visit)
+void UnaryOperatorNode::Children(std::vector<AbstractNode*> &children)
 {
-  if (visit && visitor->Visit(this) == VisitResult::Stop)
-    return;
-  ExpressionNode::Walk(visitor, false);
-
-  this->LeftVar->Walk(visitor);
-
-  for (auto &node : this->RightCalls)
-  {
-    node->Walk(visitor);
-  }
+  AddChild(children, this->Right.get());
 }
 
-void UnaryOperatorNode::Walk(Visitor* visitor, bool visit)
+void BinaryOperatorNode::Children(std::vector<AbstractNode*> &children)
 {
-  if (visit && visitor->Visit(this) == VisitResult::Stop)
-    return;
-  ExpressionNode::Walk(visitor, false);
-
-  this->Right->Walk(visitor);
-}
-
-void BinaryOperatorNode::Walk(Visitor* visitor, bool visit)
-{
-  if (visit && visitor->Visit(this) == VisitResult::Stop)
-    return;
-  ExpressionNode::Walk(visitor, false);
-
-  this->Left->Walk(visitor);
-  this->Right->Walk(visitor);
+  AddChild(children, this->Left.get());
+  AddChild(children, this->Right.get());
 }
 
-void FunctionNode::Walk(Visitor* visitor, bool visit)
+void FunctionNode::Children(std::vector<AbstractNode*> &children)
 {
-  if (visit && visitor->Visit(this) == VisitResult::Stop)
-    return;
-  StatementNode::Walk(visitor, false);
-
-  for (auto &node : this->Name)
-  {
-    node->Walk(visitor);
-  }
-
-  this->Block->Walk(visitor);
+  AddChildren(children, this->Name);
+  AddChild(children, this->Block.get());
 }
 
-void FunctionNameNode::Walk(Visitor* visitor, bool visit)
+void WhileNode::Children(std::vector<AbstractNode*> &children)
 {
-  if (visit && visitor->Visit(this) == VisitResult::Stop)
-    return;
-  AbstractNode::Walk(visitor, false);
+  AddChild(children, this->Condition.get());
+  AddChild(children, this->Block.get());
 }
 
-void WhileNode::Walk(Visitor* visitor, bool visit)
+void RepeatNode::Children(std::vector<AbstractNode*> &children)
 {
-  if (visit && visitor->Visit(this) == VisitResult::Stop)
-    return;
-  StatementNode::Walk(visitor, false);
-
-  this->Condition->Walk(visitor);
-  this->Block->Walk(visitor);
+  AddChild(children, this->Block.get());
+  AddChild(children, this->Condition.get());
 }
 
-void RepeatNode::Walk(Visitor* visitor, bool visit)
+void IfNode::Children(std::vector<AbstractNode*> &children)
 {
-  if (visit && visitor->Visit(this) == VisitResult::Stop)
-    return;
-  StatementNode::Walk(visitor, false);
-
-  this->Block->Walk(visitor);
-  this->Condition->Walk(visitor);
+  AddChild(children, this->Condition.get());
+  AddChild(children, this->Block.get());
+  AddChild(children, this->Else.get());
 }
 
-void IfNode::Walk(Visitor* visitor, bool visit)
+void ForNode::Children(std::vector<AbstractNode*> &children)
 {
-  if (visit && visitor->Visit(this) == VisitResult::Stop)
-    return;
-  StatementNode::Walk(visitor, false);
-
-  if (this->Condition)
-    this->Condition->Walk(visitor);
-
-  this->Block->Walk(visitor);
-
-  if (this->Else)
-    this->Else->Walk(visitor);
+  AddChild(children, this->Block.get());
 }
 
-void ForNode::Walk(Visitor* visitor, bool visit)
+//The loops list their block once, after the header (they used to be walked through ForNode as well)
+void NumericForNode::Children(std::vector<AbstractNode*> &children)
 {
-  if (visit && visitor->Visit(this) == VisitResult::Stop)
-    return;
-
-  StatementNode::Walk(visitor, false);
-
-  this->Block->Walk(visitor);
+  AddChild(children, this->Var.get());
+  AddChild(children, this->Limit.get());
+  AddChild(children, this->Step.get());
+  AddChild(children, this->Block.get());
 }
 
-void NumericForNode::Walk(Visitor* visitor, bool visit)
+void GenericForNode::Children(std::vector<AbstractNode*> &children)
 {
-  if (visit && visitor->Visit(this) == VisitResult::Stop)
-    return;
-  ForNode::Walk(visitor, false);
-
-  this->Var->Walk(visitor);
-  this->Limit->Walk(visitor);
-
-  if (this->Step)
-    this->Step->Walk(visitor);
-
-  this->Block->Walk(visitor);
+  AddChildren(children, this->ExpressionList);
+  AddChild(children, this->Block.get());
 }
 
-void GenericForNode::Walk(Visitor* visitor, bool visit)
+void LocalVariableNode::Children(std::vector<AbstractNode*> &children)
 {
-  if (visit && visitor->Visit(this) == VisitResult::Stop)
-    return;
-  ForNode::Walk(visitor, false);
-
-  for (auto &node : this->ExpressionList)
-  {
-    node->Walk(visitor);
-  }
-
-  this->Block->Walk(visitor);
+  AddChildren(children, this->ExpressionList);
 }
-
-void LocalVariableNode::Walk(Visitor* visitor, bool visit)
-{
-  if (visit && visitor->Visit(this) == VisitResult::Stop)
-    return;
-  StatementNode::Walk(visitor, false);
-
-  for (auto &node : this->ExpressionList)
-  {
-    node->Walk(visitor);
-  }
-}
\ No newline at end of file
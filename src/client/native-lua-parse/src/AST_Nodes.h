@@ -65,6 +65,55 @@ class NumericForNode;
 class GenericForNode;
 class LocalVariableNode;
 
+// Every node type, each one followed by the types derived from it, so a type and everything under it are one run
+// of kinds (see NodeCast)
+#define AST_NODE_TYPES(NODE) \
+  NODE(AbstractNode) \
+    NODE(StatementNode) \
+      NODE(BlockNode) \
+      NODE(AssignmentNode) \
+      NODE(BreakNode) \
+      NODE(ReturnNode) \
+      NODE(ExpressionNode) \
+        NODE(ValueNode) \
+        NODE(TableNode) \
+        NODE(FunctionExpressionNode) \
+        NODE(FunctionCallNode) \
+        NODE(PrefixExpressionNode) \
+        NODE(UnaryOperatorNode) \
+        NODE(BinaryOperatorNode) \
+      NODE(FunctionNode) \
+      NODE(WhileNode) \
+      NODE(RepeatNode) \
+      NODE(IfNode) \
+      NODE(ForNode) \
+        NODE(NumericForNode) \
+        NODE(GenericForNode) \
+      NODE(LocalVariableNode) \
+    NODE(TypeNode) \
+    NODE(VariableNode) \
+      NODE(VariableStatementNode) \
+      NODE(IdentifiedVariableNode) \
+      NODE(ExpressionVariableNode) \
+    NODE(VariableSuffixNode) \
+    NODE(CallNode) \
+      NODE(MemberCallNode) \
+    NODE(ArgumentNode) \
+      NODE(ExpressionArgumentNode) \
+      NODE(TableArgumentNode) \
+      NODE(StringArgumentNode) \
+    NODE(IndexNode) \
+      NODE(IdentifiedIndexNode) \
+      NODE(ExpressionIndexNode) \
+    NODE(FunctionNameNode)
+
+enum class NodeKind : unsigned char
+{
+#define NODE_KIND_ENUM(Class) Class,
+  AST_NODE_TYPES(NODE_KIND_ENUM)
+#undef NODE_KIND_ENUM
+};
+
 
 // Forward declarations for the symbols
 class Symbol;
@@ -121,13 +170,68 @@ public:
   virtual VisitResult Visit(NumericForNode* node) { return this->Visit((ForNode*)node); }
   virtual VisitResult Visit(IfNode* node) { return this->Visit((StatementNode*)node); }
   virtual VisitResult Visit(LocalVariableNode* node) { return this->Visit((StatementNode*)node); }
-};
-
 
-// All of our node types inherit from this node and implement the Walk function
+  //Called once the children of a node have been walked, only for nodes whose Visit returned Continue
+  virtual void Leave(AbstractNode* node) {}
+  virtual void Leave(StatementNode* node) { this->Leave((AbstractNode*)node); }
+  virtual void Leave(BlockNode* node) { this->Leave((StatementNode*)node); }
+  virtual void Leave(TypeNode* node) { this->Leave((AbstractNode*)node); }
+  virtual void Leave(AssignmentNode* node) { this->Leave((StatementNode*)node); }
+  virtual void Leave(VariableNode* node) { this->Leave((AbstractNode*)node); }
+  virtual void Leave(VariableStatementNode* node) { this->Leave((VariableNode*)node); }
+  virtual void Leave(IdentifiedVariableNode* node) { this->Leave((VariableNode*)node); }
+  virtual void Leave(ExpressionVariableNode* node) { this->Leave((VariableNode*)node); }
+  virtual void Leave(VariableSuffixNode* node) { this->Leave((AbstractNode*)node); }
+  virtual void Leave(CallNode* node) { this->Leave((AbstractNode*)node); }
+  virtual void Leave(MemberCallNode* node) { this->Leave((CallNode*)node); }
+  virtual void Leave(ArgumentNode* node) { this->Leave((AbstractNode*)node); }
+  virtual void Leave(ExpressionArgumentNode* node) { this->Leave((ArgumentNode*)node); }
+  virtual void Leave(TableArgumentNode* node) { this->Leave((ArgumentNode*)node); }
+  virtual void Leave(StringArgumentNode* node) { this->Leave((ArgumentNode*)node); }
+  virtual void Leave(IndexNode* node) { this->Leave((AbstractNode*)node); }
+  virtual void Leave(IdentifiedIndexNode* node) { this->Leave((IndexNode*)node); }
+  virtual void Leave(ExpressionIndexNode* node) { this->Leave((IndexNode*)node); }
+  virtual void Leave(BreakNode* node) { this->Leave((StatementNode*)node); }
+  virtual void Leave(ReturnNode* node) { this->Leave((StatementNode*)node); }
+  virtual void Leave(ExpressionNode* node) { this->Leave((StatementNode*)node); }
+  virtual void Leave(ValueNode* node) { this->Leave((ExpressionNode*)node); }
+  virtual void Leave(TableNode* node) { this->Leave((ExpressionNode*)node); }
+  virtual void Leave(FunctionExpressionNode* node) { this->Leave((ExpressionNode*)node); }
+  virtual void Leave(FunctionCallNode* node) { this->Leave((ExpressionNode*)node); }
+  virtual void Leave(PrefixExpressionNode* node) { this->Leave((ExpressionNode*)node); }
+  virtual void Leave(UnaryOperatorNode* node) { this->Leave((ExpressionNode*)node); }
+  virtual void Leave(BinaryOperatorNode* node) { this->Leave((ExpressionNode*)node); }
+  virtual void Leave(FunctionNode* node) { this->Leave((StatementNode*)node); }
+  virtual void Leave(FunctionNameNode* node) { this->Leave((AbstractNode*)node); }
+  virtual void Leave(WhileNode* node) { this->Leave((StatementNode*)node); }
+  virtual void Leave(RepeatNode* node) { this->Leave((StatementNode*)node); }
+  virtual void Leave(ForNode* node) { this->Leave((StatementNode*)node); }
+  virtual void Leave(GenericForNode* node) { this->Leave((ForNode*)node); }
+  virtual void Leave(NumericForNode* node) { this->Leave((ForNode*)node); }
+  virtual void Leave(IfNode* node) { this->Leave((StatementNode*)node); }
+  virtual void Leave(LocalVariableNode* node) { this->Leave((StatementNode*)node); }
+};
+
+
+// Every node type declares its kind with this. Last is the last kind derived from it in AST_NODE_TYPES (the type
+// itself when nothing derives from it), the kinds in between are the ones NodeCast accepts.
+#define NODE_KIND(Class, Base, Last) \
+  static const NodeKind FirstKind = NodeKind::Class; \
+  static const NodeKind LastKind = NodeKind::Last; \
+  Class() : Base(NodeKind::Class) {} \
+protected: \
+  Class(NodeKind kind) : Base(kind) {} \
+public:
+
+// All of our node types inherit from this node and list their children for Walk
 class AbstractNode
 {
 public:
+  static const NodeKind FirstKind = NodeKind::AbstractNode;
+  static const NodeKind LastKind = NodeKind::FunctionNameNode;
+
+  AbstractNode() : Kind(NodeKind::AbstractNode) {}
+
   virtual ~AbstractNode()
   {}
 
@@ -137,16 +241,43 @@ public:
   //Parent of this node
   AbstractNode* Parent = nullptr;
 
-  virtual void Walk(Visitor* visitor, bool visit = true);
+  //Which node type this is, Enter/Leave switch on it and NodeCast compares it instead of using RTTI. Kept last
+  //so the members of the derived node can use the padding after it.
+  const NodeKind Kind;
+
+  //Visits this node (unless visit is false) and everything under it, depth first with each node's children in
+  //the order Children lists them. Nodes still to be visited are kept on a heap stack instead of the call
+  //stack, so deeply nested code doesn't use more native stack. Visits that walk their children themselves
+  //still recurse, Leave is there so they can return Continue and do the rest after the children instead.
+  void Walk(Visitor* visitor, bool visit = true);
 
+  //Calls the visitor's Visit and Leave for the node's type
+  VisitResult Enter(Visitor* visitor);
+  void Leave(Visitor* visitor);
+
+  //Adds the children that are set, in the order they're walked
+  virtual void Children(std::vector<AbstractNode*> &children) {}
+
+protected:
+  AbstractNode(NodeKind kind) : Kind(kind) {}
 };
 
+// The node as a T if it is one (or derives from one), null otherwise
+template<typename T>
+T *NodeCast(AbstractNode *node)
+{
+  if (node == nullptr || node->Kind < T::FirstKind || node->Kind > T::LastKind)
+    return nullptr;
+
+  return static_cast<T *>(node);
+}
+
 
 class StatementNode : public AbstractNode
 {
 public:
 
-  void Walk(Visitor* visitor, bool visit = true) override;
+  NODE_KIND(StatementNode, AbstractNode, LocalVariableNode)
 };
 
 class BlockNode : public StatementNode
@@ -158,7 +289,8 @@ public:
   //Used to help with autocomplete
   std::unique_ptr<AbstractNode> End;
 
-  void Walk(Visitor* visitor, bool visit = true) override;
+  NODE_KIND(BlockNode, StatementNode, BlockNode)
+  void Children(std::vector<AbstractNode*> &children) override;
 
   //Semantic, holds all local symbols
   std::vector<Symbol *> localSymbols;
@@ -169,15 +301,15 @@ class TypeNode : public AbstractNode
 {
 public:
   Token Name;
-  size_t PointerCount;
+  size_t PointerCount = 0;
 
-  void Walk(Visitor* visitor, bool visit = true) override;
+  NODE_KIND(TypeNode, AbstractNode, TypeNode)
 
   //* Semantic Analysis *//
   // The symbol we resolved
   // Note that symbol resolution may actually need to create a type
   // For example, a pointer to a type may need to create a symbol
-  Type* SEM_Symbol;
+  Type* SEM_Symbol = nullptr;
 };
 
 class AssignmentNode : public StatementNode
@@ -189,7 +321,8 @@ public:
   unique_vector<VariableStatementNode> LeftVariables;
   unique_vector<ExpressionNode> RightExpressions;
 
-  void Walk(Visitor* visitor, bool visit = true) override;
+  NODE_KIND(AssignmentNode, StatementNode, AssignmentNode)
+  void Children(std::vector<AbstractNode*> &children) override;
 
   //Semantic
   std::vector<Symbol *> SEM_Variables;
@@ -198,10 +331,10 @@ public:
 class VariableNode : public AbstractNode
 {
 public:
-  void Walk(Visitor* visitor, bool visit = true) override;
+  NODE_KIND(VariableNode, AbstractNode, ExpressionVariableNode)
   
-  Type *SEM_ResolvedSymbol;
-  Variable *SEM_Variable;
+  Type *SEM_ResolvedSymbol = nullptr;
+  Variable *SEM_Variable = nullptr;
 };
 
 class VariableStatementNode : public VariableNode
@@ -211,7 +344,8 @@ public:
   std::unique_ptr<VariableNode> Variable;
   std::unique_ptr<VariableSuffixNode> Suffix;
   
-  void Walk(Visitor* visitor, bool visit = true) override;
+  NODE_KIND(VariableStatementNode, VariableNode, VariableStatementNode)
+  void Children(std::vector<AbstractNode*> &children) override;
 };
 
 class IdentifiedVariableNode : public VariableNode
@@ -219,7 +353,7 @@ class IdentifiedVariableNode : public VariableNode
 public:
   Token Name;
 
-  void Walk(Visitor* visitor, bool visit = true) override;
+  NODE_KIND(IdentifiedVariableNode, VariableNode, IdentifiedVariableNode)
 };
 
 class ExpressionVariableNode : public VariableNode
@@ -228,7 +362,8 @@ public:
   std::unique_ptr<ExpressionNode> Expression;
   std::unique_ptr<VariableSuffixNode> Suffix;
 
-  void Walk(Visitor* visitor, bool visit = true) override;
+  NODE_KIND(ExpressionVariableNode, VariableNode, ExpressionVariableNode)
+  void Children(std::vector<AbstractNode*> &children) override;
 };
 
 class VariableSuffixNode : public AbstractNode
@@ -243,11 +378,12 @@ public:
   //Index node, null means incomplete suffix
   std::unique_ptr<IndexNode> Index;
 
-  void Walk(Visitor* visitor, bool visit = true) override;
+  NODE_KIND(VariableSuffixNode, AbstractNode, VariableSuffixNode)
+  void Children(std::vector<AbstractNode*> &children) override;
 
   //Symbol this node is referring to
-  Symbol* SEM_ResolvedSymbol;
-  Variable *SEM_Variable;
+  Symbol* SEM_ResolvedSymbol = nullptr;
+  Variable *SEM_Variable = nullptr;
 };
 
 
@@ -257,9 +393,10 @@ class CallNode : public AbstractNode
 public:
   std::unique_ptr<ArgumentNode> Argument;
 
-  void Walk(Visitor* visitor, bool visit = true) override;
+  NODE_KIND(CallNode, AbstractNode, MemberCallNode)
+  void Children(std::vector<AbstractNode*> &children) override;
 
-  Symbol* SEM_ResolvedSymbol;
+  Symbol* SEM_ResolvedSymbol = nullptr;
 };
 
 class MemberCallNode : public CallNode
@@ -267,13 +404,13 @@ class MemberCallNode : public CallNode
 public:
   Token Name;
 
-  void Walk(Visitor* visitor, bool visit = true) override;
+  NODE_KIND(MemberCallNode, CallNode, MemberCallNode)
 };
 
 class ArgumentNode : public AbstractNode
 {
 public:
-  void Walk(Visitor* visitor, bool visit = true) override;
+  NODE_KIND(ArgumentNode, AbstractNode, StringArgumentNode)
 };
 
 class ExpressionArgumentNode : public ArgumentNode
@@ -281,7 +418,8 @@ class ExpressionArgumentNode : public ArgumentNode
 public:
   unique_vector<ExpressionNode> ExpressionList;
 
-  void Walk(Visitor* visitor, bool visit = true) override;
+  NODE_KIND(ExpressionArgumentNode, ArgumentNode, ExpressionArgumentNode)
+  void Children(std::vector<AbstractNode*> &children) override;
 };
 
 class TableArgumentNode : public ArgumentNode
@@ -289,7 +427,8 @@ class TableArgumentNode : public ArgumentNode
 public:
   std::unique_ptr<TableNode> Table;
 
-  void Walk(Visitor* visitor, bool visit = true) override;
+  NODE_KIND(TableArgumentNode, ArgumentNode, TableArgumentNode)
+  void Children(std::vector<AbstractNode*> &children) override;
 };
 
 class StringArgumentNode : public ArgumentNode
@@ -297,17 +436,17 @@ class StringArgumentNode : public ArgumentNode
 public:
   Token String;
 
-  void Walk(Visitor* visitor, bool visit = true) override;
+  NODE_KIND(StringArgumentNode, ArgumentNode, StringArgumentNode)
 };
 
 
 class IndexNode : public AbstractNode
 {
 public:
-  void Walk(Visitor* visitor, bool visit = true) override;
+  NODE_KIND(IndexNode, AbstractNode, ExpressionIndexNode)
 
   //Symbol this node is referring to
-  Variable *SEM_Variable;
+  Variable *SEM_Variable = nullptr;
 };
 
 class IdentifiedIndexNode : public IndexNode
@@ -315,7 +454,7 @@ class IdentifiedIndexNode : public IndexNode
 public:
   Token Name;
 
-  void Walk(Visitor* visitor, bool visit = true) override;
+  NODE_KIND(IdentifiedIndexNode, IndexNode, IdentifiedIndexNode)
 };
 
 class ExpressionIndexNode : public IndexNode
@@ -323,14 +462,15 @@ class ExpressionIndexNode : public IndexNode
 public:
   std::unique_ptr<ExpressionNode> Expression;
 
-  void Walk(Visitor* visitor, bool visit = true) override;
+  NODE_KIND(ExpressionIndexNode, IndexNode, ExpressionIndexNode)
+  void Children(std::vector<AbstractNode*> &children) override;
 };
 
 
 class BreakNode : public StatementNode
 {
 public:
-  void Walk(Visitor* visitor, bool visit = true) override;
+  NODE_KIND(BreakNode, StatementNode, BreakNode)
 };
 
 class ReturnNode : public StatementNode
@@ -338,7 +478,8 @@ class ReturnNode : public StatementNode
 public:
   unique_vector<ExpressionNode> ReturnValues;
 
-  void Walk(Visitor* visitor, bool visit = true) override;
+  NODE_KIND(ReturnNode, StatementNode, ReturnNode)
+  void Children(std::vector<AbstractNode*> &children) override;
 };
 
 class ExpressionNode : public StatementNode
@@ -346,16 +487,16 @@ class ExpressionNode : public StatementNode
 public:
   Token Expression;
 
-  void Walk(Visitor* visitor, bool visit = true) override;
+  NODE_KIND(ExpressionNode, StatementNode, BinaryOperatorNode)
 
-  Type *SEM_ResolvedType;
-  ValueData SEM_Value;
+  Type *SEM_ResolvedType = nullptr;
+  ValueData SEM_Value{};
 };
 
 class ValueNode : public ExpressionNode
 {
 public:
-  void Walk(Visitor* visitor, bool visit = true) override;
+  NODE_KIND(ValueNode, ExpressionNode, ValueNode)
 };
 
 class TableNode : public ExpressionNode
@@ -368,7 +509,8 @@ public:
   std::vector<IndexNode *> FullIndicies;
   std::vector<ExpressionNode *> FullValues;
 
-  void Walk(Visitor* visitor, bool visit = true) override;
+  NODE_KIND(TableNode, ExpressionNode, TableNode)
+  void Children(std::vector<AbstractNode*> &children) override;
 };
 
 class FunctionExpressionNode : public ExpressionNode
@@ -376,7 +518,8 @@ class FunctionExpressionNode : public ExpressionNode
 public:
   std::unique_ptr<FunctionNode> Function;
 
-  void Walk(Visitor* visitor, bool visit = true) override;
+  NODE_KIND(FunctionExpressionNode, ExpressionNode, FunctionExpressionNode)
+  void Children(std::vector<AbstractNode*> &children) override;
 };
 
 class FunctionCallNode : public ExpressionNode
@@ -385,7 +528,8 @@ public:
   std::unique_ptr<VariableStatementNode> Variable;
   unique_vector<CallNode> Calls;
 
-  void Walk(Visitor* visitor, bool visit = true) override;
+  NODE_KIND(FunctionCallNode, ExpressionNode, FunctionCallNode)
+  void Children(std::vector<AbstractNode*> &children) override;
 };
 
 class PrefixExpressionNode : public ExpressionNode
@@ -394,7 +538,8 @@ public:
   std::unique_ptr<VariableStatementNode> LeftVar;
   unique_vector<CallNode> RightCalls;
 
-  void Walk(Visitor* visitor, bool visit = true) override;
+  NODE_KIND(PrefixExpressionNode, ExpressionNode, PrefixExpressionNode)
+  void Children(std::vector<AbstractNode*> &children) override;
 };
 
 class UnaryOperatorNode : public ExpressionNode
@@ -403,7 +548,8 @@ public:
   Token Operator;
   std::unique_ptr<ExpressionNode> Right;
 
-  void Walk(Visitor* visitor, bool visit = true) override;
+  NODE_KIND(UnaryOperatorNode, ExpressionNode, UnaryOperatorNode)
+  void Children(std::vector<AbstractNode*> &children) override;
 };
 
 class BinaryOperatorNode : public ExpressionNode
@@ -413,7 +559,8 @@ public:
   std::unique_ptr<ExpressionNode> Left;
   std::unique_ptr<ExpressionNode> Right;
 
-  void Walk(Visitor* visitor, bool visit = true) override;
+  NODE_KIND(BinaryOperatorNode, ExpressionNode, BinaryOperatorNode)
+  void Children(std::vector<AbstractNode*> &children) override;
 };
 
 class FunctionNode : public StatementNode
@@ -428,10 +575,16 @@ public:
 
   std::unique_ptr<BlockNode> Block;
 
-  void Walk(Visitor* visitor, bool visit = true) override;
+  NODE_KIND(FunctionNode, StatementNode, FunctionNode)
+  void Children(std::vector<AbstractNode*> &children) override;
+
+  Type *SYM_ReturnType = nullptr;
+  Variable *SYM_Variable = nullptr;
 
-  Type *SYM_ReturnType;
-  Variable *SYM_Variable;
+  //The body is still to be resolved (see ResolveTypesAt), and how many members of the enclosing function it
+  //could see when it was left
+  bool SEM_Deferred = false;
+  size_t SEM_VisibleMembers = 0;
 };
 
 class FunctionNameNode : public AbstractNode
@@ -440,7 +593,7 @@ public:
   Token Name;
   bool IsMemberFunc = false;
 
-  void Walk(Visitor* visitor, bool visit = true) override;
+  NODE_KIND(FunctionNameNode, AbstractNode, FunctionNameNode)
 };
 
 class WhileNode : public StatementNode
@@ -450,7 +603,8 @@ public:
 
   std::unique_ptr<BlockNode> Block;
 
-  void Walk(Visitor* visitor, bool visit = true) override;
+  NODE_KIND(WhileNode, StatementNode, WhileNode)
+  void Children(std::vector<AbstractNode*> &children) override;
 };
 
 class RepeatNode : public StatementNode
@@ -460,7 +614,8 @@ public:
 
   std::unique_ptr<ExpressionNode> Condition;
 
-  void Walk(Visitor* visitor, bool visit = true) override;
+  NODE_KIND(RepeatNode, StatementNode, RepeatNode)
+  void Children(std::vector<AbstractNode*> &children) override;
 };
 
 class IfNode : public StatementNode
@@ -473,7 +628,8 @@ public:
 
   std::unique_ptr<IfNode> Else;
 
-  void Walk(Visitor* visitor, bool visit = true) override;
+  NODE_KIND(IfNode, StatementNode, IfNode)
+  void Children(std::vector<AbstractNode*> &children) override;
 };
 
 class ForNode : public StatementNode
@@ -482,7 +638,8 @@ public:
 
   std::unique_ptr<BlockNode> Block;
 
-  void Walk(Visitor* visitor, bool visit = true) override;
+  NODE_KIND(ForNode, StatementNode, GenericForNode)
+  void Children(std::vector<AbstractNode*> &children) override;
 };
 
 class NumericForNode : public ForNode
@@ -495,7 +652,8 @@ public:
   std::unique_ptr<ExpressionNode> Step;
 
 
-  void Walk(Visitor* visitor, bool visit = true) override;
+  NODE_KIND(NumericForNode, ForNode, NumericForNode)
+  void Children(std::vector<AbstractNode*> &children) override;
 };
 
 class GenericForNode : public ForNode
@@ -504,7 +662,8 @@ public:
   std::vector<Token> Names;
   unique_vector<ExpressionNode> ExpressionList;
 
-  void Walk(Visitor* visitor, bool visit = true) override;
+  NODE_KIND(GenericForNode, ForNode, GenericForNode)
+  void Children(std::vector<AbstractNode*> &children) override;
 };
 
 class LocalVariableNode : public StatementNode
@@ -513,7 +672,8 @@ public:
   std::vector<Token> Names;
   unique_vector<ExpressionNode> ExpressionList;
 
-  void Walk(Visitor* visitor, bool visit = true) override;
+  NODE_KIND(LocalVariableNode, StatementNode, LocalVariableNode)
+  void Children(std::vector<AbstractNode*> &children) override;
 };
 
 //  Print Visitor //
@@ -563,5 +723,32 @@ private:
   static std::vector<NodePrinter*> ActiveNodes;
 };
 
-void ResolveTypes(AbstractNode *ast, Library *lib, LibraryReference *libRef);
+// Base for the visitors that print the tree. A node's printer stays open until the node is left, so everything
+// under it prints nested inside.
+class TreePrinter : public Visitor
+{
+public:
+  NodePrinter &Open()
+  {
+    printers.push_back(std::make_unique<NodePrinter>());
+    return *printers.back();
+  }
+
+  void Leave(AbstractNode* node) override
+  {
+    printers.pop_back();
+  }
+
+private:
+  std::vector<std::unique_ptr<NodePrinter>> printers;
+};
+
+//With deferFunctions only the main chunk is resolved, the bodies of the functions in it are left until
+//ResolveTypesAt is asked about a position inside them
+void ResolveTypes(AbstractNode *ast, Library *lib, LibraryReference *libRef, bool deferFunctions = false);
+
+//Resolves the bodies ResolveTypes deferred of the functions around position, outermost first. A body is only
+//resolved once, it stays resolved for as long as the tree is kept.
+void ResolveTypesAt(AbstractNode *ast, DocumentPosition position, Library *lib, LibraryReference *libRef);
+
 void PrintTypes(AbstractNode *ast);
\ No newline at end of file
@@ -3,6 +3,9 @@
 #include <sstream>
 #include <stack>
 #include <functional>
+#include <algorithm>
+#include <unordered_set>
+#include "FuzzyMatch.h"
 
 const char* keywords[] =
 {
@@ -12,58 +15,50 @@ const char* keywords[] =
 #undef TOKEN
 };
 
-class LocationPrinter : public Visitor
+class LocationPrinter : public TreePrinter
 {
 public:
   DocumentPosition lastPosition;
 
   virtual VisitResult Visit(AbstractNode* node)
   {
-    NodePrinter printer;
+    NodePrinter &printer = Open();
     printer << "AbstractNode";
     printer << "   [" << node->Position.Line << "," << node->Position.Character << "]";
 
-    node->Walk(this, false);
-
-    return VisitResult::Stop;
+    return VisitResult::Continue;
   }
 
   virtual VisitResult Visit(BlockNode* node)
   {
-    NodePrinter printer;
+    NodePrinter &printer = Open();
     printer << "BlockNode";
     printer << "   [" << node->Position.Line << "," << node->Position.Character << "]";
 
-    node->Walk(this, false);
-
-    return VisitResult::Stop;
+    return VisitResult::Continue;
   }
 
   virtual VisitResult Visit(StatementNode* node)
   {
-    NodePrinter printer;
+    NodePrinter &printer = Open();
     printer << "StatementNode";
     printer << "   [" << node->Position.Line << "," << node->Position.Character << "]";
 
-    node->Walk(this, false);
-
-    return VisitResult::Stop;
+    return VisitResult::Continue;
   }
 
   virtual VisitResult Visit(TypeNode* node)
   {
-    NodePrinter printer;
+    NodePrinter &printer = Open();
     printer << "TypeNode(" << node->Name << ")";
     printer << "   [" << node->Position.Line << "," << node->Position.Character << "]";
 
-    node->Walk(this, false);
-
-    return VisitResult::Stop;
+    return VisitResult::Continue;
   }
 
   virtual VisitResult Visit(AssignmentNode* node)
   {
-    NodePrinter printer;
+    NodePrinter &printer = Open();
     printer << "AssignmentNode [" << node->Operator << "](";
 
     for (auto &token : node->Names)
@@ -84,279 +79,229 @@ public:
 
     typePrinter << ")";
 
-    node->Walk(this, false);
-
-    return VisitResult::Stop;
+    return VisitResult::Continue;
   }
 
   virtual VisitResult Visit(VariableNode* node)
   {
-    NodePrinter printer;
+    NodePrinter &printer = Open();
     printer << "VariableNode" << " - " << node->SEM_ResolvedSymbol;
 
-    node->Walk(this, false);
-
-    return VisitResult::Stop;
+    return VisitResult::Continue;
   }
 
   virtual VisitResult Visit(VariableStatementNode* node)
   {
-    NodePrinter printer;
+    NodePrinter &printer = Open();
     printer << "VariableStatementNode" << " - " << node->SEM_ResolvedSymbol;
     printer << "   [" << node->Position.Line << "," << node->Position.Character << "]";
 
-    node->Walk(this, false);
-
-    return VisitResult::Stop;
+    return VisitResult::Continue;
   }
 
   virtual VisitResult Visit(IdentifiedVariableNode* node)
   {
-    NodePrinter printer;
+    NodePrinter &printer = Open();
     printer << "IdentifiedVariableNode(" << node->Name << ")" << " - " << node->SEM_ResolvedSymbol;
     printer << "   [" << node->Position.Line << "," << node->Position.Character << "]";
 
-    node->Walk(this, false);
-
-    return VisitResult::Stop;
+    return VisitResult::Continue;
   }
 
   virtual VisitResult Visit(ExpressionVariableNode* node)
   {
-    NodePrinter printer;
+    NodePrinter &printer = Open();
     printer << "ExpressionVariableNode" << " - " << node->SEM_ResolvedSymbol;
     printer << "   [" << node->Position.Line << "," << node->Position.Character << "]";
 
-    node->Walk(this, false);
-
-    return VisitResult::Stop;
+    return VisitResult::Continue;
   }
 
   virtual VisitResult Visit(VariableSuffixNode* node)
   {
-    NodePrinter printer;
+    NodePrinter &printer = Open();
     printer << "VariableSuffixNode" << " - " << node->SEM_ResolvedSymbol;
     printer << "   [" << node->Position.Line << "," << node->Position.Character << "]";
 
-    node->Walk(this, false);
-
-    return VisitResult::Stop;
+    return VisitResult::Continue;
   }
 
   virtual VisitResult Visit(CallNode* node)
   {
-    NodePrinter printer;
+    NodePrinter &printer = Open();
     printer << "CallNode";
     printer << "   [" << node->Position.Line << "," << node->Position.Character << "]";
 
-    node->Walk(this, false);
-
-    return VisitResult::Stop;
+    return VisitResult::Continue;
   }
 
   virtual VisitResult Visit(MemberCallNode* node)
   {
-    NodePrinter printer;
+    NodePrinter &printer = Open();
     printer << "MemberCallNode(" << node->Name << ")";
     printer << "   [" << node->Position.Line << "," << node->Position.Character << "]";
 
-    node->Walk(this, false);
-
-    return VisitResult::Stop;
+    return VisitResult::Continue;
   }
 
   virtual VisitResult Visit(ArgumentNode* node)
   {
-    NodePrinter printer;
+    NodePrinter &printer = Open();
     printer << "ArgumentNode";
     printer << "   [" << node->Position.Line << "," << node->Position.Character << "]";
 
-    node->Walk(this, false);
-
-    return VisitResult::Stop;
+    return VisitResult::Continue;
   }
 
   virtual VisitResult Visit(ExpressionArgumentNode* node)
   {
-    NodePrinter printer;
+    NodePrinter &printer = Open();
     printer << "ExpressionArgumentNode";
     printer << "   [" << node->Position.Line << "," << node->Position.Character << "]";
 
-    node->Walk(this, false);
-
-    return VisitResult::Stop;
+    return VisitResult::Continue;
   }
 
   virtual VisitResult Visit(TableArgumentNode* node)
   {
-    NodePrinter printer;
+    NodePrinter &printer = Open();
     printer << "TableArgumentNode";
     printer << "   [" << node->Position.Line << "," << node->Position.Character << "]";
 
-    node->Walk(this, false);
-
-    return VisitResult::Stop;
+    return VisitResult::Continue;
   }
 
   virtual VisitResult Visit(StringArgumentNode* node)
   {
-    NodePrinter printer;
+    NodePrinter &printer = Open();
     printer << "StringArgumentNode(" << node->String << ")";
     printer << "   [" << node->Position.Line << "," << node->Position.Character << "]";
 
-    node->Walk(this, false);
-
-    return VisitResult::Stop;
+    return VisitResult::Continue;
   }
 
 
   virtual VisitResult Visit(IndexNode* node)
   {
-    NodePrinter printer;
+    NodePrinter &printer = Open();
     printer << "IndexNode";
     printer << "   [" << node->Position.Line << "," << node->Position.Character << "]";
 
-    node->Walk(this, false);
-
-    return VisitResult::Stop;
+    return VisitResult::Continue;
   }
 
   virtual VisitResult Visit(IdentifiedIndexNode* node)
   {
-    NodePrinter printer;
+    NodePrinter &printer = Open();
     printer << "IdentifiedIndexNode(" << node->Name << ")";
     printer << "   [" << node->Position.Line << "," << node->Position.Character << "]";
 
-    node->Walk(this, false);
-
-    return VisitResult::Stop;
+    return VisitResult::Continue;
   }
 
   virtual VisitResult Visit(ExpressionIndexNode* node)
   {
-    NodePrinter printer;
+    NodePrinter &printer = Open();
     printer << "ExpressionIndexNode";
     printer << "   [" << node->Position.Line << "," << node->Position.Character << "]";
 
-    node->Walk(this, false);
-
-    return VisitResult::Stop;
+    return VisitResult::Continue;
   }
 
 
   virtual VisitResult Visit(BreakNode* node)
   {
-    NodePrinter printer;
+    NodePrinter &printer = Open();
     printer << "BreakNode";
     printer << "   [" << node->Position.Line << "," << node->Position.Character << "]";
 
-    node->Walk(this, false);
-
-    return VisitResult::Stop;
+    return VisitResult::Continue;
   }
 
   virtual VisitResult Visit(ReturnNode* node)
   {
-    NodePrinter printer;
+    NodePrinter &printer = Open();
     printer << "ReturnNode";
     printer << "   [" << node->Position.Line << "," << node->Position.Character << "]";
 
-    node->Walk(this, false);
-
-    return VisitResult::Stop;
+    return VisitResult::Continue;
   }
 
   virtual VisitResult Visit(ExpressionNode* node)
   {
-    NodePrinter printer;
+    NodePrinter &printer = Open();
     printer << "ExpressionNode(" << node->SEM_ResolvedType << ")";
     printer << "   [" << node->Position.Line << "," << node->Position.Character << "]";
 
-    node->Walk(this, false);
-
-    return VisitResult::Stop;
+    return VisitResult::Continue;
   }
 
   virtual VisitResult Visit(ValueNode* node)
   {
-    NodePrinter printer;
+    NodePrinter &printer = Open();
     printer << "ValueNode(" << node->Expression << ")" << " - " << node->SEM_ResolvedType << " : " << node->SEM_Value;
     printer << "   [" << node->Position.Line << "," << node->Position.Character << "]";
 
-    node->Walk(this, false);
-
-    return VisitResult::Stop;
+    return VisitResult::Continue;
   }
 
   virtual VisitResult Visit(TableNode* node)
   {
-    NodePrinter printer;
+    NodePrinter &printer = Open();
     printer << "TableNode" << " - " << node->SEM_ResolvedType;
     printer << "   [" << node->Position.Line << "," << node->Position.Character << "]";
 
-    node->Walk(this, false);
-
-    return VisitResult::Stop;
+    return VisitResult::Continue;
   }
 
   virtual VisitResult Visit(FunctionExpressionNode* node)
   {
-    NodePrinter printer;
+    NodePrinter &printer = Open();
     printer << "FunctionExpressionNode" << " - " << node->SEM_ResolvedType;
     printer << "   [" << node->Position.Line << "," << node->Position.Character << "]";
 
-    node->Walk(this, false);
-
-    return VisitResult::Stop;
+    return VisitResult::Continue;
   }
 
   virtual VisitResult Visit(FunctionCallNode* node)
   {
-    NodePrinter printer;
+    NodePrinter &printer = Open();
     printer << "FunctionCallNode" << " - " << node->SEM_ResolvedType;
     printer << "   [" << node->Position.Line << "," << node->Position.Character << "]";
 
-    node->Walk(this, false);
-
-    return VisitResult::Stop;
+    return VisitResult::Continue;
   }
 
   virtual VisitResult Visit(PrefixExpressionNode* node)
   {
-    NodePrinter printer;
+    NodePrinter &printer = Open();
     printer << "PrefixExpressionNode" << " - " << node->SEM_ResolvedType << " : " << node->SEM_Value;
     printer << "   [" << node->Position.Line << "," << node->Position.Character << "]";
 
-    node->Walk(this, false);
-
-    return VisitResult::Stop;
+    return VisitResult::Continue;
   }
 
   virtual VisitResult Visit(UnaryOperatorNode* node)
   {
-    NodePrinter printer;
+    NodePrinter &printer = Open();
     printer << "UnaryOperatorNode(" << node->Operator << ")" << " - " << node->SEM_ResolvedType << " : " << node->SEM_Value;
     printer << "   [" << node->Position.Line << "," << node->Position.Character << "]";
 
-    node->Walk(this, false);
-
-    return VisitResult::Stop;
+    return VisitResult::Continue;
   }
 
   virtual VisitResult Visit(BinaryOperatorNode* node)
   {
-    NodePrinter printer;
+    NodePrinter &printer = Open();
     printer << "BinaryOperatorNode(" << node->Operator << ")" << " - " << node->SEM_ResolvedType << " : " << node->SEM_Value;
     printer << "   [" << node->Position.Line << "," << node->Position.Character << "]";
 
-    node->Walk(this, false);
-
-    return VisitResult::Stop;
+    return VisitResult::Continue;
   }
 
   virtual VisitResult Visit(FunctionNode* node)
   {
-    NodePrinter printer;
+    NodePrinter &printer = Open();
     printer << "FunctionNode" << " - " << node->SYM_ReturnType;
     printer << "   [" << node->Position.Line << "," << node->Position.Character << "]";
 
@@ -365,58 +310,48 @@ public:
       printer << " | " << token;
     }
 
-    node->Walk(this, false);
-
-    return VisitResult::Stop;
+    return VisitResult::Continue;
   }
 
   virtual VisitResult Visit(FunctionNameNode* node)
   {
-    NodePrinter printer;
+    NodePrinter &printer = Open();
     printer << "FunctionNameNode(" << node->Name << "," << node->IsMemberFunc << ")";
     printer << "   [" << node->Position.Line << "," << node->Position.Character << "]";
 
-    node->Walk(this, false);
-
-    return VisitResult::Stop;
+    return VisitResult::Continue;
   }
 
   virtual VisitResult Visit(WhileNode* node)
   {
-    NodePrinter printer;
+    NodePrinter &printer = Open();
     printer << "WhileNode";
     printer << "   [" << node->Position.Line << "," << node->Position.Character << "]";
 
-    node->Walk(this, false);
-
-    return VisitResult::Stop;
+    return VisitResult::Continue;
   }
 
   virtual VisitResult Visit(IfNode* node)
   {
-    NodePrinter printer;
+    NodePrinter &printer = Open();
     printer << "IfNode";
     printer << "   [" << node->Position.Line << "," << node->Position.Character << "]";
 
-    node->Walk(this, false);
-
-    return VisitResult::Stop;
+    return VisitResult::Continue;
   }
 
   virtual VisitResult Visit(ForNode* node)
   {
-    NodePrinter printer;
+    NodePrinter &printer = Open();
     printer << "ForNode";
     printer << "   [" << node->Position.Line << "," << node->Position.Character << "]";
 
-    node->Walk(this, false);
-
-    return VisitResult::Stop;
+    return VisitResult::Continue;
   }
 
   virtual VisitResult Visit(GenericForNode* node)
   {
-    NodePrinter printer;
+    NodePrinter &printer = Open();
     printer << "GenericForNode";
 
     for (auto &token : node->Names)
@@ -425,36 +360,30 @@ public:
     }
     printer << "   [" << node->Position.Line << "," << node->Position.Character << "]";
 
-    node->Walk(this, false);
-
-    return VisitResult::Stop;
+    return VisitResult::Continue;
   }
 
   virtual VisitResult Visit(NumericForNode* node)
   {
-    NodePrinter printer;
+    NodePrinter &printer = Open();
     printer << "NumericForNode";
     printer << "   [" << node->Position.Line << "," << node->Position.Character << "]";
 
-    node->Walk(this, false);
-
-    return VisitResult::Stop;
+    return VisitResult::Continue;
   }
 
   virtual VisitResult Visit(RepeatNode* node)
   {
-    NodePrinter printer;
+    NodePrinter &printer = Open();
     printer << "RepeatNode";
     printer << "   [" << node->Position.Line << "," << node->Position.Character << "]";
 
-    node->Walk(this, false);
-
-    return VisitResult::Stop;
+    return VisitResult::Continue;
   }
 
   virtual VisitResult Visit(LocalVariableNode* node)
   {
-    NodePrinter printer;
+    NodePrinter &printer = Open();
     printer << "LocalVariableNode";
 
     for (auto &token : node->Names)
@@ -470,9 +399,7 @@ public:
     }
     printer << "   [" << node->Position.Line << "," << node->Position.Character << "]";
 
-    node->Walk(this, false);
-
-    return VisitResult::Stop;
+    return VisitResult::Continue;
   }
 };
 
@@ -494,10 +421,52 @@ public:
     if (node->Position == position || (node->Position < position && (foundNode->Position == node->Position || foundNode->Position < node->Position)))
       foundNode = node;
 
-    node->Walk(this, false);
+    return VisitResult::Continue;
+  }
+
+  //Statements follow each other in the text, so everything in the ones before the last statement starting at
+  //or before position comes before that statement, and everything in the ones after it comes after position.
+  //Only that one is walked instead of the whole tree.
+  virtual VisitResult Visit(BlockNode* node)
+  {
+    Visit((AbstractNode *)node);
+
+    auto &statements = node->Statements;
+    auto after = std::upper_bound(statements.begin(), statements.end(), position,
+      [this](DocumentPosition position, const std::unique_ptr<StatementNode> &statement)
+    {
+      DocumentPosition start = Start(statement.get());
+      return position < start;
+    });
+
+    if (after != statements.begin())
+      (*(after - 1))->Walk(this);
+    if (node->End)
+      node->End->Walk(this);
 
     return VisitResult::Stop;
   }
+
+private:
+  std::vector<AbstractNode *> children;
+
+  //Where the text of a node starts. Its own position can be further in (an assignment is at its operator),
+  //the first child comes first in the text.
+  DocumentPosition Start(AbstractNode *node)
+  {
+    DocumentPosition start = node->Position;
+    for (;;)
+    {
+      children.clear();
+      node->Children(children);
+      if (children.empty())
+        return start;
+
+      node = children.front();
+      if (node->Position < start)
+        start = node->Position;
+    }
+  }
 };
 
 class GenerateAutoComplete : public Visitor
@@ -510,19 +479,28 @@ public:
   std::vector<AutoCompleteEntry> &entries;
   Library *lib;
   Token::Type::Enum foundToken;
+  std::string prefix;
+
+  //Scope given to the entries being added
+  unsigned scope = GlobalCompletionScope;
+
+  //Names already added, the first (closest) one wins
+  std::unordered_set<std::string> added;
 
   void AddEntry(AutoCompleteEntry e)
   {
-    for (AutoCompleteEntry &entry : entries)
-    {
-      if (entry.name == e.name)
-        return;
-    }
-
     if (foundToken == Token::Type::Colon && e.entryKind != CompletionItemKind::Method)
       return;
 
-    entries.push_back(e);
+    //The fuzzy match at the end would drop it anyway
+    if (!prefix.empty() && !HasWordStartingWith(e.name.data(), e.name.size(), prefix[0]))
+      return;
+
+    if (!added.insert(e.name).second)
+      return;
+
+    e.scope = scope;
+    entries.push_back(std::move(e));
   }
 
   Variable *GetVariable(AbstractNode *node, std::string const &name)
@@ -532,7 +510,7 @@ public:
     AbstractNode *currentNode = node;
     while (currentNode != nullptr)
     {
-      BlockNode *block = dynamic_cast<BlockNode *>(currentNode);
+      BlockNode *block = NodeCast<BlockNode>(currentNode);
       if (block)
       {
         parentStack.push_back(block);
@@ -547,7 +525,7 @@ public:
       BlockNode *block = parentStack[i];
       for (Symbol *sym : block->localSymbols)
       {
-        Variable *var = dynamic_cast<Variable *>(sym);
+        Variable *var = SymbolCast<Variable>(sym);
         if (var && var->Name == name)
           return var;
       }
@@ -558,7 +536,7 @@ public:
     {
       if (var->Name == name)
       {
-        return dynamic_cast<Variable *>(var);
+        return SymbolCast<Variable>(var);
       }
     }
 
@@ -601,35 +579,43 @@ public:
     return CompletionItemKind::Text;
   }
 
-  void AddMembers(Symbol *sym)
+  void AddMembers(Symbol *sym, bool skipGlobals = false)
   {
     if (sym == nullptr || sym->GetResolvedType() == nullptr)
       return;
 
     for (Variable *var : sym->GetResolvedType()->Members)
     {
-      TableData *tableData = dynamic_cast<TableData *>(var);
-      if (tableData)
+      if (skipGlobals && var->IsGlobal)
+        continue;
+
+      AddMember(var);
+    }
+  }
+
+  void AddMember(Variable *var)
+  {
+    TableData *tableData = SymbolCast<TableData>(var);
+    if (tableData)
+    {
+      if (tableData->Index.Type == ExpressionType::String && !tableData->Index.Data.String.empty())
       {
-        if (tableData->Index.Type == ExpressionType::String && !tableData->Index.Data.String.empty())
-        {
-          AutoCompleteEntry entry;
-          entry.name = tableData->Index.Data.String;
-          entry.entryKind = ResolveEntryKind(tableData);
+        AutoCompleteEntry entry;
+        entry.name = tableData->Index.Data.String;
+        entry.entryKind = ResolveEntryKind(tableData);
 
-          AddEntry(entry);
-        }
+        AddEntry(entry);
       }
-      else
+    }
+    else
+    {
+      if (!var->Name.empty())
       {
-        if (!var->Name.empty())
-        {
-          AutoCompleteEntry entry;
-          entry.name = var->Name;
-          entry.entryKind = ResolveEntryKind(var);
+        AutoCompleteEntry entry;
+        entry.name = var->Name;
+        entry.entryKind = ResolveEntryKind(var);
 
-          AddEntry(entry);
-        }
+        AddEntry(entry);
       }
     }
   }
@@ -640,7 +626,7 @@ public:
     NodePrinter printer;
     printer << "FunctionNameNode" << "   [" << node->Position.Line << "," << node->Position.Character << "]";
 
-    FunctionNode *func = dynamic_cast<FunctionNode *>(node->Parent);
+    FunctionNode *func = NodeCast<FunctionNode>(node->Parent);
     if (func)
     {
       //First, get our position in the array
@@ -706,7 +692,7 @@ public:
     NodePrinter printer;
     printer << "MemberCallNode" << "   [" << node->Position.Line << "," << node->Position.Character << "]";
 
-    FunctionCallNode *callNode = dynamic_cast<FunctionCallNode *>(node->Parent);
+    FunctionCallNode *callNode = NodeCast<FunctionCallNode>(node->Parent);
     if (callNode)
     {
       if (callNode->Variable->SEM_Variable)
@@ -744,7 +730,7 @@ public:
     printer << "IdentifiedIndexNode" << "   [" << node->Position.Line << "," << node->Position.Character << "]";
 
     //First, attempt to find the symbol to the left of us
-    VariableSuffixNode *vs = dynamic_cast<VariableSuffixNode *>(node->Parent);
+    VariableSuffixNode *vs = NodeCast<VariableSuffixNode>(node->Parent);
     if (vs)
     {
       //If the suffix has a valid symbol to the left
@@ -776,9 +762,9 @@ public:
       }
       
       //Otherwise, try to get the parent
-      if (dynamic_cast<VariableStatementNode *>(vs->Parent))
+      if (NodeCast<VariableStatementNode>(vs->Parent))
       {
-        AddMembers(dynamic_cast<VariableStatementNode *>(vs->Parent)->Variable->SEM_Variable);
+        AddMembers(NodeCast<VariableStatementNode>(vs->Parent)->Variable->SEM_Variable);
         return VisitResult::Stop;
       }
     }
@@ -794,40 +780,60 @@ public:
     NodePrinter printer;
     printer << "AbstractNode" << "   [" << node->Position.Line << "," << node->Position.Character << "]";
 
-    //Add all locals this should know about
+    //Add all locals this should know about, the closest blocks first
     AbstractNode *currentNode = node;
+    scope = 0;
     while (currentNode != nullptr)
     {
-      BlockNode *block = dynamic_cast<BlockNode *>(currentNode);
+      BlockNode *block = NodeCast<BlockNode>(currentNode);
       if (block)
       {
         for (Symbol *sym : block->localSymbols)
         {
           AutoCompleteEntry entry;
           entry.name = sym->Name;
-          entry.entryKind = ResolveEntryKind(dynamic_cast<Variable *>(sym));
+          entry.entryKind = ResolveEntryKind(SymbolCast<Variable>(sym));
 
           AddEntry(entry);
         }
+
+        ++scope;
       }
 
       currentNode = currentNode->Parent;
     }
 
-    //Add all globals as well
-    for (Symbol *sym : lib->Globals)
+    //Add all globals as well. When something's being typed, only the ones with a word starting with its
+    //first character can match, so they and the rest of the global table come out of the library's indexes.
+    scope = GlobalCompletionScope;
+    std::vector<Symbol *> globals;
+    if (prefix.empty())
+      globals = lib->Globals;
+    else
+      lib->FindGlobals(prefix[0], globals);
+
+    for (Symbol *sym : globals)
     {
       AutoCompleteEntry entry;
       entry.name = sym->Name;
-      entry.entryKind = ResolveEntryKind(dynamic_cast<Variable *>(sym));
+      entry.entryKind = ResolveEntryKind(SymbolCast<Variable>(sym));
 
       AddEntry(entry);
     }
 
-    //Add everything from the global table
-    AddMembers(lib->globalTable);
+    //Add everything else from the global table
+    if (prefix.empty())
+      AddMembers(lib->globalTable, true);
+    else
+    {
+      std::vector<Symbol *> members;
+      lib->FindGlobalTableMembers(prefix[0], members);
+      for (Symbol *sym : members)
+        AddMember(SymbolCast<Variable>(sym));
+    }
 
     //Finally, add in the keywords
+    scope = KeywordCompletionScope;
     for (int i = 0; i < sizeof(keywords) / sizeof(keywords[0]); ++i)
     {
       AutoCompleteEntry entry;
@@ -843,41 +849,124 @@ public:
   //Used to trigger variable lookup for index nodes
   virtual VisitResult Visit(VariableSuffixNode* node)
   {
-    node->Walk(this, false);
-    return VisitResult::Stop;
+    return VisitResult::Continue;
   }
 };
 
-void ResolveAutocomplete(AbstractNode *ast, int lineNumber, int charNumber, std::vector<AutoCompleteEntry> &output, Library *lib, std::vector<Token> &tokens)
+void ResolveAutocomplete(AbstractNode *ast, int lineNumber, int charNumber, const std::string &prefix, std::vector<AutoCompleteEntry> &output, Library *lib, std::vector<Token> &tokens)
 {
   //Get specific token from line + char
   Token::Type::Enum currentTokenType = Token::Type::Invalid;
   DocumentPosition pos(lineNumber, charNumber);
 
-  for (int i = 0; i < tokens.size(); ++i)
-  {
-    if (tokens[i].Position.Line == lineNumber && tokens[i].Position.Character == charNumber)
-      currentTokenType = tokens[i].EnumTokenType;
-  }
-  my_log("GOT %i NOT %i\n", currentTokenType, Token::Type::Dot);
+  //Tokens are in the order of the text
+  auto after = std::upper_bound(tokens.begin(), tokens.end(), pos, [](DocumentPosition position, Token &token) { return position < token.Position; });
+  if (after != tokens.begin() && (after - 1)->Position == pos)
+    currentTokenType = (after - 1)->EnumTokenType;
 
   LocateNode visitor(DocumentPosition(lineNumber, charNumber));
   ast->Walk(&visitor);
 
+  //Printing the whole tree on every request costs more than the completion itself
+#ifdef AUTOCOMPLETE_DEBUG
+  my_log("GOT %i NOT %i\n", currentTokenType, Token::Type::Dot);
+
   LocationPrinter print;
   ast->Walk(&print);
   my_log("\n");
+#endif
   //visitor.foundNode->Walk(&print);
   //my_log("\n");
 
   GenerateAutoComplete autoCompleteVisitor(output);
   autoCompleteVisitor.lib = lib;
   autoCompleteVisitor.foundToken = currentTokenType;
+  autoCompleteVisitor.prefix = prefix;
 
   //if (currentTokenType == Token::Type::Dot || currentTokenType == Token::Type::Colon)
   visitor.foundNode->Walk(&autoCompleteVisitor);
   //else
   //  autoCompleteVisitor.Visit(visitor.foundNode);
+
+  if (prefix.empty())
+    return;
+
+  //Keep the candidates the prefix fuzzy matches
+  FuzzyCandidates candidates;
+  for (const AutoCompleteEntry &entry : output)
+    candidates.Add(entry.name.data(), entry.name.size());
+
+  std::vector<unsigned> scores;
+  candidates.Match(prefix.data(), prefix.size(), scores);
+
+  size_t kept = 0;
+  for (size_t i = 0; i < output.size(); ++i)
+  {
+    if (scores[i] == 0)
+      continue;
+
+    output[i].match = scores[i];
+    if (kept != i)
+      output[kept] = std::move(output[i]);
+    ++kept;
+  }
+
+  output.resize(kept);
+}
+
+//@TODO: Fix the weird bug when deleting a name that has been autocompleted
+
+//Lower is better
+static unsigned KindRank(CompletionItemKind kind)
+{
+  switch (kind)
+  {
+  case CompletionItemKind::Method:
+  case CompletionItemKind::Field:
+    return 0;
+
+  case CompletionItemKind::Function:
+  case CompletionItemKind::Variable:
+  case CompletionItemKind::Module:
+    return 1;
+
+  case CompletionItemKind::Keyword:
+    return 3;
+
+  default:
+    return 2;
+  }
+}
+
+static bool RanksBefore(const AutoCompleteEntry &lhs, const AutoCompleteEntry &rhs)
+{
+  //Whatever starts with the prefix comes before names it only fuzzy matches
+  bool lhsPrefix = lhs.match >= FuzzyPrefixMatch;
+  bool rhsPrefix = rhs.match >= FuzzyPrefixMatch;
+  if (lhsPrefix != rhsPrefix)
+    return lhsPrefix;
+
+  if (lhs.scope != rhs.scope)
+    return lhs.scope < rhs.scope;
+
+  unsigned lhsKind = KindRank(lhs.entryKind);
+  unsigned rhsKind = KindRank(rhs.entryKind);
+  if (lhsKind != rhsKind)
+    return lhsKind < rhsKind;
+
+  if (lhs.match != rhs.match)
+    return lhs.match > rhs.match;
+
+  if (lhs.uses != rhs.uses)
+    return lhs.uses > rhs.uses;
+
+  return lhs.name < rhs.name;
 }
 
-//@TODO: Fix the weird bug when deleting a name that has been autocompleted
\ No newline at end of file
+void RankAutocomplete(std::vector<AutoCompleteEntry> &entries, size_t maxEntries)
+{
+  if (maxEntries == 0 || maxEntries > entries.size())
+    maxEntries = entries.size();
+
+  std::partial_sort(entries.begin(), entries.begin() + maxEntries, entries.end(), RanksBefore);
+}
@@ -30,8 +30,25 @@ struct AutoCompleteEntry
 {
   std::string name;
   CompletionItemKind entryKind = CompletionItemKind::Text;
+
+  //How many blocks out from the cursor the entry was found, see the scopes below for everything else
+  unsigned scope = 0;
+
+  //How often the name shows up in the document
+  unsigned uses = 0;
+
+  //How well the name matched what's being typed (see FuzzyScore)
+  unsigned match = 0;
 };
 
+//Scopes of entries that don't come from a block around the cursor
+const unsigned GlobalCompletionScope = 0x10000;
+const unsigned KeywordCompletionScope = 0x20000;
 
+//Only entries prefix fuzzy matches are added to output
+void ResolveAutocomplete(AbstractNode *ast, int lineNumber, int charNumber, const std::string &prefix, std::vector<AutoCompleteEntry> &output, Library *lib, std::vector<Token> &tokens);
 
-void ResolveAutocomplete(AbstractNode *ast, int lineNumber, int charNumber, std::vector<AutoCompleteEntry> &output, Library *lib, std::vector<Token> &tokens);
\ No newline at end of file
+//Puts the best entries first: names starting with the prefix, then the closest scope, kind, how well
+//the name matched and finally the most used. Only the first maxEntries are
+//sorted (all of them if it's 0), the rest are left in no particular order.
+void RankAutocomplete(std::vector<AutoCompleteEntry> &entries, size_t maxEntries);
\ No newline at end of file
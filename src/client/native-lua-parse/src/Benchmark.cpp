@@ -0,0 +1,693 @@
+// Timings for the native side, run outside of node.
+//
+// g++ -std=c++14 -O2 -DNODE_PRINT -DMEMORY_ACCOUNTING -fno-delete-null-pointer-checks -o benchmark Benchmark.cpp Corpus_Generator.cpp Document.cpp AST_Nodes.cpp AutoComplete.cpp Descent_Parser.cpp Lexer_DFA.cpp Incremental_Lexer.cpp Piece_Table.cpp Token.cpp TypeSystem.cpp FuzzyMatch.cpp Phase_Stats.cpp Memory_Accounting.cpp Tracing.cpp -lpthread
+//
+// benchmark [--json] [core|update|fuzzy|scaling|allocations]...
+// Runs every suite when none are named. Every timing is the median of several runs after a warm-up run,
+// --json prints the results as one JSON object so they can be compared between versions.
+// Results marked as flagged grew faster than n log n in the scaling suite, going by the best runs of the last sizes.
+
+#include "Document.h"
+#include "Incremental_Lexer.h"
+#include "FuzzyMatch.h"
+#include "Corpus_Generator.h"
+#include "Phase_Stats.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+extern std::string internal_parse_stdout;
+
+static const size_t DocumentSize = 5 * 1024 * 1024;
+static const size_t CorpusSize = 1024 * 1024;
+static const size_t LargeCorpusSize = 16 * 1024 * 1024;
+static const int Iterations = 10;
+
+struct Timing
+{
+  double median;
+  double best;
+};
+
+struct BenchmarkResult
+{
+  std::string name;
+  double value;
+  double best;
+  std::string unit;
+  bool flagged;
+};
+
+static std::vector<BenchmarkResult> Results;
+
+static void Report(const std::string &name, double value, const char *unit, bool flagged = false)
+{
+  Results.push_back({ name, value, -1, unit, flagged });
+}
+
+static void Report(const std::string &name, Timing timing)
+{
+  Results.push_back({ name, timing.median, timing.best, "ms", false });
+}
+
+//One warm-up run, then the median and best of a few more, in milliseconds. Setup isn't timed.
+static Timing Measure(const std::function<void()> &setup, const std::function<void()> &run, int iterations = Iterations)
+{
+  std::vector<double> times;
+  for (int i = 0; i <= iterations; ++i)
+  {
+    setup();
+
+    auto start = std::chrono::high_resolution_clock::now();
+    run();
+    auto end = std::chrono::high_resolution_clock::now();
+
+    internal_parse_stdout.clear();
+    if (i != 0)
+      times.push_back(std::chrono::duration<double, std::milli>(end - start).count());
+  }
+
+  std::sort(times.begin(), times.end());
+  return { times[times.size() / 2], times.front() };
+}
+
+static void Nothing()
+{
+}
+
+//Lua source of roughly 'size' bytes, every function gets its own name so the library has real work to do
+static std::string MakeDocument(size_t size)
+{
+  std::string text;
+  text.reserve(size + 256);
+
+  char chunk[256];
+  for (unsigned i = 0; text.size() < size; ++i)
+  {
+    snprintf(chunk, sizeof(chunk),
+      "-- helper number %u\n"
+      "function helper%u(a, b)\n"
+      "  local sum = a + b * %u\n"
+      "  return sum\n"
+      "end\n\n", i, i, i);
+    text += chunk;
+  }
+
+  return text;
+}
+
+//The fixed corpus the core suite runs on: tables, methods, loops, comments and a couple of globals per chunk.
+//Don't change it, or results stop being comparable with older runs.
+static std::string MakeCorpus(size_t size)
+{
+  std::string text;
+  text.reserve(size + 2048);
+
+  char chunk[2048];
+  for (unsigned i = 0; text.size() < size; ++i)
+  {
+    snprintf(chunk, sizeof(chunk),
+      "-- Inventory module %u, keeps track of what a player carries\n"
+      "local Inventory%u = {}\n"
+      "Inventory%u.__index = Inventory%u\n"
+      "\n"
+      "function Inventory%u.new(owner, capacity)\n"
+      "  local self = { owner = owner, capacity = capacity or 10, items = { \"sword\", \"shield\" } }\n"
+      "  self.count = 2\n"
+      "  return self\n"
+      "end\n"
+      "\n"
+      "function Inventory%u:add(item, amount)\n"
+      "  for i = 1, amount do\n"
+      "    if self.count < self.capacity then\n"
+      "      self.items[self.count + 1] = item\n"
+      "      self.count = self.count + 1\n"
+      "    else\n"
+      "      return false\n"
+      "    end\n"
+      "  end\n"
+      "  return true\n"
+      "end\n"
+      "\n"
+      "--[[ Shared state ]]\n"
+      "globalInventory%u = Inventory%u.new(\"player\", 5)\n"
+      "globalInventory%u:add(\"potion\", 3)\n"
+      "local total%u = 0\n"
+      "while total%u < 10 do\n"
+      "  total%u = total%u + globalInventory%u.count * 2\n"
+      "end\n\n", i, i, i, i, i, i, i, i, i, i, i, i, i, i);
+    text += chunk;
+  }
+
+  return text;
+}
+
+class CountNodes : public Visitor
+{
+public:
+  size_t count = 0;
+
+  virtual VisitResult Visit(AbstractNode* node)
+  {
+    ++count;
+    return VisitResult::Continue;
+  }
+};
+
+//Line and character just past the first occurrence of 'what'
+static DocumentPosition PositionAfter(const std::string &text, const char *what)
+{
+  size_t offset = text.find(what) + std::strlen(what);
+  size_t lineStart = text.rfind('\n', offset - 1);
+  lineStart = lineStart == std::string::npos ? 0 : lineStart + 1;
+
+  return DocumentPosition((unsigned)std::count(text.begin(), text.begin() + lineStart, '\n'), (unsigned)(offset - lineStart));
+}
+
+static void BenchmarkCore()
+{
+  const std::string corpus = MakeCorpus(CorpusSize);
+  const double megabytes = corpus.size() / (1024.0 * 1024.0);
+  Report("corpus_size", megabytes, "MB");
+
+  //Lexer::ReadToken straight over the text, whitespace and comments included
+  size_t tokenCount = 0;
+  Timing lexing = Measure(Nothing, [&]()
+  {
+    tokenCount = 0;
+    const char *stream = corpus.c_str();
+    unsigned lineNumber = 0;
+    unsigned charNumber = 0;
+
+    Token token;
+    while (*stream != '\0')
+    {
+      Lexer::ReadToken(demo::lexer, stream, token, lineNumber, charNumber);
+      stream += token.Length != 0 ? token.Length : 1;
+      ++tokenCount;
+    }
+  });
+  Report("lexer", lexing);
+  Report("lexer_throughput", megabytes / (lexing.median / 1000), "MB/s");
+  Report("lexer_tokens", (double)tokenCount, "tokens");
+
+  //A generated data file sized document, lexed on one thread and then split over every core
+  {
+    PieceTable large;
+    large.Reset(MakeCorpus(LargeCorpusSize));
+    std::vector<Token> list;
+    auto clearList = [&]() { list.clear(); };
+    Report("lexer_large", Measure(clearList, [&]() { LexTokens(demo::lexer, large, list); }, 3));
+    Report("lexer_large_parallel", Measure(clearList, [&]() { LexTokensParallel(demo::lexer, large, list); }, 3));
+
+    //The same for the parser, the main chunk is split at top level statements
+    std::unique_ptr<AbstractNode> largeAst;
+    std::vector<ParsingException> largeErrors;
+    auto clearLargeTree = [&]() { largeAst = nullptr; largeErrors.clear(); };
+    Report("parser_large", Measure(clearLargeTree, [&]() { largeAst = RecognizeTokens(list, &largeErrors, false); }, 3));
+    Report("parser_large_parallel", Measure(clearLargeTree, [&]() { largeAst = RecognizeTokensParallel(list, &largeErrors, false); }, 3));
+    Report("large_threads", (double)std::thread::hardware_concurrency(), "threads");
+  }
+
+  PieceTable text;
+  text.Reset(corpus);
+  std::vector<Token> tokens;
+  LexTokens(demo::lexer, text, tokens);
+
+  //RecognizeTokens on the significant tokens
+  std::unique_ptr<AbstractNode> ast;
+  std::vector<ParsingException> errors;
+  Timing parsing = Measure([&]() { ast = nullptr; errors.clear(); }, [&]() { ast = RecognizeTokens(tokens, &errors, false); });
+
+  CountNodes nodes;
+  ast->Walk(&nodes);
+  Report("parser", parsing);
+  Report("parser_throughput", nodes.count / (parsing.median / 1000), "nodes/s");
+  Report("parser_nodes", (double)nodes.count, "nodes");
+  Report("parser_errors", (double)errors.size(), "errors");
+
+  //Lexing and parsing together, through a token list and then pulling tokens straight off the lexer
+  auto clearTree = [&]() { ast = nullptr; errors.clear(); };
+  Report("lex_and_parse", Measure(clearTree, [&]()
+  {
+    std::vector<Token> list;
+    LexTokens(demo::lexer, text, list);
+    ast = RecognizeTokens(list, &errors, false);
+  }));
+  Report("lex_and_parse_streamed", Measure(clearTree, [&]()
+  {
+    TokenStream stream(demo::lexer, text);
+    ast = RecognizeStream(stream, &errors, false);
+  }));
+  Report("token_list_bytes", (double)(tokens.size() * sizeof(Token)), "bytes");
+
+  //ResolveTypes on a fresh tree each time, then what it costs to let go of everything it made
+  LibraryReference libRefs;
+  auto freshTree = [&]()
+  {
+    libRefs.Release();
+    errors.clear();
+    ast = RecognizeTokens(tokens, &errors, false);
+  };
+  Report("resolve_types", Measure(freshTree, [&]() { ResolveTypes(ast.get(), demo::masterLibrary, &libRefs); }));
+
+  auto resolvedTree = [&]()
+  {
+    freshTree();
+    ResolveTypes(ast.get(), demo::masterLibrary, &libRefs);
+  };
+  Report("library_release", Measure(resolvedTree, [&]() { libRefs.Release(); }));
+
+  //Only the main chunk, then the bodies a completion inside a method needs
+  Report("resolve_types_deferred", Measure(freshTree, [&]() { ResolveTypes(ast.get(), demo::masterLibrary, &libRefs, true); }));
+
+  const DocumentPosition inMethod = PositionAfter(corpus, "      return false\n");
+  auto deferredTree = [&]()
+  {
+    freshTree();
+    ResolveTypes(ast.get(), demo::masterLibrary, &libRefs, true);
+  };
+  Report("resolve_types_at", Measure(deferredTree, [&]() { ResolveTypesAt(ast.get(), inMethod, demo::masterLibrary, &libRefs); }));
+
+  //A file of nothing but functions, where most of the work is in their bodies
+  {
+    PieceTable functionsText;
+    functionsText.Reset(MakeDocument(CorpusSize));
+    std::vector<Token> functionTokens;
+    LexTokens(demo::lexer, functionsText, functionTokens);
+
+    auto freshFunctions = [&]()
+    {
+      libRefs.Release();
+      errors.clear();
+      ast = RecognizeTokens(functionTokens, &errors, false);
+    };
+    Report("resolve_types_functions", Measure(freshFunctions, [&]() { ResolveTypes(ast.get(), demo::masterLibrary, &libRefs); }));
+    Report("resolve_types_functions_deferred", Measure(freshFunctions, [&]()
+    {
+      ResolveTypes(ast.get(), demo::masterLibrary, &libRefs, true);
+    }));
+
+    //Its globals would show up in the completions below
+    libRefs.Release();
+  }
+
+  //The rest runs with the corpus open like the binding would have it
+  const std::string uri = "corpus.lua";
+  demo::ParseDocument(uri, corpus);
+
+  //What the open corpus holds on to, by category
+  DocumentMemory &memory = *demo::DocumentMemories[uri];
+  for (size_t i = 0; i < (size_t)MemoryCategory::Count; ++i)
+    Report(std::string("memory_") + MemoryCategoryName((MemoryCategory)i), memory.categories[i].bytes / 1024.0, "KB");
+  Report("memory_total", memory.Total() / 1024.0, "KB");
+
+  //A sweep that finds nothing to remove
+  Report("library_clean", Measure(Nothing, [&]() { demo::masterLibrary->Clean(); }));
+
+  struct Request
+  {
+    const char *name;
+    DocumentPosition position;
+    const char *prefix;
+  };
+
+  //ResolveAutocomplete through the same path the binding takes
+  const Request requests[] = {
+    { "autocomplete_scope", PositionAfter(corpus, "      return false\n"), "" },
+    { "autocomplete_prefix", PositionAfter(corpus, "      return false\n"), "glo" },
+    { "autocomplete_fuzzy", PositionAfter(corpus, "      return false\n"), "gInv" },
+    { "autocomplete_member", PositionAfter(corpus, "    if self."), "" },
+  };
+
+  for (const Request &request : requests)
+  {
+    std::vector<AutoCompleteEntry> entries;
+    Timing timing = Measure([&]() { entries.clear(); }, [&]()
+    {
+      demo::AutoComplete(uri, request.position.Line, request.position.Character, request.prefix, 100, entries);
+    });
+
+    Report(request.name, timing);
+    Report(std::string(request.name) + "_entries", (double)entries.size(), "entries");
+  }
+
+  demo::Documents.erase(uri);
+}
+
+//What the binding used to do: String::Utf8Value, a std::string from that, then a copy for every by value parameter
+static void OldUpdate(const std::string &uri, const char *source, size_t length)
+{
+  std::unique_ptr<char[]> utf8Value(new char[length + 1]);
+  std::memcpy(utf8Value.get(), source, length + 1);
+
+  std::string text(utf8Value.get());
+  std::string parameter = text;
+  demo::ParseDocument(uri, parameter);
+}
+
+//What it does now: one copy out of the JS string, moved the rest of the way
+static void NewUpdate(const std::string &uri, const char *source, size_t length)
+{
+  std::string text(source, length);
+  demo::ParseDocument(uri, std::move(text));
+}
+
+static void BenchmarkUpdates()
+{
+  const std::string uri = "benchmark.lua";
+  const std::string original = MakeDocument(DocumentSize);
+  Report("update_document_size", original.size() / (1024.0 * 1024.0), "MB");
+
+  //Same size text with one character changed in the middle of a name
+  std::string edited = original;
+  size_t middle = edited.find("helper", edited.size() / 2);
+  edited[middle] = 'H';
+
+  //Stands in for the JS string the text gets copied out of
+  std::string source;
+  auto reset = [&]() { demo::ParseDocument(uri, original); };
+
+  //Sending the same text again, only the diff runs so the copies are most of the cost
+  source = original;
+  reset();
+  Report("update_unchanged_copied", Measure(Nothing, [&]() { OldUpdate(uri, source.c_str(), source.size()); }));
+  Report("update_unchanged", Measure(Nothing, [&]() { NewUpdate(uri, source.c_str(), source.size()); }));
+
+  //One character edited, the change is spliced into the table and re-lexed
+  source = edited;
+  Report("update_edited_copied", Measure(reset, [&]() { OldUpdate(uri, source.c_str(), source.size()); }));
+  Report("update_edited", Measure(reset, [&]() { NewUpdate(uri, source.c_str(), source.size()); }));
+
+  //Opening the document, everything gets built from the new buffer
+  source = original;
+  auto fresh = [&]() { demo::Documents.erase(uri); };
+  Report("update_opened_copied", Measure(fresh, [&]() { OldUpdate(uri, source.c_str(), source.size()); }));
+  Report("update_opened", Measure(fresh, [&]() { NewUpdate(uri, source.c_str(), source.size()); }));
+
+  //The same with function bodies left for the first completion inside them (SetDeferFunctionBodies)
+  demo::deferFunctionBodies = true;
+  Report("update_opened_deferred", Measure(fresh, [&]() { NewUpdate(uri, source.c_str(), source.size()); }));
+  demo::deferFunctionBodies = false;
+
+  demo::Documents.erase(uri);
+}
+
+//Made up identifiers, a mix of camelCase and snake_case built out of common words
+static void MakeNames(size_t count, std::vector<std::string> &names)
+{
+  static const char *words[] = { "get", "set", "value", "player", "health", "update", "draw", "sprite", "table",
+    "index", "count", "load", "save", "world", "entity", "position", "velocity", "timer", "sound", "input" };
+  const size_t wordCount = sizeof(words) / sizeof(words[0]);
+
+  unsigned seed = 12345;
+  auto next = [&seed]() { seed = seed * 1103515245 + 12345; return (seed >> 16) & 0x7FFF; };
+
+  names.clear();
+  for (size_t i = 0; i < count; ++i)
+  {
+    bool snake = next() % 3 == 0;
+    std::string name = words[next() % wordCount];
+    for (unsigned parts = 1 + next() % 3; parts != 0; --parts)
+    {
+      std::string word = words[next() % wordCount];
+      if (snake)
+        name += "_";
+      else
+        word[0] = word[0] - 'a' + 'A';
+      name += word;
+    }
+
+    name += std::to_string(i);
+    names.push_back(name);
+  }
+}
+
+static void BenchmarkFuzzy()
+{
+  static const char *patterns[] = { "p", "gph", "setVel", "world_timer", "zzz" };
+
+  for (size_t count : { (size_t)10000, (size_t)100000 })
+  {
+    std::vector<std::string> names;
+    MakeNames(count, names);
+
+    std::string size = std::to_string(count / 1000) + "k";
+
+    FuzzyCandidates candidates;
+    Report("fuzzy_pack_" + size, Measure([&]() { candidates.Clear(); }, [&]()
+    {
+      for (const std::string &name : names)
+        candidates.Add(name.data(), name.size());
+    }));
+
+    for (const char *pattern : patterns)
+    {
+      std::vector<unsigned> scores;
+      Timing timing = Measure(Nothing, [&]() { candidates.Match(pattern, std::strlen(pattern), scores); });
+
+      size_t matched = 0;
+      for (unsigned score : scores)
+        matched += score != 0;
+
+      std::string name = "fuzzy_match_" + size + "_" + pattern;
+      Report(name, timing);
+      Report(name + "_matched", (double)matched, "names");
+    }
+  }
+}
+
+//How a parameter of the generated workspace gets scaled
+struct ScalingParameter
+{
+  const char *name;
+  unsigned CorpusShape::*field;
+};
+
+static const unsigned ScalingSteps = 5;
+static const int ScalingIterations = 5;
+
+//Sizes the growth is fitted over, the last two doublings. That's where the constant costs matter least.
+static const size_t GrowthSteps = 3;
+
+//Below these a doubling is mostly timer and allocator noise, so it isn't flagged
+static const double TimeNoiseFloor = 5;
+static const double MemoryNoiseFloor = 64;
+
+//Exponent k of the growth over the last few sizes, as in value ~ n^k. A least squares fit of log2(value) against
+//the doublings, so a single slow run at one size doesn't decide it alone.
+static double GrowthExponent(const std::vector<double> &values)
+{
+  size_t count = std::min(GrowthSteps, values.size());
+  double sumX = 0, sumY = 0, sumXX = 0, sumXY = 0;
+  for (size_t i = 0; i < count; ++i)
+  {
+    double value = values[values.size() - count + i];
+    if (value <= 0)
+      return 0;
+
+    double x = (double)i;
+    double y = std::log2(value);
+    sumX += x;
+    sumY += y;
+    sumXX += x * x;
+    sumXY += x * y;
+  }
+
+  double denominator = count * sumXX - sumX * sumX;
+  if (denominator <= 0)
+    return 0;
+  return (count * sumXY - sumX * sumY) / denominator;
+}
+
+//What the exponent comes out as for n log n doubling from n to 2n, with room for noise. n is the smallest size
+//of the fit, where the log factor adds the most. Anything with the last size under floor isn't flagged.
+static bool WorseThanNLogN(double exponent, double n, double last, double floor)
+{
+  n = std::max(n, 2.0);
+  double limit = std::log2(2 * std::log(2 * n) / std::log(n)) + 0.35;
+  return exponent > limit && last >= floor;
+}
+
+//Opens a generated workspace with one parameter doubled at a time and everything else left alone.
+//Reports the time to open and close it and the memory it holds, flags anything growing faster than n log n.
+static void BenchmarkScaling()
+{
+  const ScalingParameter parameters[] = {
+    { "files", &CorpusShape::files },
+    { "lines", &CorpusShape::linesPerFile },
+    { "nesting", &CorpusShape::nestingDepth },
+    { "globals", &CorpusShape::globals },
+    { "table", &CorpusShape::tableSize },
+    { "comments", &CorpusShape::commentDensity },
+  };
+
+  const CorpusShape base;
+
+  for (const ScalingParameter &parameter : parameters)
+  {
+    std::vector<double> opening, closing, memory;
+    std::string prefix = std::string("scaling_") + parameter.name + "_";
+
+    unsigned value = base.*parameter.field;
+    for (unsigned step = 0; step < ScalingSteps; ++step, value *= 2)
+    {
+      CorpusShape shape = base;
+      shape.*parameter.field = value;
+
+      std::vector<demo::DocumentSource> workspace;
+      GenerateCorpus(shape, workspace);
+
+      std::vector<demo::DocumentSource> files;
+      std::vector<demo::ParseResult> results;
+      auto open = [&]() { demo::ParseDocuments(std::move(files), results); };
+      auto close = [&]() { demo::Documents.clear(); };
+
+      Timing opened = Measure([&]() { close(); files = workspace; }, open, ScalingIterations);
+      Timing closed = Measure([&]() { files = workspace; open(); }, close, ScalingIterations);
+
+      files = workspace;
+      int64_t before = LiveBytes();
+      open();
+      double held = (LiveBytes() - before) / 1024.0;
+      close();
+      internal_parse_stdout.clear();
+
+      std::string name = prefix + std::to_string(value);
+      Report(name + "_open", opened);
+      Report(name + "_close", closed);
+      Report(name + "_memory", held, "KB");
+
+      //The best run is the one least disturbed by the rest of the machine
+      opening.push_back(opened.best);
+      closing.push_back(closed.best);
+      memory.push_back(held);
+    }
+
+    //n is the first size of the fit, value is already one doubling past the last size
+    double n = value >> std::min(GrowthSteps, (size_t)ScalingSteps);
+
+    double exponent = GrowthExponent(opening);
+    Report(prefix + "open_growth", exponent, "exponent",
+      WorseThanNLogN(exponent, n, opening.back(), TimeNoiseFloor));
+
+    exponent = GrowthExponent(closing);
+    Report(prefix + "close_growth", exponent, "exponent",
+      WorseThanNLogN(exponent, n, closing.back(), TimeNoiseFloor));
+
+    exponent = GrowthExponent(memory);
+    Report(prefix + "memory_growth", exponent, "exponent",
+      WorseThanNLogN(exponent, n, memory.back(), MemoryNoiseFloor));
+  }
+}
+
+static void ReportAllocations(const std::string &name, const AllocationCounts &counts)
+{
+  Report(name + "_allocations", (double)counts.allocations, "allocs");
+  Report(name + "_frees", (double)counts.frees, "frees");
+  Report(name + "_bytes", counts.bytes / 1024.0, "KB");
+}
+
+//How many allocations opening, editing and completing in the core corpus makes, by phase and by call site.
+//These don't depend on the machine, so they can be compared exactly between versions.
+static void BenchmarkAllocations()
+{
+  const std::string corpus = MakeCorpus(CorpusSize);
+  const std::string uri = "allocations.lua";
+
+  std::string edited = corpus;
+  edited.insert(edited.find("  self.count = 2\n"), "  self.extra = 1\n");
+  const DocumentPosition position = PositionAfter(corpus, "      return false\n");
+
+  ResetAllocationCounts();
+
+  demo::ParseDocument(uri, corpus);
+  demo::ParseDocument(uri, edited);
+
+  std::vector<AutoCompleteEntry> entries;
+  demo::AutoComplete(uri, position.Line, position.Character, "glo", 100, entries);
+
+  demo::Documents.erase(uri);
+  internal_parse_stdout.clear();
+
+  for (size_t i = 0; i < (size_t)Phase::Count; ++i)
+    ReportAllocations(std::string("allocations_phase_") + PhaseName((Phase)i), PhaseAllocations(i));
+  ReportAllocations("allocations_phase_none", PhaseAllocations((size_t)Phase::Count));
+
+  for (size_t i = 0; i < (size_t)AllocationSite::Count; ++i)
+    ReportAllocations(std::string("allocations_site_") + AllocationSiteName((AllocationSite)i), SiteAllocations((AllocationSite)i));
+}
+
+static void PrintText()
+{
+  for (const BenchmarkResult &result : Results)
+  {
+    const char *flag = result.flagged ? "  <-- worse than n log n" : "";
+    if (result.best >= 0)
+      printf("%-48s %14.3f %-8s (best %.3f)%s\n", result.name.c_str(), result.value, result.unit.c_str(), result.best, flag);
+    else
+      printf("%-48s %14.3f %s%s\n", result.name.c_str(), result.value, result.unit.c_str(), flag);
+  }
+}
+
+static void PrintJson()
+{
+  printf("{\n  \"iterations\": %d,\n  \"results\": [\n", Iterations);
+  for (size_t i = 0; i < Results.size(); ++i)
+  {
+    const BenchmarkResult &result = Results[i];
+    printf("    { \"name\": \"%s\", \"value\": %.6g, \"unit\": \"%s\"", result.name.c_str(), result.value, result.unit.c_str());
+    if (result.best >= 0)
+      printf(", \"best\": %.6g", result.best);
+    if (result.flagged)
+      printf(", \"flagged\": true");
+    printf(" }%s\n", i + 1 != Results.size() ? "," : "");
+  }
+  printf("  ]\n}\n");
+}
+
+int main(int argc, char **argv)
+{
+  demo::Initialize();
+
+  bool json = false;
+  std::vector<std::string> suites;
+  for (int i = 1; i < argc; ++i)
+  {
+    if (std::strcmp(argv[i], "--json") == 0)
+      json = true;
+    else
+      suites.push_back(argv[i]);
+  }
+
+  auto selected = [&suites](const char *name)
+  {
+    return suites.empty() || std::find(suites.begin(), suites.end(), name) != suites.end();
+  };
+
+  if (selected("core"))
+    BenchmarkCore();
+  if (selected("update"))
+    BenchmarkUpdates();
+  if (selected("fuzzy"))
+    BenchmarkFuzzy();
+  if (selected("scaling"))
+    BenchmarkScaling();
+  if (selected("allocations"))
+    BenchmarkAllocations();
+
+  if (json)
+    PrintJson();
+  else
+    PrintText();
+
+  return 0;
+}
@@ -0,0 +1,131 @@
+#include "Corpus_Generator.h"
+
+#include <cstdarg>
+#include <cstdio>
+
+namespace
+{
+  //Writes one file, a comment line goes in after every so many lines of code
+  class CorpusWriter
+  {
+  public:
+    CorpusWriter(const CorpusShape &shape, std::string &text) : shape(shape), text(text) {}
+
+    //Small LCG, only needs to be the same everywhere
+    unsigned Next()
+    {
+      seed = seed * 1103515245 + 12345;
+      return (seed >> 16) & 0x7FFF;
+    }
+
+    void Line(unsigned indent, const char *format, ...)
+    {
+      text.append(indent * 2, ' ');
+
+      char line[512];
+      va_list args;
+      va_start(args, format);
+      vsnprintf(line, sizeof(line), format, args);
+      va_end(args);
+
+      text += line;
+      text += '\n';
+      ++lines;
+
+      comments += shape.commentDensity;
+      for (; comments >= 100; comments -= 100)
+      {
+        text.append(indent * 2, ' ');
+        if (Next() % 4 == 0)
+          text += "--[[ block comment, the lexer has to find where it ends ]]\n";
+        else
+          text += "-- line comment about the code above\n";
+      }
+    }
+
+    const CorpusShape &shape;
+    std::string &text;
+    unsigned seed = 0;
+    unsigned lines = 0;
+    unsigned comments = 0;
+  };
+
+  const char *BlockOpeners[] = {
+    "if value > %u then",
+    "for i%u = 1, count do",
+    "while value < %u do",
+    "do",
+  };
+}
+
+void GenerateCorpus(const CorpusShape &shape, std::vector<demo::DocumentSource> &files)
+{
+  files.clear();
+  files.resize(shape.files);
+
+  for (unsigned file = 0; file < shape.files; ++file)
+  {
+    char uri[64];
+    snprintf(uri, sizeof(uri), "file:///corpus/module%u.lua", file);
+    files[file].uri = uri;
+
+    std::string &text = files[file].text;
+    CorpusWriter writer(shape, text);
+    writer.seed = shape.seed * 7919 + file;
+
+    //The module table
+    writer.Line(0, "local Module%u = {", file);
+    for (unsigned entry = 0; entry < shape.tableSize; ++entry)
+    {
+      if (entry % 4 == 3)
+        writer.Line(1, "field%u = { x = %u, y = %u },", entry, entry, writer.Next());
+      else if (entry % 4 == 2)
+        writer.Line(1, "\"value%u\",", entry);
+      else
+        writer.Line(1, "field%u = %u,", entry, writer.Next());
+    }
+    writer.Line(0, "}");
+    writer.Line(0, "");
+
+    //This file's share of the globals, every other one is a function
+    for (unsigned global = file; global < shape.globals; global += shape.files)
+    {
+      if (global % 2 == 0)
+        writer.Line(0, "globalValue%u = %u", global, writer.Next());
+      else
+        writer.Line(0, "function globalFunction%u(a) return a + %u end", global, global);
+    }
+    writer.Line(0, "");
+
+    //Functions with nested blocks until there are enough lines of code
+    const unsigned start = writer.lines;
+    for (unsigned function = 0; writer.lines - start < shape.linesPerFile; ++function)
+    {
+      writer.Line(0, "function Module%u.function%u(value, count)", file, function);
+      writer.Line(1, "local total = Module%u.field0", file);
+
+      for (unsigned depth = 0; depth < shape.nestingDepth; ++depth)
+        writer.Line(depth + 1, BlockOpeners[depth % 4], depth);
+
+      unsigned indent = shape.nestingDepth + 1;
+      if (shape.globals != 0)
+      {
+        unsigned global = writer.Next() % shape.globals;
+        if (global % 2 == 0)
+          writer.Line(indent, "total = total + globalValue%u", global);
+        else
+          writer.Line(indent, "total = globalFunction%u(total)", global);
+      }
+      writer.Line(indent, "value = value + total * %u", function);
+
+      for (unsigned depth = shape.nestingDepth; depth != 0; --depth)
+        writer.Line(depth, "end");
+
+      writer.Line(1, "return total");
+      writer.Line(0, "end");
+      writer.Line(0, "");
+    }
+
+    writer.Line(0, "return Module%u", file);
+  }
+}
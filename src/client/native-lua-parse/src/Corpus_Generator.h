@@ -0,0 +1,33 @@
+#pragma once
+#include "Document.h"
+
+#include <string>
+#include <vector>
+
+// Shape of a generated workspace. Every field can be scaled on its own, so the cost of one thing can be looked at
+// while the rest of the input stays the same.
+struct CorpusShape
+{
+  unsigned files = 4;
+
+  //Lines of function code per file, the module table and global definitions come on top of these
+  unsigned linesPerFile = 250;
+
+  //How deep the blocks in every function body go (if, for, while and do nested in each other)
+  unsigned nestingDepth = 2;
+
+  //Globals defined across the whole workspace, split between the files and used from the function bodies
+  unsigned globals = 100;
+
+  //Entries in each file's module table literal
+  unsigned tableSize = 8;
+
+  //Comment lines per 100 lines of code
+  unsigned commentDensity = 10;
+
+  //Same shape and seed give the same text every time
+  unsigned seed = 1;
+};
+
+// Lua source for a whole workspace of the given shape, one DocumentSource per file
+void GenerateCorpus(const CorpusShape &shape, std::vector<demo::DocumentSource> &files);
@@ -1,5 +1,10 @@
 #include "Descent_Parser.h"
+#include "Incremental_Lexer.h"
 #include "Token.h"
+#include "Tracing.h"
+#include "Memory_Accounting.h"
+#include <algorithm>
+#include <thread>
 #include <vector>
 
 //  Descent_Info  //
@@ -91,34 +96,230 @@ std::string TokenIdentifier(Token &t)
   return std::string(t.Text, t.Length);
 }
 
+//How tightly operators hold on to their operands, higher binds tighter
+struct BindingPower
+{
+  enum
+  {
+    None,
+    Or,
+    And,
+    Comparison,
+    Concat,
+    Additive,
+    Multiplicative,
+    Unary,
+    Exponent
+  };
+};
+
+static unsigned BinaryPowerOf(Token::Type::Enum type)
+{
+  switch (type)
+  {
+  case Token::Type::Or:
+    return BindingPower::Or;
+
+  case Token::Type::And:
+    return BindingPower::And;
+
+  case Token::Type::LessThan:
+  case Token::Type::GreaterThan:
+  case Token::Type::LessThanOrEqualTo:
+  case Token::Type::GreaterThanOrEqualTo:
+  case Token::Type::EqualsTo:
+  case Token::Type::NotEqualsTo:
+    return BindingPower::Comparison;
+
+  case Token::Type::Concat:
+    return BindingPower::Concat;
+
+  case Token::Type::Plus:
+  case Token::Type::Minus:
+    return BindingPower::Additive;
+
+  case Token::Type::Multiply:
+  case Token::Type::Divide:
+  case Token::Type::Modulo:
+    return BindingPower::Multiplicative;
+
+  case Token::Type::Exponent:
+    return BindingPower::Exponent;
+
+  default:
+    return BindingPower::None;
+  }
+}
+
+//Binding power of every token as a binary operator, None for tokens that aren't one
+static const unsigned BinaryPower[Token::Type::EnumCount] = {
+#define TOKEN(Name, Value) BinaryPowerOf(Token::Type::Name),
+#include "Tokens.inl"
+#undef TOKEN
+};
+
+static bool IsUnaryOperator(Token::Type::Enum type)
+{
+  return type == Token::Type::Minus || type == Token::Type::Not || type == Token::Type::Length;
+}
+
+//Gives the children of node their parent. Children that were put together without being finished by the parser
+//(operators folded in a loop, suffixes chained onto each other, calls moved over from a suffix) have theirs
+//linked on the way. The end marker of a block gets the block's parent, so a completion at the end of a block
+//looks at what the block belongs to.
+static void LinkChildren(AbstractNode *node, std::vector<AbstractNode *> &children, std::vector<AbstractNode *> &stack)
+{
+  stack.push_back(node);
+
+  while (!stack.empty())
+  {
+    AbstractNode *parent = stack.back();
+    stack.pop_back();
+
+    BlockNode *parentBlock = NodeCast<BlockNode>(parent);
+    AbstractNode *parentEnd = parentBlock != nullptr ? parentBlock->End.get() : nullptr;
+
+    children.clear();
+    parent->Children(children);
+    const size_t count = children.size();
+
+    for (size_t i = 0; i < count; ++i)
+    {
+      AbstractNode *child = children[i];
+      if (child == parentEnd)
+        continue;
+
+      child->Parent = parent;
+
+      BlockNode *block = NodeCast<BlockNode>(child);
+      AbstractNode *end = block != nullptr ? block->End.get() : nullptr;
+      if (end != nullptr)
+        end->Parent = parent;
+
+      //Only go further down if the child wasn't finished with all of its children already
+      child->Children(children);
+      bool linked = true;
+      for (size_t j = count; j < children.size(); ++j)
+        linked &= children[j] == end || children[j]->Parent == child;
+      children.resize(count);
+
+      if (!linked)
+        stack.push_back(child);
+    }
+  }
+}
+
+//Where the parser reads its tokens from. Past the last token Current() is a blank (Invalid) token that no rule
+//accepts, so nothing has to check for the end before looking at a token.
+
+//Tokens that were all lexed up front, or the [begin, limit) range of them. A range ends like the list would
+//but still sees the token in front of it, so positions taken from Previous() come out the same.
+class TokenVector
+{
+public:
+  TokenVector(std::vector<Token> &tokens)
+    :TokenVector(tokens, 0, tokens.size())
+  {}
+
+  TokenVector(std::vector<Token> &tokens, size_t begin, size_t limit)
+    :tokens(tokens), index(begin), limit(limit), current(begin < limit ? &tokens[begin] : &end)
+  {}
+
+  const Token &Current() const { return *current; }
+
+  //The token before Current(), a blank one at the start
+  const Token &Previous() const { return index != 0 ? tokens[index - 1] : end; }
+
+  bool AtEnd() const { return current == &end; }
+
+  void Advance()
+  {
+    ++index;
+    current = index < limit ? &tokens[index] : &end;
+  }
+
+private:
+  std::vector<Token> &tokens;
+  size_t index;
+  size_t limit;
+  const Token *current;
+  Token end;
+};
+
+//Tokens pulled from the lexer as the parser gets to them. The parser never goes back and only looks one
+//token ahead, so all that's kept is a ring with the current token and the one before it.
+class TokenRing
+{
+public:
+  TokenRing(TokenStream &stream)
+    :stream(stream)
+  {
+    Read(ring[0]);
+  }
+
+  const Token &Current() const { return ring[index & 1]; }
+  const Token &Previous() const { return index != 0 ? ring[(index - 1) & 1] : blank; }
+  bool AtEnd() const { return ended; }
+
+  void Advance()
+  {
+    ++index;
+    Read(ring[index & 1]);
+  }
+
+private:
+  void Read(Token &token)
+  {
+    if (!ended && stream.Next(token))
+      return;
+
+    token = Token();
+    ended = true;
+  }
+
+  TokenStream &stream;
+  Token ring[2];
+  size_t index = 0;
+  bool ended = false;
+  Token blank;
+};
+
+template<typename Tokens>
 struct RecursiveParser
 {
-  RecursiveParser(std::vector<Token>& tokens)
-    :tokens(tokens), tokenStream(0)
+  RecursiveParser(Tokens &tokens)
+    :tokens(tokens)
   {}
 
-  std::vector<Token>& tokens;
-  unsigned tokenStream;
+  Tokens &tokens;
   bool throwException = false;
 
   std::vector<ParsingException> errors;
 
-  DocumentPosition GetCurrentPosition()
+  //Kept so linking parents doesn't allocate for every node
+  std::vector<AbstractNode *> linkChildren;
+  std::vector<AbstractNode *> linkStack;
+
+  //Called on every node a rule accepts, so the tree comes out with its parents set
+  template<typename T>
+  std::unique_ptr<T> Finish(std::unique_ptr<T> node)
   {
-    if (tokenStream - 1 >= tokens.size() || tokenStream - 1 < 0)
-      return DocumentPosition();
+    if (node)
+      LinkChildren(node.get(), linkChildren, linkStack);
 
-    return tokens[tokenStream - 1].Position;
+    return node;
   }
 
-  bool Accept(Token::Type::Enum type)
+  DocumentPosition GetCurrentPosition()
   {
-    if (tokenStream >= tokens.size())
-      return false;
+    return tokens.Previous().Position;
+  }
 
-    if (tokens[tokenStream].EnumTokenType == type)
+  bool Accept(Token::Type::Enum type)
+  {
+    if (tokens.Current().EnumTokenType == type)
     {
-      tokenStream++;
+      tokens.Advance();
       DescentInfo::AcceptToken(type);
       return true;
     }
@@ -128,13 +329,10 @@ struct RecursiveParser
 
   bool Accept(Token::Type::Enum type, Token &t)
   {
-    if (tokenStream >= tokens.size())
-      return false;
-
-    if (tokens[tokenStream].EnumTokenType == type)
+    if (tokens.Current().EnumTokenType == type)
     {
-      t = tokens[tokenStream];
-      tokenStream++;
+      t = tokens.Current();
+      tokens.Advance();
       DescentInfo::AcceptToken(type);
       return true;
     }
@@ -148,10 +346,10 @@ struct RecursiveParser
       return true;
     else
     {
-      if (tokenStream >= tokens.size())
-        errors.push_back(ParsingException("End of token stream!", tokens[tokens.size() - 1].Position));
+      if (tokens.AtEnd())
+        errors.push_back(ParsingException("End of token stream!", tokens.Previous().Position));
       else
-        errors.push_back(ParsingException(std::string("Expected ") + TokenNames[(int)type] + ", found " + TokenNames[(int)tokens[tokenStream].EnumTokenType] + ".", tokens[tokenStream].Position));
+        errors.push_back(ParsingException(std::string("Expected ") + TokenNames[(int)type] + ", found " + TokenNames[(int)tokens.Current().EnumTokenType] + ".", tokens.Current().Position));
 
 #ifdef __EXCEPTIONS
       if (throwException)
@@ -168,10 +366,10 @@ struct RecursiveParser
       return true;
     else
     {
-      if (tokenStream >= tokens.size())
-        errors.push_back(ParsingException("End of token stream!", tokens[tokens.size() - 1].Position));
+      if (tokens.AtEnd())
+        errors.push_back(ParsingException("End of token stream!", tokens.Previous().Position));
       else
-        errors.push_back(ParsingException(std::string("Expected ") + TokenNames[(int)type] + ", found " + TokenNames[(int)tokens[tokenStream].EnumTokenType] + ".", tokens[tokenStream].Position));
+        errors.push_back(ParsingException(std::string("Expected ") + TokenNames[(int)type] + ", found " + TokenNames[(int)tokens.Current().EnumTokenType] + ".", tokens.Current().Position));
 
 #ifdef __EXCEPTIONS
       if (throwException)
@@ -216,10 +414,10 @@ struct RecursiveParser
       return true;
     else
     {
-      if (tokenStream >= tokens.size())
+      if (tokens.AtEnd())
         errors.push_back(ParsingException("End of token stream!"));
       else
-        errors.push_back(ParsingException(std::string("Expected ") + CollectTokenNames(args...) + ", found " + TokenNames[(int)tokens[tokenStream].EnumTokenType] + "."));
+        errors.push_back(ParsingException(std::string("Expected ") + CollectTokenNames(args...) + ", found " + TokenNames[(int)tokens.Current().EnumTokenType] + "."));
 
 #ifdef __EXCEPTIONS
       if (throwException)
@@ -261,13 +459,13 @@ struct RecursiveParser
     return std::move(value);
   }
 
-  bool Expect(Token::Type::Enum type, std::vector<Token>& tokens, unsigned &tokenStream, std::string const &error)
+  bool Expect(Token::Type::Enum type, std::string const &error)
   {
     if (Accept(type))
       return true;
     else
     {
-      errors.push_back(ParsingException(error, tokens[tokenStream].Position));
+      errors.push_back(ParsingException(error, tokens.Current().Position));
 
 #ifdef __EXCEPTIONS
       if (throwException)
@@ -291,9 +489,9 @@ struct RecursiveParser
 
     mainFunction->Block = Chunk();
 
-    if (tokenStream != tokens.size())
+    if (!tokens.AtEnd())
     {
-      errors.push_back(ParsingException("Syntax error near '" + tokens[tokenStream].str() + "'", tokens[tokenStream].Position));
+      errors.push_back(ParsingException("Syntax error near '" + tokens.Current().str() + "'", tokens.Current().Position));
 #ifdef __EXCEPTIONS
       if (throwException)
         throw errors.back();
@@ -303,7 +501,7 @@ struct RecursiveParser
     //Destroy the "end" node of the main chunk
     mainFunction->Block->End = nullptr;
 
-    return rule.Accept(std::move(mainFunction));
+    return rule.Accept(Finish(std::move(mainFunction)));
   }
 
   std::unique_ptr<BlockNode> Chunk()
@@ -345,17 +543,23 @@ struct RecursiveParser
     blockNode->End = std::make_unique<AbstractNode>();
     blockNode->End->Position = GetCurrentPosition();
 
-    return rule.Accept(std::move(blockNode));
+    return rule.Accept(Finish(std::move(blockNode)));
   }
 
   std::unique_ptr<StatementNode> Statement()
   {
     DescentInfo rule("Statement");
 
+    //Every statement is told apart by its first token
+    switch (tokens.Current().EnumTokenType)
+    {
     //Resolve ambiguity, both Assignment and FunctionCall can start with a var
-    auto var_or_exp = VariableStatement();
-    if (var_or_exp)
+    case Token::Type::Identifier:
+    case Token::Type::OpenParentheses:
     {
+      auto var_or_exp = VariableStatement();
+      if (!var_or_exp)
+        return nullptr;
 
       //If invalid, it should be a function call
       if (Invalid_Variable(var_or_exp))
@@ -372,7 +576,7 @@ struct RecursiveParser
 
         functionCallNode->Variable = std::move(var_or_exp);
 
-        return rule.Accept(std::move(functionCallNode));
+        return rule.Accept(Finish(std::move(functionCallNode)));
       }
       else
       {
@@ -385,7 +589,7 @@ struct RecursiveParser
           assignmentNode->Position = GetCurrentPosition();
         }
 
-        return rule.Accept(std::move(assignmentNode));
+        return rule.Accept(Finish(std::move(assignmentNode)));
       }
 
       /*
@@ -416,17 +620,19 @@ struct RecursiveParser
       */
     }
 
-    if (Accept(Token::Type::Do))
+    case Token::Type::Do:
     {
+      Accept(Token::Type::Do);
       std::unique_ptr<BlockNode> blockNode = Chunk();
       Expect(Token::Type::End);
       blockNode->End->Position = GetCurrentPosition();
 
-      return rule.Accept(std::move(blockNode));
+      return rule.Accept(Finish(std::move(blockNode)));
     }
 
-    if (Accept(Token::Type::While))
+    case Token::Type::While:
     {
+      Accept(Token::Type::While);
       std::unique_ptr<WhileNode> whileNode = std::make_unique<WhileNode>();
       whileNode->Position = GetCurrentPosition();
       whileNode->Condition = Expect(Expression());
@@ -438,11 +644,12 @@ struct RecursiveParser
       Expect(Token::Type::End);
       whileNode->Block->End->Position = GetCurrentPosition();
 
-      return rule.Accept(std::move(whileNode));
+      return rule.Accept(Finish(std::move(whileNode)));
     }
 
-    if (Accept(Token::Type::Repeat))
+    case Token::Type::Repeat:
     {
+      Accept(Token::Type::Repeat);
       std::unique_ptr<RepeatNode> repeatNode = std::make_unique<RepeatNode>();
       repeatNode->Position = GetCurrentPosition();
       repeatNode->Block = Expect(Chunk());
@@ -452,11 +659,12 @@ struct RecursiveParser
       repeatNode->Condition = Expect(Expression());
       repeatNode->Block->End->Position = GetCurrentPosition();
 
-      return rule.Accept(std::move(repeatNode));
+      return rule.Accept(Finish(std::move(repeatNode)));
     }
 
-    if (Accept(Token::Type::If))
+    case Token::Type::If:
     {
+      Accept(Token::Type::If);
       std::unique_ptr<IfNode> ifNode = std::make_unique<IfNode>();
       ifNode->Position = GetCurrentPosition();
       ifNode->Condition = Expect(Expression());
@@ -486,11 +694,12 @@ struct RecursiveParser
         currentNode->Block->End->Position = GetCurrentPosition();
       }
 
-      return rule.Accept(std::move(ifNode));
+      return rule.Accept(Finish(std::move(ifNode)));
     }
 
-    if (Accept(Token::Type::For))
+    case Token::Type::For:
     {
+      Accept(Token::Type::For);
       std::vector<Token> names;
       Expect(IdentifierList(names));
 
@@ -513,7 +722,7 @@ struct RecursiveParser
         Expect(Token::Type::End);
         numericNode->Block->End->Position = GetCurrentPosition();
 
-        return rule.Accept(std::move(numericNode));
+        return rule.Accept(Finish(std::move(numericNode)));
       }
       //Generic
       else if (Accept(Token::Type::In))
@@ -529,22 +738,23 @@ struct RecursiveParser
         Expect(Token::Type::End);
         genericNode->Block->End->Position = GetCurrentPosition();
 
-        return rule.Accept(std::move(genericNode));
+        return rule.Accept(Finish(std::move(genericNode)));
       }
       else
       {
-        errors.push_back(ParsingException(std::string("Expected = or in, found ") + TokenNames[(int)tokens[tokenStream - 1].EnumTokenType] + ".", tokens[tokenStream - 1].Position));
+        errors.push_back(ParsingException(std::string("Expected = or in, found ") + TokenNames[(int)tokens.Previous().EnumTokenType] + ".", tokens.Previous().Position));
 #ifdef __EXCEPTIONS
       if (throwException)
         throw errors.back();
 #endif
 
-        return false;
+        return nullptr;
       }
     }
 
-    if (Accept(Token::Type::Function))
+    case Token::Type::Function:
     {
+      Accept(Token::Type::Function);
       std::unique_ptr<FunctionNode> functionNode = std::make_unique<FunctionNode>();
       functionNode->Position = GetCurrentPosition();
 
@@ -579,11 +789,12 @@ struct RecursiveParser
       }
 
       FunctionBody(functionNode);
-      return rule.Accept(std::move(functionNode));
+      return rule.Accept(Finish(std::move(functionNode)));
     }
 
-    if (Accept(Token::Type::Local))
+    case Token::Type::Local:
     {
+      Accept(Token::Type::Local);
       if (Accept(Token::Type::Function))
       {
         std::unique_ptr<FunctionNode> functionNode = std::make_unique<FunctionNode>();
@@ -596,7 +807,7 @@ struct RecursiveParser
         functionNode->Name.push_back(std::move(nameNode));
 
         FunctionBody(functionNode);
-        return rule.Accept(std::move(functionNode));
+        return rule.Accept(Finish(std::move(functionNode)));
       }
 
       std::unique_ptr<LocalVariableNode> localVarNode = std::make_unique<LocalVariableNode>();
@@ -608,10 +819,12 @@ struct RecursiveParser
         Expect(ExpressionList(localVarNode->ExpressionList));
       }
 
-      return rule.Accept(std::move(localVarNode));
+      return rule.Accept(Finish(std::move(localVarNode)));
     }
 
-    return nullptr;
+    default:
+      return nullptr;
+    }
   }
 
   std::unique_ptr<StatementNode> LastStatement()
@@ -635,7 +848,7 @@ struct RecursiveParser
       statementNode = std::move(returnNode);
     }
 
-    return rule.Accept(std::move(statementNode));
+    return rule.Accept(Finish(std::move(statementNode)));
   }
 
   bool Assignment(std::unique_ptr<AssignmentNode> &assignmentNode)
@@ -668,7 +881,7 @@ struct RecursiveParser
     {}
     else
     {
-      errors.push_back(ParsingException(std::string("Expected =, +=, -=, *=, or /=, found ") + TokenNames[(int)tokens[tokenStream - 1].EnumTokenType] + ".", tokens[tokenStream - 1].Position));
+      errors.push_back(ParsingException(std::string("Expected =, +=, -=, *=, or /=, found ") + TokenNames[(int)tokens.Previous().EnumTokenType] + ".", tokens.Previous().Position));
 #ifdef __EXCEPTIONS
       if (throwException)
         throw errors.back();
@@ -720,7 +933,7 @@ struct RecursiveParser
 
         variable->Variable = std::move(expressionVariable);
 
-        return rule.Accept(std::move(variable));
+        return rule.Accept(Finish(std::move(variable)));
       }
 
       variable->Variable = std::move(expressionVariable);
@@ -750,7 +963,7 @@ struct RecursiveParser
     variable->Suffix = std::move(currentSuffix);
 
 
-    return rule.Accept(std::move(variable));
+    return rule.Accept(Finish(std::move(variable)));
   }
 
   std::unique_ptr<VariableSuffixNode> VariableSuffix()
@@ -800,13 +1013,13 @@ struct RecursiveParser
     {
       if (suffixNode->CallNodes.size() > 0)
       {
-        return rule.Accept(std::move(suffixNode));
+        return rule.Accept(Finish(std::move(suffixNode)));
       }
 
       return nullptr;
     }
 
-    return rule.Accept(std::move(suffixNode));
+    return rule.Accept(Finish(std::move(suffixNode)));
   }
 
   std::unique_ptr<CallNode> Call()
@@ -842,7 +1055,7 @@ struct RecursiveParser
       return nullptr;
     }
 
-    return rule.Accept(std::move(callNode));
+    return rule.Accept(Finish(std::move(callNode)));
   }
 
   std::unique_ptr<ArgumentNode> Arguments()
@@ -892,7 +1105,7 @@ struct RecursiveParser
     }
 
 
-    return rule.Accept(std::move(node));
+    return rule.Accept(Finish(std::move(node)));
   }
 
   std::unique_ptr<TableNode> Table()
@@ -909,7 +1122,7 @@ struct RecursiveParser
 
     Expect(Token::Type::CloseCurley);
 
-    return rule.Accept(std::move(tableNode));
+    return rule.Accept(Finish(std::move(tableNode)));
   }
 
   void FieldList(std::unique_ptr<TableNode> &tableNode)
@@ -1041,7 +1254,7 @@ struct RecursiveParser
   {
     DescentInfo rule("Expression");
 
-    auto expression = Expression1();
+    auto expression = SubExpression(BindingPower::Or);
     if (!(expression))
       return nullptr;
 
@@ -1059,323 +1272,100 @@ struct RecursiveParser
     //  expression = std::move(binOpNode);
     //}
 
-    return rule.Accept(std::move(expression));
+    return rule.Accept(Finish(std::move(expression)));
   }
 
-  std::unique_ptr<ExpressionNode> Expression1()
+  //Precedence climbing, takes every operator binding at least as tight as minPower into the expression.
+  //All binary operators are left associative.
+  std::unique_ptr<ExpressionNode> SubExpression(unsigned minPower)
   {
-    DescentInfo rule("Expression1");
+    DescentInfo rule("SubExpression");
 
-    auto expression = Expression2();
-    if (!(expression))
-      return nullptr;
-
-    Token Operator;
-    for (;;)
-    {
-      if (Accept(Token::Type::Or, Operator))
-      {
-        std::unique_ptr<BinaryOperatorNode> binOpNode = std::make_unique<BinaryOperatorNode>();
-        binOpNode->Position = GetCurrentPosition();
-        binOpNode->Operator = Operator;
-        binOpNode->Left = std::move(expression);
-        binOpNode->Right = Expect(Expression2());
-        expression = std::move(binOpNode);
-        continue;
-      }
-
-      break;
-    }
-
-    return rule.Accept(std::move(expression));
-  }
+    std::unique_ptr<ExpressionNode> expression;
 
-  std::unique_ptr<ExpressionNode> Expression2()
-  {
-    DescentInfo rule("Expression2");
-
-    auto expression = Expression3();
-    if (!(expression))
-      return nullptr;
+    //Nothing tighter than what was last taken can follow, unless the operand before it was missing.
+    //Leaving those for the caller gives the same tree the grammar would for broken code.
+    unsigned maxPower = BindingPower::Exponent;
 
     Token Operator;
-
-    for (;;)
+    if (IsUnaryOperator(tokens.Current().EnumTokenType))
     {
-      if (Accept(Token::Type::And, Operator))
-      {
-        std::unique_ptr<BinaryOperatorNode> binOpNode = std::make_unique<BinaryOperatorNode>();
-        binOpNode->Position = GetCurrentPosition();
-        binOpNode->Operator = Operator;
-        binOpNode->Left = std::move(expression);
-        binOpNode->Right = Expect(Expression3());
-        expression = std::move(binOpNode);
-        continue;
-      }
-
-      break;
-    }
-
-    return rule.Accept(std::move(expression));
-  }
+      Accept(tokens.Current().EnumTokenType, Operator);
 
-  std::unique_ptr<ExpressionNode> Expression3()
-  {
-    DescentInfo rule("Expression3");
-
-    auto expression = Expression4();
-    if (!(expression))
-      return nullptr;
-
-    Token Operator;
-
-    for (;;)
-    {
-      if (Accept(Token::Type::LessThan, Operator)
-        || (Accept(Token::Type::GreaterThan, Operator))
-        || (Accept(Token::Type::LessThanOrEqualTo, Operator))
-        || (Accept(Token::Type::GreaterThanOrEqualTo, Operator))
-        || (Accept(Token::Type::EqualsTo, Operator))
-        || (Accept(Token::Type::NotEqualsTo, Operator)))
-      {
-        std::unique_ptr<BinaryOperatorNode> binOpNode = std::make_unique<BinaryOperatorNode>();
-        binOpNode->Position = GetCurrentPosition();
-        binOpNode->Operator = Operator;
-        binOpNode->Left = std::move(expression);
-        binOpNode->Right = Expect(Expression4());
-        expression = std::move(binOpNode);
-
-        continue;
-      }
+      std::unique_ptr<UnaryOperatorNode> unaryOpNode = std::make_unique<UnaryOperatorNode>();
+      unaryOpNode->Position = GetCurrentPosition();
+      unaryOpNode->Operator = Operator;
+      unaryOpNode->Right = SubExpression(BindingPower::Exponent);
 
-      break;
+      expression = std::move(unaryOpNode);
+      maxPower = BindingPower::Unary;
     }
-
-    return rule.Accept(std::move(expression));
-  }
-
-  std::unique_ptr<ExpressionNode> Expression4()
-  {
-    DescentInfo rule("Expression4");
-
-    auto expression = Expression5();
-    if (!(expression))
-      return nullptr;
-
-    Token Operator;
-
-    for (;;)
+    else
     {
-      if (Accept(Token::Type::Concat, Operator))
-      {
-        std::unique_ptr<BinaryOperatorNode> binOpNode = std::make_unique<BinaryOperatorNode>();
-        binOpNode->Position = GetCurrentPosition();
-        binOpNode->Operator = Operator;
-        binOpNode->Left = std::move(expression);
-        binOpNode->Right = Expect(Expression5());
-        expression = std::move(binOpNode);
-
-        continue;
-      }
-
-      break;
+      expression = PrimaryExpression();
+      if (!(expression))
+        return nullptr;
     }
 
-    return rule.Accept(std::move(expression));
-  }
-
-  std::unique_ptr<ExpressionNode> Expression5()
-  {
-    DescentInfo rule("Expression5");
-
-    auto expression = Expression6();
-    if (!(expression))
-      return nullptr;
-
-    Token Operator;
-
     for (;;)
     {
-      if (Accept(Token::Type::Plus, Operator) || Accept(Token::Type::Minus, Operator))
-      {
-        std::unique_ptr<BinaryOperatorNode> binOpNode = std::make_unique<BinaryOperatorNode>();
-        binOpNode->Position = GetCurrentPosition();
-        binOpNode->Operator = Operator;
-        binOpNode->Left = std::move(expression);
-        binOpNode->Right = Expect(Expression6());
-        expression = std::move(binOpNode);
-
-        continue;
-      }
-
-      break;
-    }
-
-    return rule.Accept(std::move(expression));
-  }
-
-  std::unique_ptr<ExpressionNode> Expression6()
-  {
-    DescentInfo rule("Expression6");
-
-    auto expression = Expression7();
-    if (!(expression))
-      return nullptr;
-
-    Token Operator;
+      unsigned power = BinaryPower[tokens.Current().EnumTokenType];
+      if (power < minPower || power > maxPower)
+        break;
 
-    for (;;)
-    {
-      if (Accept(Token::Type::Multiply, Operator)
-        || Accept(Token::Type::Divide, Operator)
-        || Accept(Token::Type::Modulo, Operator))
-      {
-        std::unique_ptr<BinaryOperatorNode> binOpNode = std::make_unique<BinaryOperatorNode>();
-        binOpNode->Position = GetCurrentPosition();
-        binOpNode->Operator = Operator;
-        binOpNode->Left = std::move(expression);
-        binOpNode->Right = Expect(Expression7());
-        expression = std::move(binOpNode);
+      Accept(tokens.Current().EnumTokenType, Operator);
 
-        continue;
-      }
+      std::unique_ptr<BinaryOperatorNode> binOpNode = std::make_unique<BinaryOperatorNode>();
+      binOpNode->Position = GetCurrentPosition();
+      binOpNode->Operator = Operator;
+      binOpNode->Left = std::move(expression);
+      binOpNode->Right = Expect(SubExpression(power + 1));
+      expression = std::move(binOpNode);
 
-      break;
+      maxPower = power;
     }
 
-    return rule.Accept(std::move(expression));
+    return rule.Accept(Finish(std::move(expression)));
   }
 
-  std::unique_ptr<ExpressionNode> Expression7()
+  std::unique_ptr<ExpressionNode> PrimaryExpression()
   {
-    DescentInfo rule("Expression7");
-
-    std::unique_ptr<UnaryOperatorNode> firstOp;
-    std::unique_ptr<UnaryOperatorNode> *unaryOp = nullptr;
-
-    Token Operator;
-
-    auto AssignUnary = [this, &Operator, &unaryOp, &firstOp]() {
-      std::unique_ptr<UnaryOperatorNode> unaryOpNode = std::make_unique<UnaryOperatorNode>();
-      unaryOpNode->Position = GetCurrentPosition();
-      unaryOpNode->Operator = Operator;
-
-      if (unaryOp)
-      {
-        (*unaryOp)->Right = std::move(unaryOpNode);
-        unaryOp = (std::unique_ptr<UnaryOperatorNode> *)&(*unaryOp)->Right;
-      }
-      else
-      {
-        firstOp = std::move(unaryOpNode);
-        unaryOp = &firstOp;
-      }
-    };
-
-    for (;;)
-    {
-      if (Accept(Token::Type::Minus, Operator))
-      {
-        AssignUnary();
-        continue;
-      }
-
-      if (Accept(Token::Type::Not, Operator))
-      {
-        AssignUnary();
-        continue;
-      }
-
-      if (Accept(Token::Type::Length, Operator))
-      {
-        AssignUnary();
-        continue;
-      }
+    DescentInfo rule("PrimaryExpression");
 
+    std::unique_ptr<ExpressionNode> expressionNode;
+    switch (tokens.Current().EnumTokenType)
+    {
+    case Token::Type::Nil:
+    case Token::Type::False:
+    case Token::Type::True:
+    case Token::Type::IntegerLiteral:
+    case Token::Type::FloatLiteral:
+    case Token::Type::StringLiteral:
+    case Token::Type::VariableDot:
+      expressionNode = Value();
       break;
-    }
-
-    auto expression = Expression8();
 
-    if (unaryOp)
-    {
-      (*unaryOp)->Right = std::move(expression);
-      expression = std::move(firstOp);
-    }
+    case Token::Type::Function:
+      expressionNode = FunctionExpression();
+      break;
 
-    return rule.Accept(std::move(expression));
-  }
+    case Token::Type::Identifier:
+    case Token::Type::OpenParentheses:
+      expressionNode = PrefixExpression();
+      break;
 
-  std::unique_ptr<ExpressionNode> Expression8()
-  {
-    DescentInfo rule("Expression8");
+    case Token::Type::OpenCurley:
+      expressionNode = Table();
+      break;
 
-    auto expression = Expression9();
-    if (!(expression))
+    default:
       return nullptr;
-
-    Token Operator;
-
-    for (;;)
-    {
-      if (Accept(Token::Type::Exponent, Operator))
-      {
-        std::unique_ptr<BinaryOperatorNode> binOpNode = std::make_unique<BinaryOperatorNode>();
-        binOpNode->Position = GetCurrentPosition();
-        binOpNode->Operator = Operator;
-        binOpNode->Left = std::move(expression);
-        binOpNode->Right = Expect(Expression9());
-        expression = std::move(binOpNode);
-
-        continue;
-      }
-
-      break;
     }
 
-    return rule.Accept(std::move(expression));
-  }
-
-  std::unique_ptr<ExpressionNode> Expression9()
-  {
-    DescentInfo rule("Expression9");
-
-    std::unique_ptr<ExpressionNode> expressionNode;
-    auto value = Value();
-    if (value)
-    {
-      expressionNode = std::move(value);
-    }
-    else
-    {
-      auto function = FunctionExpression();
-      if (function)
-      {
-        expressionNode = std::move(function);
-      }
-      else
-      {
-        auto functionCall = PrefixExpression();
-        if (functionCall)
-        {
-          expressionNode = std::move(functionCall);
-        }
-        else
-        {
-          auto table = Table();
-          if (table)
-          {
-            expressionNode = std::move(table);
-          }
-          else
-          {
-            return nullptr;
-          }
-        }
-      }
-    }
+    if (!(expressionNode))
+      return nullptr;
 
-    return rule.Accept(std::move(expressionNode));
+    return rule.Accept(Finish(std::move(expressionNode)));
   }
 
   std::unique_ptr<ExpressionNode> Value()
@@ -1394,7 +1384,7 @@ struct RecursiveParser
         Accept(Token::Type::VariableDot, valueNode->Expression))
     {
       valueNode->Position = GetCurrentPosition();
-      return rule.Accept(std::move(valueNode));
+      return rule.Accept(Finish(std::move(valueNode)));
     }
 
     return nullptr;
@@ -1414,7 +1404,7 @@ struct RecursiveParser
 
     FunctionBody(functionNode->Function);
 
-    return rule.Accept(std::move(functionNode));
+    return rule.Accept(Finish(std::move(functionNode)));
   }
 
   void FunctionBody(std::unique_ptr<FunctionNode> &functionNode)
@@ -1550,7 +1540,7 @@ struct RecursiveParser
       break;
     }
 
-    return rule.Accept(std::move(prefixNode));
+    return rule.Accept(Finish(std::move(prefixNode)));
   }
 
   /*
@@ -1577,7 +1567,7 @@ struct RecursiveParser
       callableNode = std::move(expNode);
     }
 
-    return rule.Accept(std::move(callableNode));
+    return rule.Accept(Finish(std::move(callableNode)));
   }
   */
 
@@ -1603,7 +1593,7 @@ struct RecursiveParser
       break;
     }
 
-    return rule.Accept(std::move(functionCallNode));
+    return rule.Accept(Finish(std::move(functionCallNode)));
   }
 
   std::unique_ptr<IfNode> Else()
@@ -1628,7 +1618,7 @@ struct RecursiveParser
         elseNode->Block->End->Position = elseNode->Else->Position;
       }
 
-      return rule.Accept(std::move(elseNode));
+      return rule.Accept(Finish(std::move(elseNode)));
     }
 
     if (Accept(Token::Type::Else))
@@ -1638,7 +1628,7 @@ struct RecursiveParser
 
       elseNode->Block = Expect(Chunk());
       
-      return rule.Accept(std::move(elseNode));
+      return rule.Accept(Finish(std::move(elseNode)));
     }
 
     return nullptr;
@@ -1646,9 +1636,10 @@ struct RecursiveParser
 };
 
 
-std::unique_ptr<AbstractNode> RecognizeTokens(std::vector<Token> &tokens, std::vector<ParsingException> *error, bool throwException)
+template<typename Tokens>
+static std::unique_ptr<AbstractNode> Recognize(Tokens &tokens, std::vector<ParsingException> *error, bool throwException)
 {
-  RecursiveParser parser(tokens);
+  RecursiveParser<Tokens> parser(tokens);
   parser.throwException = throwException;
 
   std::unique_ptr<AbstractNode> ast = std::move(parser.Start());
@@ -1660,55 +1651,278 @@ std::unique_ptr<AbstractNode> RecognizeTokens(std::vector<Token> &tokens, std::v
 
   return std::move(ast);
 }
+
+std::unique_ptr<AbstractNode> RecognizeTokens(std::vector<Token> &tokens, std::vector<ParsingException> *error, bool throwException)
+{
+  TokenVector source(tokens);
+  return Recognize(source, error, throwException);
+}
+
+std::unique_ptr<AbstractNode> RecognizeStream(TokenStream &stream, std::vector<ParsingException> *error, bool throwException)
+{
+  TokenRing source(stream);
+  return Recognize(source, error, throwException);
+}
+
+//Ranges smaller than this aren't worth a thread
+static const size_t MinimumRangeTokens = 1 << 17;
+
+//Tokens that can end an expression. An identifier right after one can't carry the expression on, so it has to
+//start the next statement.
+static bool EndsValue(Token::Type::Enum type)
+{
+  switch (type)
+  {
+  case Token::Type::Identifier:
+  case Token::Type::IntegerLiteral:
+  case Token::Type::FloatLiteral:
+  case Token::Type::StringLiteral:
+  case Token::Type::Nil:
+  case Token::Type::True:
+  case Token::Type::False:
+  case Token::Type::VariableDot:
+  case Token::Type::CloseParentheses:
+  case Token::Type::CloseSquare:
+  case Token::Type::CloseCurley:
+  case Token::Type::End:
+    return true;
+  default:
+    return false;
+  }
+}
+
+//Whether the token at index starts a statement of the main chunk, only asked when nothing is open
+static bool StartsTopLevelStatement(const std::vector<Token> &tokens, size_t index)
+{
+  Token::Type::Enum previous = tokens[index - 1].EnumTokenType;
+  switch (tokens[index].EnumTokenType)
+  {
+  //Never part of an expression outside of a function body
+  case Token::Type::Local:
+  case Token::Type::If:
+  case Token::Type::While:
+  case Token::Type::For:
+  case Token::Type::Repeat:
+  case Token::Type::Do:
+    return true;
+
+  //'function name' is a statement, 'local function name' is one statement with the local
+  case Token::Type::Function:
+    return previous != Token::Type::Local && index + 1 < tokens.size() && tokens[index + 1].EnumTokenType == Token::Type::Identifier;
+
+  case Token::Type::Identifier:
+  case Token::Type::OpenParentheses:
+    return previous == Token::Type::Semicolon || (tokens[index].EnumTokenType == Token::Type::Identifier && EndsValue(previous));
+
+  default:
+    return false;
+  }
+}
+
+//Picks where the main chunk gets cut, one range per thread, each starting at a top level statement close to an
+//even split. Keywords are matched up with a stack (function/do/if/while/for/repeat against end/until, brackets
+//against their closers). Returns false if they don't match up, a return or break comes too early, or there's
+//nowhere to cut, the parser then has to tell what the code means.
+static bool FindTopLevelRanges(const std::vector<Token> &tokens, unsigned threads, std::vector<size_t> &starts)
+{
+  enum class Open { Block, LoopHeader, Repeat, Parentheses, Square, Curley };
+  std::vector<Open> open;
+
+  starts.assign(1, 0);
+  size_t target = tokens.size() / threads;
+
+  for (size_t i = 0; i < tokens.size(); ++i)
+  {
+    Token::Type::Enum type = tokens[i].EnumTokenType;
+
+    if (open.empty() && i >= target && target != 0 && StartsTopLevelStatement(tokens, i))
+    {
+      starts.push_back(i);
+      target = starts.size() < threads ? tokens.size() * starts.size() / threads : 0;
+    }
+
+    switch (type)
+    {
+    case Token::Type::Function:
+    case Token::Type::If:
+      open.push_back(Open::Block);
+      break;
+
+    //The 'do' of a loop closes its header instead of opening a block of its own
+    case Token::Type::While:
+    case Token::Type::For:
+      open.push_back(Open::LoopHeader);
+      break;
+
+    case Token::Type::Do:
+      if (!open.empty() && open.back() == Open::LoopHeader)
+        open.back() = Open::Block;
+      else
+        open.push_back(Open::Block);
+      break;
+
+    case Token::Type::Repeat:
+      open.push_back(Open::Repeat);
+      break;
+
+    case Token::Type::OpenParentheses: open.push_back(Open::Parentheses); break;
+    case Token::Type::OpenSquare: open.push_back(Open::Square); break;
+    case Token::Type::OpenCurley: open.push_back(Open::Curley); break;
+
+    case Token::Type::End:
+    case Token::Type::Until:
+    case Token::Type::CloseParentheses:
+    case Token::Type::CloseSquare:
+    case Token::Type::CloseCurley:
+    {
+      Open expected = type == Token::Type::End ? Open::Block
+        : type == Token::Type::Until ? Open::Repeat
+        : type == Token::Type::CloseParentheses ? Open::Parentheses
+        : type == Token::Type::CloseSquare ? Open::Square
+        : Open::Curley;
+
+      if (open.empty() || open.back() != expected)
+        return false;
+      open.pop_back();
+      break;
+    }
+
+    //Ends the main chunk, anything after it is an error only the serial parse reports the same way
+    case Token::Type::Return:
+    case Token::Type::Break:
+      if (open.empty())
+        target = 0;
+      break;
+
+    default:
+      break;
+    }
+  }
+
+  return open.empty() && starts.size() > 1;
+}
+
+//What one thread made of its range of the main chunk
+struct ParsedRange
+{
+  size_t begin = 0;
+  size_t limit = 0;
+  std::unique_ptr<AbstractNode> ast;   //The main function for the first range, the range's BlockNode otherwise
+  bool clean = false;                  //Parsed right to the end without an error
+};
+
+static void ParseRange(std::vector<Token> &tokens, bool first, MemoryAccount *account, size_t phase, ParsedRange &range)
+{
+  ScopedTrace trace("parseRange", "parse");
+  ScopedMemoryAccount charge(account);
+  size_t previousPhase = SetAllocationPhase(phase);
+
+  TokenVector source(tokens, range.begin, range.limit);
+  RecursiveParser<TokenVector> parser(source);
+  if (first)
+    range.ast = parser.Start();
+  else
+    range.ast = parser.Chunk();
+
+  range.clean = parser.errors.empty() && source.AtEnd();
+  SetAllocationPhase(previousPhase);
+}
+
+std::unique_ptr<AbstractNode> RecognizeTokensParallel(std::vector<Token> &tokens, std::vector<ParsingException> *error, bool throwException, unsigned threads)
+{
+#ifndef PARSER_DEBUG
+  if (threads == 0)
+    threads = std::thread::hardware_concurrency();
+  threads = (unsigned)std::min<size_t>(threads, tokens.size() / MinimumRangeTokens);
+
+  std::vector<size_t> starts;
+  if (threads >= 2 && FindTopLevelRanges(tokens, threads, starts))
+  {
+    std::vector<ParsedRange> ranges(starts.size());
+    for (size_t i = 0; i < ranges.size(); ++i)
+    {
+      ranges[i].begin = starts[i];
+      ranges[i].limit = i + 1 < starts.size() ? starts[i + 1] : tokens.size();
+    }
+
+    MemoryAccount *account = ActiveMemoryAccount();
+    size_t phase = ActiveAllocationPhase();
+    std::vector<std::thread> workers;
+    for (size_t i = 1; i < ranges.size(); ++i)
+      workers.emplace_back(ParseRange, std::ref(tokens), false, account, phase, std::ref(ranges[i]));
+
+    ParseRange(tokens, true, account, phase, ranges[0]);
+    for (std::thread &worker : workers)
+      worker.join();
+
+    //Errors can make the serial parse stop early or take a statement further than a range did, so only trees
+    //without any are put together. Broken files are parsed again serially to report exactly what it would.
+    bool clean = std::all_of(ranges.begin(), ranges.end(), [](const ParsedRange &range) { return range.clean; });
+    if (clean)
+    {
+      std::unique_ptr<AbstractNode> ast = std::move(ranges[0].ast);
+      BlockNode *main = static_cast<FunctionNode *>(ast.get())->Block.get();
+      for (size_t i = 1; i < ranges.size(); ++i)
+      {
+        BlockNode *block = static_cast<BlockNode *>(ranges[i].ast.get());
+        for (std::unique_ptr<StatementNode> &statement : block->Statements)
+          main->Statements.push_back(std::move(statement));
+      }
+
+      //The statements moved over still point at the blocks they were parsed into
+      std::vector<AbstractNode *> children, stack;
+      LinkChildren(main, children, stack);
+
+      if (error != nullptr)
+        error->clear();
+      return ast;
+    }
+  }
+#endif
+
+  return RecognizeTokens(tokens, error, throwException);
+}
 std::vector<NodePrinter*> NodePrinter::ActiveNodes;
 
-class PrintVisitor : public Visitor
+class PrintVisitor : public TreePrinter
 {
 public:
   virtual VisitResult Visit(AbstractNode* node)
   {
-    NodePrinter printer;
+    NodePrinter &printer = Open();
     printer << "AbstractNode";
 
-    node->Walk(this, false);
-
-    return VisitResult::Stop;
+    return VisitResult::Continue;
   }
 
   virtual VisitResult Visit(BlockNode* node)
   {
-    NodePrinter printer;
+    NodePrinter &printer = Open();
     printer << "BlockNode";
 
-    node->Walk(this, false);
-
-    return VisitResult::Stop;
+    return VisitResult::Continue;
   }
 
   virtual VisitResult Visit(StatementNode* node)
   {
-    NodePrinter printer;
+    NodePrinter &printer = Open();
     printer << "StatementNode";
 
-    node->Walk(this, false);
-
-    return VisitResult::Stop;
+    return VisitResult::Continue;
   }
 
 
   virtual VisitResult Visit(TypeNode* node)
   {
-    NodePrinter printer;
+    NodePrinter &printer = Open();
     printer << "TypeNode(" << node->Name << ")";
     
-    node->Walk(this, false);
-
-    return VisitResult::Stop;
+    return VisitResult::Continue;
   }
 
   virtual VisitResult Visit(AssignmentNode* node)
   {
-    NodePrinter printer;
+    NodePrinter &printer = Open();
     printer << "AssignmentNode [" << node->Operator << "](";
 
     for (auto &token : node->Names)
@@ -1718,256 +1932,206 @@ public:
 
     printer << ")";
 
-    node->Walk(this, false);
-
-    return VisitResult::Stop;
+    return VisitResult::Continue;
   }
 
   virtual VisitResult Visit(VariableNode* node)
   {
-    NodePrinter printer;
+    NodePrinter &printer = Open();
     printer << "VariableNode";
 
-    node->Walk(this, false);
-
-    return VisitResult::Stop;
+    return VisitResult::Continue;
   }
 
   virtual VisitResult Visit(VariableStatementNode* node)
   {
-    NodePrinter printer;
+    NodePrinter &printer = Open();
     printer << "VariableStatementNode";
 
-    node->Walk(this, false);
-
-    return VisitResult::Stop;
+    return VisitResult::Continue;
   }
 
   virtual VisitResult Visit(IdentifiedVariableNode* node)
   {
-    NodePrinter printer;
+    NodePrinter &printer = Open();
     printer << "IdentifiedVariableNode(" << node->Name << ")";
 
-    node->Walk(this, false);
-
-    return VisitResult::Stop;
+    return VisitResult::Continue;
   }
 
   virtual VisitResult Visit(ExpressionVariableNode* node)
   {
-    NodePrinter printer;
+    NodePrinter &printer = Open();
     printer << "ExpressionVariableNode";
 
-    node->Walk(this, false);
-
-    return VisitResult::Stop;
+    return VisitResult::Continue;
   }
 
   virtual VisitResult Visit(VariableSuffixNode* node)
   {
-    NodePrinter printer;
+    NodePrinter &printer = Open();
     printer << "VariableSuffixNode";
 
-    node->Walk(this, false);
-
-    return VisitResult::Stop;
+    return VisitResult::Continue;
   }
 
   virtual VisitResult Visit(CallNode* node)
   {
-    NodePrinter printer;
+    NodePrinter &printer = Open();
     printer << "CallNode";
 
-    node->Walk(this, false);
-
-    return VisitResult::Stop;
+    return VisitResult::Continue;
   }
 
   virtual VisitResult Visit(MemberCallNode* node)
   {
-    NodePrinter printer;
+    NodePrinter &printer = Open();
     printer << "MemberCallNode(" << node->Name << ")";
 
-    node->Walk(this, false);
-
-    return VisitResult::Stop;
+    return VisitResult::Continue;
   }
 
   virtual VisitResult Visit(ArgumentNode* node)
   {
-    NodePrinter printer;
+    NodePrinter &printer = Open();
     printer << "ArgumentNode";
 
-    node->Walk(this, false);
-
-    return VisitResult::Stop;
+    return VisitResult::Continue;
   }
 
   virtual VisitResult Visit(ExpressionArgumentNode* node)
   {
-    NodePrinter printer;
+    NodePrinter &printer = Open();
     printer << "ExpressionArgumentNode";
 
-    node->Walk(this, false);
-
-    return VisitResult::Stop;
+    return VisitResult::Continue;
   }
 
   virtual VisitResult Visit(TableArgumentNode* node)
   {
-    NodePrinter printer;
+    NodePrinter &printer = Open();
     printer << "TableArgumentNode";
 
-    node->Walk(this, false);
-
-    return VisitResult::Stop;
+    return VisitResult::Continue;
   }
 
   virtual VisitResult Visit(StringArgumentNode* node)
   {
-    NodePrinter printer;
+    NodePrinter &printer = Open();
     printer << "StringArgumentNode(" << node->String << ")";
 
-    node->Walk(this, false);
-
-    return VisitResult::Stop;
+    return VisitResult::Continue;
   }
 
 
   virtual VisitResult Visit(IndexNode* node)
   {
-    NodePrinter printer;
+    NodePrinter &printer = Open();
     printer << "IndexNode";
 
-    node->Walk(this, false);
-
-    return VisitResult::Stop;
+    return VisitResult::Continue;
   }
 
   virtual VisitResult Visit(IdentifiedIndexNode* node)
   {
-    NodePrinter printer;
+    NodePrinter &printer = Open();
     printer << "IdentifiedIndexNode(" << node->Name << ")";
 
-    node->Walk(this, false);
-
-    return VisitResult::Stop;
+    return VisitResult::Continue;
   }
 
   virtual VisitResult Visit(ExpressionIndexNode* node)
   {
-    NodePrinter printer;
+    NodePrinter &printer = Open();
     printer << "ExpressionIndexNode";
 
-    node->Walk(this, false);
-
-    return VisitResult::Stop;
+    return VisitResult::Continue;
   }
 
 
   virtual VisitResult Visit(BreakNode* node)
   {
-    NodePrinter printer;
+    NodePrinter &printer = Open();
     printer << "BreakNode";
 
-    node->Walk(this, false);
-
-    return VisitResult::Stop;
+    return VisitResult::Continue;
   }
 
   virtual VisitResult Visit(ReturnNode* node)
   {
-    NodePrinter printer;
+    NodePrinter &printer = Open();
     printer << "ReturnNode";
 
-    node->Walk(this, false);
-
-    return VisitResult::Stop;
+    return VisitResult::Continue;
   }
 
   virtual VisitResult Visit(ExpressionNode* node)
   {
-    NodePrinter printer;
+    NodePrinter &printer = Open();
     printer << "ExpressionNode(" << node->Expression << ")";
 
-    node->Walk(this, false);
-
-    return VisitResult::Stop;
+    return VisitResult::Continue;
   }
 
   virtual VisitResult Visit(ValueNode* node)
   {
-    NodePrinter printer;
+    NodePrinter &printer = Open();
     printer << "ValueNode(" << node->Expression << ")";
 
-    node->Walk(this, false);
-
-    return VisitResult::Stop;
+    return VisitResult::Continue;
   }
 
   virtual VisitResult Visit(TableNode* node)
   {
-    NodePrinter printer;
+    NodePrinter &printer = Open();
     printer << "TableNode";
 
-    node->Walk(this, false);
-
-    return VisitResult::Stop;
+    return VisitResult::Continue;
   }
 
   virtual VisitResult Visit(FunctionExpressionNode* node)
   {
-    NodePrinter printer;
+    NodePrinter &printer = Open();
     printer << "FunctionExpressionNode";
 
-    node->Walk(this, false);
-
-    return VisitResult::Stop;
+    return VisitResult::Continue;
   }
 
   virtual VisitResult Visit(FunctionCallNode* node)
   {
-    NodePrinter printer;
+    NodePrinter &printer = Open();
     printer << "FunctionCallNode";
 
-    node->Walk(this, false);
-
-    return VisitResult::Stop;
+    return VisitResult::Continue;
   }
 
   virtual VisitResult Visit(PrefixExpressionNode* node)
   {
-    NodePrinter printer;
+    NodePrinter &printer = Open();
     printer << "PrefixExpressionNode";
 
-    node->Walk(this, false);
-
-    return VisitResult::Stop;
+    return VisitResult::Continue;
   }
 
   virtual VisitResult Visit(UnaryOperatorNode* node)
   {
-    NodePrinter printer;
+    NodePrinter &printer = Open();
     printer << "UnaryOperatorNode(" << node->Operator << ")";
 
-    node->Walk(this, false);
-
-    return VisitResult::Stop;
+    return VisitResult::Continue;
   }
 
   virtual VisitResult Visit(BinaryOperatorNode* node)
   {
-    NodePrinter printer;
+    NodePrinter &printer = Open();
     printer << "BinaryOperatorNode(" << node->Operator << ")";
 
-    node->Walk(this, false);
-
-    return VisitResult::Stop;
+    return VisitResult::Continue;
   }
 
   virtual VisitResult Visit(FunctionNode* node)
   {
-    NodePrinter printer;
+    NodePrinter &printer = Open();
     printer << "FunctionNode";
 
     for (auto &token : node->ParameterList)
@@ -1975,54 +2139,44 @@ public:
       printer << " | " << token;
     }
 
-    node->Walk(this, false);
-
-    return VisitResult::Stop;
+    return VisitResult::Continue;
   }
 
   virtual VisitResult Visit(FunctionNameNode* node)
   {
-    NodePrinter printer;
+    NodePrinter &printer = Open();
     printer << "FunctionNameNode(" << node->Name << "," << node->IsMemberFunc << ")";
 
-    node->Walk(this, false);
-
-    return VisitResult::Stop;
+    return VisitResult::Continue;
   }
 
   virtual VisitResult Visit(WhileNode* node)
   {
-    NodePrinter printer;
+    NodePrinter &printer = Open();
     printer << "WhileNode";
 
-    node->Walk(this, false);
-
-    return VisitResult::Stop;
+    return VisitResult::Continue;
   }
 
   virtual VisitResult Visit(IfNode* node)
   {
-    NodePrinter printer;
+    NodePrinter &printer = Open();
     printer << "IfNode";
 
-    node->Walk(this, false);
-
-    return VisitResult::Stop;
+    return VisitResult::Continue;
   }
 
   virtual VisitResult Visit(ForNode* node)
   {
-    NodePrinter printer;
+    NodePrinter &printer = Open();
     printer << "ForNode";
 
-    node->Walk(this, false);
-
-    return VisitResult::Stop;
+    return VisitResult::Continue;
   }
 
   virtual VisitResult Visit(GenericForNode* node)
   {
-    NodePrinter printer;
+    NodePrinter &printer = Open();
     printer << "GenericForNode";
 
     for (auto &token : node->Names)
@@ -2030,34 +2184,28 @@ public:
       printer << " | " << token;
     }
 
-    node->Walk(this, false);
-
-    return VisitResult::Stop;
+    return VisitResult::Continue;
   }
 
   virtual VisitResult Visit(NumericForNode* node)
   {
-    NodePrinter printer;
+    NodePrinter &printer = Open();
     printer << "NumericForNode";
 
-    node->Walk(this, false);
-
-    return VisitResult::Stop;
+    return VisitResult::Continue;
   }
 
   virtual VisitResult Visit(RepeatNode* node)
   {
-    NodePrinter printer;
+    NodePrinter &printer = Open();
     printer << "RepeatNode";
 
-    node->Walk(this, false);
-
-    return VisitResult::Stop;
+    return VisitResult::Continue;
   }
 
   virtual VisitResult Visit(LocalVariableNode* node)
   {
-    NodePrinter printer;
+    NodePrinter &printer = Open();
     printer << "LocalVariableNode";
 
     for (auto &token : node->Names)
@@ -2065,9 +2213,7 @@ public:
       printer << " | " << token;
     }
 
-    node->Walk(this, false);
-
-    return VisitResult::Stop;
+    return VisitResult::Continue;
   }
 };
 
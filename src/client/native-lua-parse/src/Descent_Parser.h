@@ -87,7 +87,16 @@ public:
 #endif
 
 
+class TokenStream;
+
 std::unique_ptr<AbstractNode> RecognizeTokens(std::vector<Token> &tokens, std::vector<ParsingException> *error = nullptr, bool throwException = false);
+
+//Parses tokens as they're lexed, without a token list. The tree comes out the same as from RecognizeTokens.
+std::unique_ptr<AbstractNode> RecognizeStream(TokenStream &stream, std::vector<ParsingException> *error = nullptr, bool throwException = false);
+//The same tree as RecognizeTokens, with the statements of the main chunk parsed on several threads (one per core
+//with threads = 0) for very large files. Falls back to RecognizeTokens when the file is too small, where the
+//statements start can't be told from the keywords alone, or when there are errors.
+std::unique_ptr<AbstractNode> RecognizeTokensParallel(std::vector<Token> &tokens, std::vector<ParsingException> *error = nullptr, bool throwException = false, unsigned threads = 0);
 void RemoveWhitespaceAndComments(std::vector<Token> &tokens);
 void PrintTree(AbstractNode* node);
 void GenerateTree(AbstractNode* node);
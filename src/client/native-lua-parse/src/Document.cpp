@@ -0,0 +1,359 @@
+#include "Document.h"
+#include "Incremental_Lexer.h"
+#include "Phase_Stats.h"
+
+#include <algorithm>
+#include <chrono>
+
+namespace demo
+{
+  Lexer::DfaState *lexer;
+  Library *masterLibrary;
+  bool deferFunctionBodies = false;
+
+  std::unordered_map<std::string, std::unique_ptr<Document>> Documents;
+  std::unordered_map<std::string, std::unique_ptr<DocumentMemory>> DocumentMemories;
+
+  void Document::Parse(std::string documentText)
+  {
+    TextChange change;
+    {
+      ScopedPhase timer(Phase::Diff);
+      change = text.Diff(documentText.data(), documentText.size());
+    }
+
+    if (ast != nullptr && change.IsEmpty())
+      return;
+
+    //Taking over the new buffer is cheaper than copying most of it into the table
+    if (ast == nullptr || change.NewEnd - change.Start > documentText.size() / 2)
+    {
+      Rebuild(std::move(documentText));
+      return;
+    }
+
+    {
+      ScopedMemoryAccount account(Account(MemoryCategory::Text));
+      text.Replace(change.Start, change.OldEnd, documentText.data() + change.Start, change.NewEnd - change.Start);
+    }
+    Update(change);
+  }
+
+  void Document::ApplyEdits(const std::vector<TextEdit> &edits)
+  {
+    //Updating sets its own accounts, what's left is the text (or a compacted copy of it)
+    ScopedMemoryAccount account(Account(MemoryCategory::Text));
+
+    TextChange change;
+    for (const TextEdit &edit : edits)
+    {
+      size_t start = 0;
+      size_t end = text.Size();
+      if (edit.hasRange)
+      {
+        start = text.Offset(edit.start.Line, edit.start.Character);
+        end = std::max(start, text.Offset(edit.end.Line, edit.end.Character));
+      }
+      else
+      {
+        //Replacing everything, only keep the part that actually changed
+        TextChange difference;
+        {
+          ScopedPhase timer(Phase::Diff);
+          difference = text.Diff(edit.text.data(), edit.text.size());
+        }
+        text.Replace(difference.Start, difference.OldEnd, edit.text.data() + difference.Start, difference.NewEnd - difference.Start);
+        change.Add(difference.Start, difference.OldEnd, difference.NewEnd - difference.Start);
+        continue;
+      }
+
+      text.Replace(start, end, edit.text.data(), edit.text.size());
+      change.Add(start, end, edit.text.size());
+    }
+
+    if (!change.IsEmpty())
+      Update(change);
+  }
+
+  std::string Document::PrefixAt(unsigned lineNumber, unsigned charNumber)
+  {
+    EnsureTokens();
+
+    size_t cursor = text.Offset(lineNumber, charNumber);
+
+    //Last token starting before the cursor
+    auto it = std::upper_bound(tokens.begin(), tokens.end(), cursor, [](size_t offset, const Token &token)
+    {
+      return offset <= token.Offset;
+    });
+
+    if (it == tokens.begin())
+      return std::string();
+
+    const Token &token = *(it - 1);
+    if (token.EnumTokenType != Token::Type::Identifier || token.Offset + token.Length < cursor)
+      return std::string();
+
+    return std::string(token.Text, cursor - token.Offset);
+  }
+
+  void Document::Update(const TextChange &change)
+  {
+    if (text.NeedsCompacting())
+    {
+      Rebuild(text.str());
+      return;
+    }
+
+    //Without the old tokens there's nothing to relex against
+    if (!tokensLexed)
+    {
+      Lex();
+      Release();
+      Build();
+      return;
+    }
+
+    bool unchanged;
+    {
+      ScopedPhase timer(Phase::Relex);
+      ScopedMemoryAccount account(Account(MemoryCategory::Tokens));
+      unchanged = RelexTokens(lexer, text, change, tokens);
+    }
+
+    if (unchanged)
+    {
+      //Only whitespace or comments changed, so the tree and its types still hold
+      my_log("Parsing Skipped (no significant changes)\n");
+      return;
+    }
+
+    Release();
+    Build();
+  }
+
+  void Document::Rebuild(std::string documentText)
+  {
+    //The tree points into the table's buffers, so it has to go before they do
+    Release();
+
+    {
+      //The buffer is taken over as it is, it was allocated before anything was being counted
+      ScopedMemoryAccount account(Account(MemoryCategory::Text));
+      ChargeString(documentText, Account(MemoryCategory::Text));
+      text.Reset(std::move(documentText));
+    }
+
+    Lex();
+    Build();
+  }
+
+  void Document::Index(std::string documentText)
+  {
+    Release();
+
+    {
+      ScopedMemoryAccount account(Account(MemoryCategory::Text));
+      ChargeString(documentText, Account(MemoryCategory::Text));
+      text.Reset(std::move(documentText));
+    }
+
+    tokens.clear();
+    tokensLexed = false;
+    Build();
+  }
+
+  void Document::EnsureTokens()
+  {
+    if (tokensLexed)
+      return;
+
+    Lex();
+    CountUsage();
+  }
+
+  void Document::Lex()
+  {
+    ScopedPhase timer(Phase::Lex);
+    ScopedMemoryAccount account(Account(MemoryCategory::Tokens));
+    tokens.clear();
+
+    //Generated data files can run to hundreds of MB, those are split over every core
+    LexTokensParallel(lexer, text, tokens);
+    tokensLexed = true;
+  }
+
+  //Let go of the tree and the symbols it was holding on to
+  void Document::Release()
+  {
+    ScopedPhase timer(Phase::Release);
+    libRefs.Release();
+    ast = nullptr;
+    lastErrors.clear();
+    usage.clear();
+  }
+
+  void Document::Build()
+  {
+    std::vector<ParsingException> errors;
+    {
+      ScopedPhase timer(Phase::Parse);
+      ScopedMemoryAccount account(Account(MemoryCategory::Tree));
+      if (tokensLexed)
+        ast = std::move(RecognizeTokensParallel(tokens, &errors, false));
+      else
+      {
+        //Lexing happens as the parser asks for tokens, so it's counted as parsing
+        TokenStream stream(lexer, text);
+        ast = std::move(RecognizeStream(stream, &errors, false));
+      }
+    }
+
+    {
+      ScopedMemoryAccount account(Account(MemoryCategory::Errors));
+      lastErrors = errors;
+    }
+
+    if (lastErrors.size() > 0)
+    {
+      my_log("Parsing Failed!\n");
+      for (auto && e : lastErrors)
+      {
+        my_log("Error (%s:%d: %s)\n", "Test", e.position.Line, e.what());
+      }
+    }
+    else
+      my_log("Parsing Successful\n");
+
+    {
+      ScopedMemoryAccount account(Account(MemoryCategory::Symbols));
+      typesDeferred = deferFunctionBodies;
+      ResolveTypes(ast.get(), masterLibrary, &libRefs, typesDeferred);
+    }
+
+    if (tokensLexed)
+      CountUsage();
+  }
+
+  void Document::ResolveAt(DocumentPosition position)
+  {
+    if (!typesDeferred || !ast)
+      return;
+
+    ScopedMemoryAccount account(Account(MemoryCategory::Symbols));
+    ResolveTypesAt(ast.get(), position, masterLibrary, &libRefs);
+  }
+
+  void Document::CountUsage()
+  {
+    ScopedPhase timer(Phase::Usage);
+    ScopedMemoryAccount account(Account(MemoryCategory::Usage));
+    std::string name;
+    for (const Token &token : tokens)
+    {
+      if (token.EnumTokenType == Token::Type::Identifier)
+      {
+        name.assign(token.Text, token.Length);
+        ++usage[name];
+      }
+    }
+  }
+
+  void Initialize()
+  {
+    lexer = Lexer::CreateLanguageDfa();
+    masterLibrary = CreateCoreLibrary();
+  }
+
+  //A new, empty document for uri
+  static Document *OpenDocument(const std::string &uri, int version)
+  {
+    std::unique_ptr<DocumentMemory> &memory = DocumentMemories[uri];
+    if (memory == nullptr)
+      memory = std::make_unique<DocumentMemory>();
+
+    std::unique_ptr<Document> doc = std::make_unique<Document>();
+    doc->memory = memory.get();
+    doc->version = version;
+
+    Document *opened = doc.get();
+    Documents[uri] = std::move(doc);
+    return opened;
+  }
+
+  void ParseDocument(std::string uri, std::string text, int version) {
+    auto it = Documents.find(uri);
+    if (it != Documents.end())
+    {
+      it->second->version = version;
+      it->second->Parse(std::move(text));
+    }
+    else
+      OpenDocument(uri, version)->Parse(std::move(text));
+  }
+
+  void ParseDocuments(std::vector<DocumentSource> &&files, std::vector<ParseResult> &results) {
+    results.resize(files.size());
+    for (size_t i = 0; i < files.size(); ++i)
+    {
+      auto start = std::chrono::high_resolution_clock::now();
+
+      //New files are only indexed, ones indexed before are parsed like any other change. A file the editor has
+      //open (it has a version) is left alone, its buffer is newer than what's on disk and edits build on it.
+      auto it = Documents.find(files[i].uri);
+      if (it == Documents.end())
+        OpenDocument(files[i].uri, -1)->Index(std::move(files[i].text));
+      else if (it->second->version < 0)
+        it->second->Parse(std::move(files[i].text));
+
+      auto end = std::chrono::high_resolution_clock::now();
+      results[i].errors = (unsigned)Documents[files[i].uri]->lastErrors.size();
+      results[i].milliseconds = std::chrono::duration<double, std::milli>(end - start).count();
+    }
+  }
+
+  bool ApplyEdits(const std::string &uri, int version, const std::vector<TextEdit> &edits) {
+    auto it = Documents.find(uri);
+    if (it == Documents.end() || version <= it->second->version)
+      return false;
+
+    it->second->version = version;
+    it->second->ApplyEdits(edits);
+    return true;
+  }
+
+  std::string CompletionPrefix(const std::string &uri, unsigned lineNumber, unsigned charNumber) {
+    auto it = Documents.find(uri);
+    if (it == Documents.end())
+      return std::string();
+
+    return it->second->PrefixAt(lineNumber, charNumber);
+  }
+
+  void AutoComplete(const std::string &uri, unsigned lineNumber, unsigned charNumber, const std::string &prefix, size_t maxEntries, std::vector<AutoCompleteEntry> &entries) {
+    auto it = Documents.find(uri);
+    if (it != Documents.end())
+    {
+      Document &doc = *it->second;
+
+      doc.EnsureTokens();
+      doc.ResolveAt(DocumentPosition(lineNumber, charNumber));
+
+      my_log("**************       AUTOCOMPLETE      **************\n");
+      {
+        ScopedPhase timer(Phase::ResolveAutocomplete);
+        ResolveAutocomplete(doc.ast.get(), lineNumber, charNumber, prefix, entries, masterLibrary, doc.tokens);
+      }
+
+      ScopedPhase timer(Phase::Rank);
+      for (AutoCompleteEntry &entry : entries)
+      {
+        auto use = doc.usage.find(entry.name);
+        if (use != doc.usage.end())
+          entry.uses = use->second;
+      }
+
+      RankAutocomplete(entries, maxEntries);
+    }
+  }
+}
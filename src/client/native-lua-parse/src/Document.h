@@ -0,0 +1,127 @@
+#pragma once
+#include "Lexer_DFA.h"
+#include "Piece_Table.h"
+#include "Descent_Parser.h"
+#include "TypeSystem.h"
+#include "AutoComplete.h"
+#include "Memory_Accounting.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+// Everything the node binding does, without any of the V8 parts (so it can also be driven from native code)
+namespace demo
+{
+  extern Lexer::DfaState *lexer;
+  extern Library *masterLibrary;
+
+  //Documents built while this is set only have their main chunk resolved, a function's body is resolved once a
+  //completion lands inside it (see ResolveTypesAt). Set by the binding's SetDeferFunctionBodies.
+  //
+  //Off by default because completions can come out different: until a body is resolved, what the function
+  //returns is unknown (no members after a call to it) and the globals only it assigns don't exist, so they're
+  //missing from completions everywhere else in the file.
+  extern bool deferFunctionBodies;
+
+  //One change from the editor (LSP TextDocumentContentChangeEvent), without a range it replaces everything
+  struct TextEdit
+  {
+    bool hasRange = false;
+    DocumentPosition start;
+    DocumentPosition end;
+    std::string text;
+  };
+
+  struct Document
+  {
+    PieceTable text;
+    std::vector<Token> tokens;
+    std::unique_ptr<AbstractNode> ast;
+    std::vector<ParsingException> lastErrors;
+    LibraryReference libRefs;
+    int version = -1;
+
+    //How many times each identifier shows up, used to rank completions
+    std::unordered_map<std::string, unsigned> usage;
+
+    //Where this document's allocations get counted, nothing is counted without one
+    DocumentMemory *memory = nullptr;
+
+    //Full text of the document, only what differs from the current text is looked at again.
+    //Takes the string by value so callers can move their buffer in instead of copying it.
+    void Parse(std::string documentText);
+
+    //Parses a document that's being indexed. Its tokens are read straight off the lexer by the parser and
+    //aren't kept, they're only lexed once an edit or a completion needs them (most indexed files never do).
+    void Index(std::string documentText);
+
+    //Edits are applied one after another, like the editor made them
+    void ApplyEdits(const std::vector<TextEdit> &edits);
+
+    //The part of the identifier in front of the cursor, what's being typed
+    std::string PrefixAt(unsigned lineNumber, unsigned charNumber);
+
+    //Lexes the tokens (and counts usage from them) if the document was indexed without them
+    void EnsureTokens();
+
+    //Resolves the function bodies around a position that were left for later, see deferFunctionBodies
+    void ResolveAt(DocumentPosition position);
+
+  private:
+    void Update(const TextChange &change);
+    void Rebuild(std::string documentText);
+    void Release();
+    void Lex();
+    void Build();
+    void CountUsage();
+
+    //False while tokens (and usage) were left out, see Index
+    bool tokensLexed = false;
+
+    //The tree was resolved with deferFunctionBodies set
+    bool typesDeferred = false;
+
+    MemoryAccount *Account(MemoryCategory category) { return memory != nullptr ? memory->Account(category) : nullptr; }
+  };
+
+  extern std::unordered_map<std::string, std::unique_ptr<Document>> Documents;
+
+  //Memory of every document by uri (see Memory_Accounting.h). These stay after a document is gone, what it
+  //made can outlive it.
+  extern std::unordered_map<std::string, std::unique_ptr<DocumentMemory>> DocumentMemories;
+
+  //A file handed over for indexing
+  struct DocumentSource
+  {
+    std::string uri;
+    std::string text;
+  };
+
+  //How parsing one file of a ParseDocuments call went
+  struct ParseResult
+  {
+    unsigned errors = 0;
+    double milliseconds = 0;
+  };
+
+  //Creates the lexer and the core library, has to be called before anything else
+  void Initialize();
+
+  //The version numbers edits are checked against start over from the given one
+  void ParseDocument(std::string uri, std::string text, int version = -1);
+
+  //Parses a whole batch of files (workspace indexing), one result per file in the same order. Files the editor
+  //has open keep their text and version.
+  void ParseDocuments(std::vector<DocumentSource> &&files, std::vector<ParseResult> &results);
+
+  //Returns false if the document isn't known or the edits are older than what it already has
+  bool ApplyEdits(const std::string &uri, int version, const std::vector<TextEdit> &edits);
+
+  //The part of the identifier in front of the cursor, empty if the document isn't known
+  std::string CompletionPrefix(const std::string &uri, unsigned lineNumber, unsigned charNumber);
+
+  //Everything that could go at the cursor and fuzzy matches prefix, best first (see RankAutocomplete for maxEntries)
+  void AutoComplete(const std::string &uri, unsigned lineNumber, unsigned charNumber, const std::string &prefix, size_t maxEntries, std::vector<AutoCompleteEntry> &entries);
+}
@@ -0,0 +1,219 @@
+#include "FuzzyMatch.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define FUZZY_MATCH_SSE2
+#include <emmintrin.h>
+#endif
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+//Bonuses on top of the one point every matched character gets
+static const unsigned NameStartBonus = 16;
+static const unsigned WordStartBonus = 8;
+static const unsigned RunBonus = 4;
+
+static unsigned LowestBit(unsigned mask)
+{
+#ifdef _MSC_VER
+  unsigned long index;
+  _BitScanForward(&index, mask);
+  return index;
+#else
+  return __builtin_ctz(mask);
+#endif
+}
+
+static char Fold(char c)
+{
+  return (c >= 'A' && c <= 'Z') ? c - 'A' + 'a' : c;
+}
+
+//One bit per letter, one for all digits, one for '_' and one for everything else
+static uint32_t CharacterBit(char c)
+{
+  c = Fold(c);
+  if (c >= 'a' && c <= 'z')
+    return 1u << (c - 'a');
+  if (c >= '0' && c <= '9')
+    return 1u << 26;
+  if (c == '_')
+    return 1u << 27;
+  return 1u << 28;
+}
+
+static uint32_t CharacterMask(const char *text, size_t length)
+{
+  uint32_t mask = 0;
+  for (size_t i = 0; i < length; ++i)
+    mask |= CharacterBit(text[i]);
+  return mask;
+}
+
+//First position at or after 'from' holding c, or length if there isn't one
+static size_t FindCharacter(const char *text, size_t from, size_t length, char c)
+{
+  size_t i = from;
+
+#ifdef FUZZY_MATCH_SSE2
+  __m128i needle = _mm_set1_epi8(c);
+  for (; i + 16 <= length; i += 16)
+  {
+    unsigned found = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(text + i)), needle));
+    if (found != 0)
+      return i + LowestBit(found);
+  }
+#endif
+
+  for (; i < length; ++i)
+  {
+    if (text[i] == c)
+      return i;
+  }
+
+  return length;
+}
+
+bool IsWordStart(const char *name, size_t i)
+{
+  if (i == 0)
+    return true;
+
+  char previous = name[i - 1];
+  char current = name[i];
+  if (previous == '_' && current != '_')
+    return true;
+
+  return current >= 'A' && current <= 'Z' && previous >= 'a' && previous <= 'z';
+}
+
+bool HasWordStartingWith(const char *name, size_t length, char c)
+{
+  c = Fold(c);
+  for (size_t i = 0; i < length; ++i)
+  {
+    if (Fold(name[i]) == c && IsWordStart(name, i))
+      return true;
+  }
+
+  return false;
+}
+
+//name is the original text (for word starts), folded the lowercased copy, pattern is already lowercased
+static unsigned Score(const char *name, const char *folded, size_t length, const char *pattern, size_t patternLength)
+{
+  if (patternLength > length)
+    return 0;
+
+  //The first character has to start a word
+  size_t position = FindCharacter(folded, 0, length, pattern[0]);
+  while (position < length && !IsWordStart(name, position))
+    position = FindCharacter(folded, position + 1, length, pattern[0]);
+
+  if (position == length)
+    return 0;
+
+  unsigned score = 1 + (position == 0 ? NameStartBonus : WordStartBonus);
+  bool prefix = position == 0;
+
+  for (size_t i = 1; i < patternLength; ++i)
+  {
+    size_t next = FindCharacter(folded, position + 1, length, pattern[i]);
+    if (next == length)
+      return 0;
+
+    score += 1;
+    if (next == position + 1)
+      score += RunBonus;
+    else
+    {
+      prefix = false;
+      if (IsWordStart(name, next))
+        score += WordStartBonus;
+    }
+
+    position = next;
+  }
+
+  return prefix ? score + FuzzyPrefixMatch : score;
+}
+
+static std::string Folded(const char *text, size_t length)
+{
+  std::string folded(text, length);
+  for (char &c : folded)
+    c = Fold(c);
+  return folded;
+}
+
+unsigned FuzzyScore(const char *name, size_t length, const char *pattern, size_t patternLength)
+{
+  if (patternLength == 0)
+    return 1;
+
+  std::string folded = Folded(name, length);
+  std::string foldedPattern = Folded(pattern, patternLength);
+  return Score(name, folded.data(), length, foldedPattern.data(), patternLength);
+}
+
+void FuzzyCandidates::Add(const char *name, size_t length)
+{
+  size_t start = text.size();
+  text.append(name, length);
+  folded.resize(text.size());
+
+  for (size_t i = start; i < text.size(); ++i)
+    folded[i] = Fold(text[i]);
+
+  ends.push_back((uint32_t)text.size());
+  masks.push_back(CharacterMask(name, length));
+}
+
+void FuzzyCandidates::Clear()
+{
+  text.clear();
+  folded.clear();
+  ends.clear();
+  masks.clear();
+}
+
+void FuzzyCandidates::Match(const char *pattern, size_t patternLength, std::vector<unsigned> &scores) const
+{
+  scores.assign(ends.size(), patternLength == 0 ? 1 : 0);
+  if (patternLength == 0)
+    return;
+
+  std::string foldedPattern = Folded(pattern, patternLength);
+  const uint32_t patternMask = CharacterMask(pattern, patternLength);
+
+  auto score = [&](size_t i)
+  {
+    size_t start = i != 0 ? ends[i - 1] : 0;
+    scores[i] = Score(text.data() + start, folded.data() + start, ends[i] - start, foldedPattern.data(), patternLength);
+  };
+
+  size_t i = 0;
+
+#ifdef FUZZY_MATCH_SSE2
+  //Check the masks of four candidates at a time, most of them are missing some character of the pattern
+  __m128i wanted = _mm_set1_epi32((int)patternMask);
+  for (; i + 4 <= masks.size(); i += 4)
+  {
+    __m128i present = _mm_and_si128(_mm_loadu_si128((const __m128i *)(masks.data() + i)), wanted);
+    unsigned lanes = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(present, wanted)));
+
+    while (lanes != 0)
+    {
+      score(i + LowestBit(lanes));
+      lanes &= lanes - 1;
+    }
+  }
+#endif
+
+  for (; i < masks.size(); ++i)
+  {
+    if ((masks[i] & patternMask) == patternMask)
+      score(i);
+  }
+}
@@ -0,0 +1,40 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+// Scores at or above this matched the whole pattern as a prefix of the name
+const unsigned FuzzyPrefixMatch = 0x10000;
+
+// Whether name[i] starts a word: the start of the name, after a '_' or a camelCase hump
+bool IsWordStart(const char *name, size_t i);
+
+// Whether a word of name starts with c (ignoring case), which a pattern starting with c needs to match at all
+bool HasWordStartingWith(const char *name, size_t length, char c);
+
+// Score of a single name against pattern, 0 if it doesn't match. Case is ignored.
+// Every pattern character has to show up in the name in order, and the first one has to start a word.
+// Word starts and runs of characters score higher.
+unsigned FuzzyScore(const char *name, size_t length, const char *pattern, size_t patternLength);
+
+// Candidate names packed back to back in one buffer, so a pattern is checked against all of them in one pass
+class FuzzyCandidates
+{
+public:
+  void Add(const char *name, size_t length);
+  void Clear();
+  size_t Size() const { return ends.size(); }
+
+  // Scores every candidate (in the order they were added) the same way FuzzyScore does
+  void Match(const char *pattern, size_t patternLength, std::vector<unsigned> &scores) const;
+
+private:
+  // The names as given and lowercased
+  std::string text;
+  std::string folded;
+  std::vector<uint32_t> ends;
+
+  // Which characters show up in each name, candidates missing any of the pattern's are skipped without looking at them
+  std::vector<uint32_t> masks;
+};
@@ -0,0 +1,466 @@
+#include "Incremental_Lexer.h"
+#include "Tracing.h"
+#include "Memory_Accounting.h"
+#include <cstring>
+#include <cstddef>
+#include <algorithm>
+#include <thread>
+
+static bool IsWhitespaceOrComment(const Token &token)
+{
+  return token.EnumTokenType == Token::Type::Whitespace || token.EnumTokenType == Token::Type::Comment;
+}
+
+//Reads the tokens of a document one after another, straight out of its pieces
+struct TokenReader
+{
+  TokenReader(Lexer::DfaState *root, const std::vector<PieceTable::Piece> &pieces, PieceTable *storage)
+    :root(root), pieces(pieces), storage(storage)
+  {
+    for (const PieceTable::Piece &piece : pieces)
+      size += piece.Length;
+  }
+
+  //Moves to a byte offset, starting from the line/char numbers the lexer had there
+  void Seek(size_t documentOffset, unsigned line, unsigned character)
+  {
+    lineNumber = line;
+    charNumber = character;
+    offset = documentOffset;
+    pendingScanEnd = documentOffset;
+
+    size_t pieceStart = 0;
+    for (piece = 0; piece < pieces.size(); ++piece)
+    {
+      if (documentOffset < pieceStart + pieces[piece].Length)
+        break;
+      pieceStart += pieces[piece].Length;
+    }
+
+    if (piece < pieces.size())
+    {
+      stream = pieces[piece].Text + (documentOffset - pieceStart);
+      pieceEnd = pieces[piece].Text + pieces[piece].Length;
+    }
+    else
+      stream = pieceEnd = nullptr;
+  }
+
+  //Returns false once the end of the document is reached
+  bool Next(Token &token)
+  {
+    while (offset < size)
+    {
+      unsigned line = lineNumber;
+      unsigned character = charNumber;
+      Lexer::ReadToken(root, stream, token, lineNumber, charNumber);
+
+      //The lexer looked past the end of this piece (into whatever follows it in the buffer), so the token
+      //has to be read again from a copy of the text that runs on into the next pieces
+      bool documentEnd = piece + 1 == pieces.size() && *pieceEnd == '\0';
+      if (token.ScanLength > (size_t)(pieceEnd - stream) && !documentEnd)
+      {
+        lineNumber = line;
+        charNumber = character;
+        ReadAcrossPieces(token);
+      }
+
+      token.Offset = (unsigned)offset;
+      size_t scanEnd = offset + token.ScanLength;
+      bool skipped = token.Length == 0 || IsWhitespaceOrComment(token);
+
+      //Characters the lexer doesn't know about are stepped over
+      Advance(token.Length != 0 ? token.Length : 1);
+
+      if (skipped)
+      {
+        //Remember how far the skipped text was looked at, the next real token owns it
+        if (scanEnd > pendingScanEnd)
+          pendingScanEnd = scanEnd;
+
+        if (token.Length == 0)
+          continue;
+      }
+      else
+      {
+        if (pendingScanEnd > scanEnd)
+          token.ScanLength = (unsigned)(pendingScanEnd - token.Offset);
+
+        pendingScanEnd = offset;
+      }
+
+      return true;
+    }
+
+    return false;
+  }
+
+  void Advance(size_t count)
+  {
+    offset += count;
+
+    while (count >= (size_t)(pieceEnd - stream))
+    {
+      count -= pieceEnd - stream;
+      if (++piece == pieces.size())
+      {
+        stream = pieceEnd = nullptr;
+        return;
+      }
+
+      stream = pieces[piece].Text;
+      pieceEnd = stream + pieces[piece].Length;
+    }
+
+    stream += count;
+  }
+
+  void ReadAcrossPieces(Token &token)
+  {
+    std::string window;
+    for (size_t wanted = 256;; wanted *= 2)
+    {
+      //Copy up to 'wanted' bytes of the document, starting at the token
+      window.clear();
+      size_t current = piece;
+      const char *from = stream;
+      while (window.size() < wanted && current < pieces.size())
+      {
+        const char *end = pieces[current].Text + pieces[current].Length;
+        size_t count = std::min(wanted - window.size(), (size_t)(end - from));
+        window.append(from, count);
+
+        if (++current < pieces.size())
+          from = pieces[current].Text;
+      }
+
+      unsigned line = lineNumber;
+      unsigned character = charNumber;
+      Lexer::ReadToken(root, window.c_str(), token, line, character);
+
+      //Done once the lexer stopped inside the copy, or the copy reaches the end of the document anyway
+      if (token.ScanLength <= window.size() || offset + window.size() == size)
+      {
+        lineNumber = line;
+        charNumber = character;
+        break;
+      }
+    }
+
+    token.Text = storage->Store(window.data(), token.Length);
+  }
+
+  Lexer::DfaState *root;
+  const std::vector<PieceTable::Piece> &pieces;
+  PieceTable *storage;
+  size_t size = 0;
+
+  size_t piece = 0;
+  const char *stream = nullptr;
+  const char *pieceEnd = nullptr;
+  size_t offset = 0;
+  unsigned lineNumber = 0;
+  unsigned charNumber = 0;
+
+  //Furthest byte looked at by the whitespace/comments read since the last real token
+  size_t pendingScanEnd = 0;
+};
+
+void ParseStream(const char *stream, Lexer::DfaState* root, std::vector<Token> &tokens)
+{
+  std::vector<PieceTable::Piece> pieces(1, { stream, std::strlen(stream) });
+
+  //A single terminated piece never needs to copy tokens anywhere
+  TokenReader reader(root, pieces, nullptr);
+  reader.Seek(0, 0, 0);
+
+  Token token;
+  while (reader.Next(token))
+    tokens.push_back(token);
+}
+
+void LexTokens(Lexer::DfaState* root, PieceTable &text, std::vector<Token> &tokens)
+{
+  TokenReader reader(root, text.Pieces(), &text);
+  reader.Seek(0, 0, 0);
+
+  Token token;
+  while (reader.Next(token))
+  {
+    if (!IsWhitespaceOrComment(token))
+      tokens.push_back(token);
+  }
+}
+
+//Parts smaller than this aren't worth a thread
+static const size_t MinimumPartSize = 1 << 20;
+
+//What one thread made of its part of the document. The part is lexed as if a token started right where it
+//does, which is wrong when that's inside a long string or comment (see StitchParts).
+struct LexedPart
+{
+  size_t start = 0;
+  size_t limit = 0;
+  std::vector<Token> tokens;  //Lines counted from the start of the part
+
+  //Where the reader was after the last token starting before limit, to carry on from
+  size_t end = 0;
+  unsigned endLine = 0;
+  unsigned endChar = 0;
+  size_t endPending = 0;
+};
+
+static void LexPart(Lexer::DfaState *root, const std::vector<PieceTable::Piece> &pieces, bool keepTrivia, MemoryAccount *account, size_t phase, LexedPart &part)
+{
+  ScopedTrace trace("lexPart", "lex");
+  ScopedMemoryAccount charge(account);
+  size_t previousPhase = SetAllocationPhase(phase);
+
+  TokenReader reader(root, pieces, nullptr);
+  reader.Seek(part.start, 0, 0);
+
+  Token token;
+  for (;;)
+  {
+    part.end = reader.offset;
+    part.endLine = reader.lineNumber;
+    part.endChar = reader.charNumber;
+    part.endPending = reader.pendingScanEnd;
+
+    if (!reader.Next(token) || token.Offset >= part.limit)
+      break;
+
+    if (keepTrivia || !IsWhitespaceOrComment(token))
+      part.tokens.push_back(token);
+  }
+
+  SetAllocationPhase(previousPhase);
+}
+
+//Joins the parts into one list. Starting from where the first part (the only one known to be right) ended,
+//tokens are lexed one at a time until one starts where a token of a later part does. From there on that part
+//is the same as lexing straight through, apart from its line numbers (and the characters on the line the two
+//met on), so it's taken over and lexing picks up again where it ended. Usually that's the very first token.
+static void StitchParts(Lexer::DfaState *root, const std::vector<PieceTable::Piece> &pieces, bool keepTrivia, std::vector<LexedPart> &parts, std::vector<Token> &tokens)
+{
+  tokens.insert(tokens.end(), parts[0].tokens.begin(), parts[0].tokens.end());
+
+  TokenReader reader(root, pieces, nullptr);
+  reader.Seek(parts[0].end, parts[0].endLine, parts[0].endChar);
+  reader.pendingScanEnd = parts[0].endPending;
+
+  size_t next = 1;
+  Token token;
+  while (next < parts.size() && reader.Next(token))
+  {
+    bool significant = !IsWhitespaceOrComment(token);
+    if (keepTrivia || significant)
+      tokens.push_back(token);
+
+    //Only a significant token clears what the reader remembers of the trivia before it, after a comment or
+    //whitespace the two could still differ in how far the next token was looked at
+    if (!significant || token.Offset < parts[next].start)
+      continue;
+
+    size_t part = next;
+    while (part + 1 < parts.size() && token.Offset >= parts[part + 1].start)
+      ++part;
+
+    const std::vector<Token> &lexed = parts[part].tokens;
+    auto match = std::lower_bound(lexed.begin(), lexed.end(), token.Offset, [](const Token &candidate, size_t offset)
+    {
+      return candidate.Offset < offset;
+    });
+
+    if (match == lexed.end() || match->Offset != token.Offset)
+      continue;
+
+    unsigned syncLine = match->Position.Line;
+    unsigned lineShift = token.Position.Line - match->Position.Line;
+    unsigned charShift = token.Position.Character - match->Position.Character;
+
+    for (auto it = match + 1; it != lexed.end(); ++it)
+    {
+      Token moved = *it;
+      if (moved.Position.Line == syncLine)
+        moved.Position.Character += charShift;
+      moved.Position.Line += lineShift;
+      tokens.push_back(moved);
+    }
+
+    const LexedPart &synced = parts[part];
+    reader.Seek(synced.end, synced.endLine + lineShift, synced.endLine == syncLine ? synced.endChar + charShift : synced.endChar);
+    reader.pendingScanEnd = synced.endPending;
+    next = part + 1;
+  }
+
+  //The last part wasn't met up with, or there's text after the last part's tokens
+  while (reader.Next(token))
+  {
+    if (keepTrivia || !IsWhitespaceOrComment(token))
+      tokens.push_back(token);
+  }
+}
+
+//Returns false if the text is too small to be worth splitting, nothing is lexed then
+static bool LexParallel(Lexer::DfaState *root, const std::vector<PieceTable::Piece> &pieces, bool keepTrivia, unsigned threads, std::vector<Token> &tokens)
+{
+  const char *text = pieces[0].Text;
+  size_t size = pieces[0].Length;
+
+  if (threads == 0)
+    threads = std::thread::hardware_concurrency();
+  threads = (unsigned)std::min<size_t>(threads, size / MinimumPartSize);
+  if (threads < 2)
+    return false;
+
+  //Cut right after a newline close to every even split, a token is most likely to start there
+  std::vector<LexedPart> parts(1);
+  for (unsigned i = 1; i < threads; ++i)
+  {
+    size_t cut = std::max(size * i / threads, parts.back().start + 1);
+    const char *newline = cut < size ? (const char *)std::memchr(text + cut, '\n', size - cut) : nullptr;
+    if (newline == nullptr || (size_t)(newline - text) + 1 >= size)
+      break;
+
+    parts.back().limit = newline - text + 1;
+    parts.emplace_back();
+    parts.back().start = newline - text + 1;
+  }
+  parts.back().limit = size;
+
+  MemoryAccount *account = ActiveMemoryAccount();
+  size_t phase = ActiveAllocationPhase();
+  std::vector<std::thread> workers;
+  for (size_t i = 1; i < parts.size(); ++i)
+    workers.emplace_back(LexPart, root, std::cref(pieces), keepTrivia, account, phase, std::ref(parts[i]));
+
+  LexPart(root, pieces, keepTrivia, account, phase, parts[0]);
+  for (std::thread &worker : workers)
+    worker.join();
+
+  StitchParts(root, pieces, keepTrivia, parts, tokens);
+  return true;
+}
+
+void ParseStreamParallel(const char *stream, Lexer::DfaState* root, std::vector<Token> &tokens, unsigned threads)
+{
+  std::vector<PieceTable::Piece> pieces(1, { stream, std::strlen(stream) });
+  if (!LexParallel(root, pieces, true, threads, tokens))
+    ParseStream(stream, root, tokens);
+}
+
+void LexTokensParallel(Lexer::DfaState* root, PieceTable &text, std::vector<Token> &tokens, unsigned threads)
+{
+  //Tokens running across pieces get copied into the table, which isn't safe from several threads. A document
+  //that was just read in is a single piece.
+  if (text.Pieces().size() != 1 || !LexParallel(root, text.Pieces(), false, threads, tokens))
+    LexTokens(root, text, tokens);
+}
+
+TokenStream::TokenStream(Lexer::DfaState *root, PieceTable &text)
+  :reader(std::make_unique<TokenReader>(root, text.Pieces(), &text))
+{
+  reader->Seek(0, 0, 0);
+}
+
+TokenStream::~TokenStream()
+{
+}
+
+bool TokenStream::Next(Token &token)
+{
+  while (reader->Next(token))
+  {
+    if (!IsWhitespaceOrComment(token))
+      return true;
+  }
+
+  return false;
+}
+
+static bool SameToken(const Token &lhs, const Token &rhs)
+{
+  return lhs.TokenType == rhs.TokenType &&
+    lhs.Length == rhs.Length &&
+    lhs.Position.Line == rhs.Position.Line &&
+    lhs.Position.Character == rhs.Position.Character &&
+    std::memcmp(lhs.Text, rhs.Text, lhs.Length) == 0;
+}
+
+bool RelexTokens(Lexer::DfaState* root, PieceTable &text, const TextChange &change, std::vector<Token> &tokens)
+{
+  //How far text after the change moved
+  const ptrdiff_t shift = (ptrdiff_t)change.NewEnd - (ptrdiff_t)change.OldEnd;
+
+  //Tokens that were lexed without looking at any of the changed bytes are still correct
+  size_t first = 0;
+  while (first < tokens.size() && (size_t)tokens[first].Offset + tokens[first].ScanLength <= change.Start)
+    ++first;
+
+  //Start lexing right after the last good token, with the line/char the lexer had left off at
+  TokenReader reader(root, text.Pieces(), &text);
+  if (first != 0)
+  {
+    const Token &previous = tokens[first - 1];
+    reader.Seek(previous.Offset + previous.Length, previous.Position.Line, previous.Position.Character + 1);
+  }
+  else
+    reader.Seek(0, 0, 0);
+
+  std::vector<Token> relexed;
+  size_t resume = tokens.size();
+  size_t candidate = first;
+  unsigned syncLine = 0;
+  unsigned lineShift = 0;
+  unsigned charShift = 0;
+
+  Token token;
+  while (reader.Next(token))
+  {
+    if (IsWhitespaceOrComment(token))
+      continue;
+
+    relexed.push_back(token);
+
+    //After the change the text is the same as before, so as soon as a token starts where an old one did
+    //every token after it will also be the same (just moved)
+    if (token.Offset < change.NewEnd)
+      continue;
+
+    size_t oldOffset = token.Offset - shift;
+    while (candidate < tokens.size() && tokens[candidate].Offset < oldOffset)
+      ++candidate;
+
+    if (candidate < tokens.size() && tokens[candidate].Offset == oldOffset)
+    {
+      const Token &old = tokens[candidate];
+      syncLine = old.Position.Line;
+      lineShift = token.Position.Line - old.Position.Line;
+      charShift = token.Position.Character - old.Position.Character;
+      resume = candidate + 1;
+      break;
+    }
+  }
+
+  bool unchanged = lineShift == 0 && charShift == 0 && relexed.size() == resume - first;
+  for (size_t i = 0; unchanged && i < relexed.size(); ++i)
+    unchanged = SameToken(tokens[first + i], relexed[i]);
+
+  //Positions after the change only move by whole lines, except on the line the lexer synced up on
+  //where the characters shift too. Their text stays where it was.
+  for (size_t i = resume; i < tokens.size(); ++i)
+  {
+    Token &kept = tokens[i];
+    kept.Offset += (unsigned)shift;
+
+    if (kept.Position.Line == syncLine)
+      kept.Position.Character += charShift;
+    kept.Position.Line += lineShift;
+  }
+
+  tokens.erase(tokens.begin() + first, tokens.begin() + resume);
+  tokens.insert(tokens.begin() + first, relexed.begin(), relexed.end());
+
+  return unchanged;
+}
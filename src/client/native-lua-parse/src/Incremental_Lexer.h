@@ -0,0 +1,40 @@
+#pragma once
+#include "Lexer_DFA.h"
+#include "Piece_Table.h"
+#include <memory>
+#include <vector>
+
+// Lexes the whole stream (whitespace and comments are kept, see RemoveWhitespaceAndComments)
+void ParseStream(const char *stream, Lexer::DfaState* root, std::vector<Token> &tokens);
+
+// Lexes a whole document straight out of its pieces, dropping whitespace and comments
+void LexTokens(Lexer::DfaState* root, PieceTable &text, std::vector<Token> &tokens);
+
+// The same tokens as ParseStream and LexTokens, lexed on several threads for very large documents (one per
+// core with threads = 0). The text is cut after newlines and every part is lexed as if a token started there.
+// Parts that really start inside a long string or comment are put right while joining them.
+void ParseStreamParallel(const char *stream, Lexer::DfaState* root, std::vector<Token> &tokens, unsigned threads = 0);
+void LexTokensParallel(Lexer::DfaState* root, PieceTable &text, std::vector<Token> &tokens, unsigned threads = 0);
+
+// Updates tokens (from LexTokens, before 'change' was made to text) so they match the text again, only
+// re-lexing the part of the document the change could have affected. Tokens after it are moved along.
+// Returns true if the significant tokens came out identical (type, text and position), meaning only
+// whitespace or comments were edited and any tree built from the old tokens is still valid.
+bool RelexTokens(Lexer::DfaState* root, PieceTable &text, const TextChange &change, std::vector<Token> &tokens);
+
+struct TokenReader;
+
+// The significant tokens of a document one at a time, each one lexed when it's asked for. Lets a document be
+// parsed without ever holding its whole token list (see RecognizeStream).
+class TokenStream
+{
+public:
+  TokenStream(Lexer::DfaState *root, PieceTable &text);
+  ~TokenStream();
+
+  // Returns false once the end of the document is reached
+  bool Next(Token &token);
+
+private:
+  std::unique_ptr<TokenReader> reader;
+};
@@ -159,6 +159,7 @@ namespace Lexer
     DfaState *lastAcceptedState = nullptr;
     DfaState *currentState = startingState;
     unsigned lastCharNumber = charNumber;
+    const char *furthest = stream;
 
     while (currentState != nullptr && *stream != 0)
     {
@@ -198,6 +199,9 @@ namespace Lexer
         }
       }
 
+      if (stream > furthest)
+        furthest = stream;
+
       if (currentState && currentState->acceptingToken != 0)
       {
         lastAcceptedPosition = stream;
@@ -219,17 +223,19 @@ namespace Lexer
       }
     }
 
+    outToken.ScanLength = (unsigned)(furthest - begin) + 1;
+
     if (lastAcceptedState != nullptr)
     {
       outToken.Text = begin;
-      outToken.Length = lastAcceptedPosition - begin;
+      outToken.Length = (unsigned)(lastAcceptedPosition - begin);
       outToken.TokenType = lastAcceptedState->acceptingToken;
       outToken.Position = DocumentPosition(lineNumber, charNumber - 1);
     }
     else
     {
       outToken.Text = begin;
-      outToken.Length = stream - begin;
+      outToken.Length = (unsigned)(stream - begin);
       outToken.TokenType = 0;
       outToken.Position = DocumentPosition(lineNumber, charNumber - 1);
     }
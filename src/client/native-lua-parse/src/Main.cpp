@@ -1,4 +1,5 @@
 #include "Lexer_DFA.h"
+#include "Incremental_Lexer.h"
 #include "Descent_Parser.h"
 #include "TypeSystem.h"
 #include "AutoComplete.h"
@@ -86,36 +87,6 @@ void Lexer_RunTest(int part, int test, Lexer::DfaState* root, const char *filena
   my_log("*******************************************\n\n");
 }
 
-void ParseStream(const char *stream, Lexer::DfaState* root, std::vector<Token> &tokens)
-{
-  unsigned lineNumber = 0;
-  unsigned charNumber = 0;
-  while (*stream != '\0')
-  {
-    Token token;
-    Lexer::ReadToken(root, stream, token, lineNumber, charNumber);
-    stream += token.Length;
-
-    if (token.Length != 0)
-      tokens.push_back(token);
-  }
-
-  //Correct line numbers, then remove them
-  //std::vector<int> line_indecies;
-  //int line_num = 1;
-  //
-  //for (int i = 0; i < tokens.size(); ++i)
-  //{
-  //  tokens[i].Line = line_num;
-  //  if (tokens[i].EnumTokenType == Token::Type::Newline)
-  //  {
-  //    tokens.erase(tokens.begin() + i);
-  //    --i;
-  //    line_num++;
-  //  }
-  //}
-}
-
 void Parser_RunTest(int part, int test, Lexer::DfaState* root, const char *filename, bool throwException)
 {
   //Read in file
@@ -230,7 +201,7 @@ void Autocomplete_RunTest(int part, int test, Lexer::DfaState* root, const char
   PrintTypes(ast.get());
 
   std::vector<AutoCompleteEntry> entries;
-  ResolveAutocomplete(ast.get(), lineNumber, charNumber, entries, lib, tokens);
+  ResolveAutocomplete(ast.get(), lineNumber, charNumber, "", entries, lib, tokens);
 
   my_log("\n");
   my_log("Found Entries:\n");
@@ -317,7 +288,7 @@ void AutocompleteMultiFile_RunTest(int part, int test, Lexer::DfaState* root, st
   if (it != Documents.end())
   {
     std::vector<AutoCompleteEntry> entries;
-    ResolveAutocomplete(it->second->ast.get(), lineNumber, charNumber, entries, masterLibrary, it->second->tokens);
+    ResolveAutocomplete(it->second->ast.get(), lineNumber, charNumber, "", entries, masterLibrary, it->second->tokens);
 
     my_log("\n");
     my_log("Found Entries:\n");
@@ -427,7 +398,7 @@ void ReferenceCount_RunTest(int part, int test, Lexer::DfaState* root, bool thro
     if (it != Documents.end())
     {
       std::vector<AutoCompleteEntry> entries;
-      ResolveAutocomplete(it->second->ast.get(), lineNumber, charNumber, entries, masterLibrary, it->second->tokens);
+      ResolveAutocomplete(it->second->ast.get(), lineNumber, charNumber, "", entries, masterLibrary, it->second->tokens);
 
       //my_log("\n");
       //my_log("Found Entries:\n");
@@ -1,13 +1,16 @@
 #include <node.h>
 
-#include "Lexer_DFA.h"
-#include "Descent_Parser.h"
-#include "TypeSystem.h"
-#include "AutoComplete.h"
+#include "Document.h"
 #include "Minidump.h"
+#include "Session_Recorder.h"
+#include "Phase_Stats.h"
+#include "Tracing.h"
 
 #include <memory>
 #include <string>
+#include <algorithm>
+#include <cstring>
+#include <cstdint>
 #include <fstream>
 #include <future>
 #include <thread>
@@ -59,24 +62,7 @@ const char* Escape(char c)
   }
 }
 
-void ParseStream(const char *stream, Lexer::DfaState* root, std::vector<Token> &tokens)
-{
-  unsigned lineNumber = 0;
-  unsigned charNumber = 0;
-  while (*stream != '\0')
-  {
-    Token token;
-    Lexer::ReadToken(root, stream, token, lineNumber, charNumber);
-    stream += token.Length;
-
-    if (token.Length != 0)
-      tokens.push_back(token);
-  }
-}
-
 namespace demo {
-  Lexer::DfaState *lexer;
-  Library *masterLibrary;
 
 #ifdef _WIN32
   Windows::LONG my_handler(Windows::EXCEPTION_POINTERS *ptr)
@@ -89,134 +75,132 @@ namespace demo {
 
   using namespace v8;
 
-  struct Document
+  //Copies a JS string straight into a std::string, this is the only copy of the text an update makes
+  std::string ToUtf8(Local<Value> value)
   {
-    std::string text;
-    std::vector<Token> tokens;
-    std::unique_ptr<AbstractNode> ast;
-    std::vector<ParsingException> lastErrors;
-    LibraryReference libRefs;
+    Local<String> source = value->ToString();
+    std::string result;
 
-    void Parse(std::string documentText)
+    //Most files are plain ASCII, which V8 can hand over without encoding anything
+    if (source->IsOneByte())
     {
-      text = documentText;
-      ParseStream(text.c_str(), lexer, tokens);
+      result.resize(source->Length());
+      source->WriteOneByte((uint8_t *)&result[0], 0, (int)result.size(), String::NO_NULL_TERMINATION);
 
-      RemoveWhitespaceAndComments(tokens);
-      ast = std::move(RecognizeTokens(tokens, &lastErrors, false));
-
-      if (lastErrors.size() > 0)
-      {
-        my_log("Parsing Failed!\n");
-        for (auto && e : lastErrors)
-        {
-          my_log("Error (%s:%d: %s)\n", "Test", e.position.Line, e.what());
-        }
-      }
-      else
-        my_log("Parsing Successful\n");
+      unsigned char bits = 0;
+      for (char c : result)
+        bits |= (unsigned char)c;
 
-      ResolveTypes(ast.get(), masterLibrary, &libRefs);
+      if (bits < 0x80)
+        return result;
     }
-  };
-
-  std::unordered_map<std::string, std::unique_ptr<Document>> Documents;
-
-
-  void ParseDocument(std::string uri, std::string text) {
-    std::unique_ptr<Document> doc = std::make_unique<Document>();
 
-    auto it = Documents.find(uri);
-    if (it != Documents.end())
-    {
-      it->second = std::move(doc);
-      it->second->Parse(text);
-    }
-    else
-    {
-      doc->Parse(text);
-      Documents.insert(std::make_pair(uri, std::move(doc)));
-    }
-  }
-
-  void AutoComplete(std::string uri, unsigned lineNumber, unsigned charNumber, std::vector<AutoCompleteEntry> &entries) {
-    auto it = Documents.find(uri);
-    if (it != Documents.end())
-    {
-      Document &doc = *it->second;
-
-      my_log("**************       AUTOCOMPLETE      **************\n");
-      ResolveAutocomplete(doc.ast.get(), lineNumber, charNumber, entries, masterLibrary, doc.tokens);
-    }
+    result.resize(source->Utf8Length());
+    source->WriteUtf8(&result[0], (int)result.size(), nullptr, String::NO_NULL_TERMINATION);
+    return result;
   }
 
+  //AutoComplete(uri, line, character, maxEntries?, prefix?)
+  //Only entries the prefix fuzzy matches come back, without one it's the identifier in front of the cursor.
+  //They're ranked and only the best maxEntries (all if 0) are kept, packed into a single ArrayBuffer:
+  //  uint32 count, uint32 total, uint32 labelEnds[count], uint32 kinds[count], then the UTF-8 labels back to back
+  //where total is how many entries matched before they were cut down to count.
   void WatchFunction_AutoComplete(const FunctionCallbackInfo<Value> &args)
   {
+    ScopedTrace trace("AutoComplete", "binding");
     internal_parse_stdout = "";
 
     Isolate* isolate = args.GetIsolate();
-    String::Utf8Value uriValue(args[0]);
+    std::string uri = ToUtf8(args[0]);
 
     unsigned lineNumber = args[1]->ToUint32()->Int32Value();
     unsigned charNumber = args[2]->ToUint32()->Int32Value();
+    unsigned maxEntries = args.Length() > 3 ? args[3]->Uint32Value() : 0;
+    bool hasPrefix = args.Length() > 4 && args[4]->IsString();
+    std::string prefix = hasPrefix ? ToUtf8(args[4]) : std::string();
+
+    RecordAutoComplete(uri, lineNumber, charNumber, maxEntries, hasPrefix ? &prefix : nullptr);
+
+    if (!hasPrefix)
+      prefix = CompletionPrefix(uri, lineNumber, charNumber);
 
-    std::string uri(*uriValue);
     std::vector<AutoCompleteEntry> entries;
 
 #ifdef _WIN32
     __try {
 #endif
-        AutoComplete(uri, lineNumber, charNumber, entries);
+        AutoComplete(uri, lineNumber, charNumber, prefix, maxEntries, entries);
 
 #ifdef _WIN32
       }
       __except (my_handler((struct Windows::_EXCEPTION_POINTERS*)Windows::_exception_info())) {}
 #endif
 
-	  // We will be creating temporary handles so we use a handle scope.
-	  v8::HandleScope handle_scope(isolate);
+    // We will be creating temporary handles so we use a handle scope.
+    v8::HandleScope handle_scope(isolate);
+
+    size_t count = entries.size();
+    if (maxEntries != 0 && count > maxEntries)
+      count = maxEntries;
 
-	  // Create a new empty array.
-	  v8::Handle<v8::Array> array = v8::Array::New(isolate, entries.size());
-	  unsigned currentIndex = 0;
+    size_t labelBytes = 0;
+    for (size_t i = 0; i < count; ++i)
+      labelBytes += entries[i].name.size();
 
-	  my_log("\n");
-	  my_log("Found Entries (%i):\n", entries.size());
-	  for (auto &&entry : entries)
-	  {
-		my_log("  %s\n", entry.name.c_str());
+    const size_t headerBytes = sizeof(uint32_t) * (2 + 2 * count);
+    Local<ArrayBuffer> buffer = ArrayBuffer::New(isolate, headerBytes + labelBytes);
+    char *data = (char *)buffer->GetContents().Data();
 
-		Local<Object> js_entry = Object::New(isolate);
-		js_entry->Set(String::NewFromUtf8(isolate, "label"), String::NewFromUtf8(isolate, entry.name.c_str()));
-		js_entry->Set(String::NewFromUtf8(isolate, "data"), v8::Number::New(isolate, currentIndex));
-		js_entry->Set(String::NewFromUtf8(isolate, "kind"), v8::Uint32::New(isolate, (unsigned)entry.entryKind));
-		array->Set(currentIndex, js_entry);
-		currentIndex++;
-	  }
-	  //my_log("\n");
+    uint32_t *header = (uint32_t *)data;
+    uint32_t *labelEnds = header + 2;
+    uint32_t *kinds = labelEnds + count;
+    char *labels = data + headerBytes;
 
-	  my_log("*******************************************\n\n");
+    header[0] = (uint32_t)count;
+    header[1] = (uint32_t)entries.size();
 
-	  Local<Object> obj = Object::New(isolate);
-	  obj->Set(String::NewFromUtf8(isolate, "completion_items"), array);
-	  obj->Set(String::NewFromUtf8(isolate, "output"), String::NewFromUtf8(isolate, internal_parse_stdout.c_str()));
-	  args.GetReturnValue().Set(obj);
+    uint32_t labelEnd = 0;
+    for (size_t i = 0; i < count; ++i)
+    {
+      const AutoCompleteEntry &entry = entries[i];
+      std::memcpy(labels + labelEnd, entry.name.data(), entry.name.size());
+      labelEnd += (uint32_t)entry.name.size();
+
+      labelEnds[i] = labelEnd;
+      kinds[i] = (uint32_t)entry.entryKind;
+    }
+
+    Local<Object> obj = Object::New(isolate);
+    obj->Set(String::NewFromUtf8(isolate, "completions"), buffer);
+
+#ifdef AUTOCOMPLETE_DEBUG
+    my_log("\n");
+    my_log("Found Entries (%i):\n", entries.size());
+    for (auto &&entry : entries)
+      my_log("  %s\n", entry.name.c_str());
+    my_log("*******************************************\n\n");
+
+    obj->Set(String::NewFromUtf8(isolate, "output"), String::NewFromUtf8(isolate, internal_parse_stdout.c_str()));
+#endif
 
+    args.GetReturnValue().Set(obj);
   }
 
   void WatchFunction_ParseDocument(const FunctionCallbackInfo<Value> &args)
   {
+    ScopedTrace trace("ParseDocument", "binding");
     internal_parse_stdout = "";
 
-    String::Utf8Value uriValue(args[0]);
-    String::Utf8Value documentText(args[1]);
-    std::string uri(*uriValue);
-    std::string text(*documentText);
+    std::string uri = ToUtf8(args[0]);
+    std::string text = ToUtf8(args[1]);
+    int version = args.Length() > 2 ? args[2]->Int32Value() : -1;
+
+    RecordParseDocument(uri, text, version);
 
 #ifdef _WIN32
       __try {
 #endif
-        ParseDocument(uri, text);
+        ParseDocument(std::move(uri), std::move(text), version);
 
 #ifdef _WIN32
       }
@@ -225,9 +209,215 @@ namespace demo {
  
   }
 
+  //Takes [{uri, text}, ...] and returns [{uri, errors, ms}, ...], so indexing a workspace is one call instead of one per file
+  void WatchFunction_ParseDocuments(const FunctionCallbackInfo<Value> &args)
+  {
+    ScopedTrace trace("ParseDocuments", "binding");
+    internal_parse_stdout = "";
+
+    Isolate* isolate = args.GetIsolate();
+    Local<String> uriKey = String::NewFromUtf8(isolate, "uri");
+    Local<String> textKey = String::NewFromUtf8(isolate, "text");
+
+    Local<Array> files = Local<Array>::Cast(args[0]);
+    std::vector<DocumentSource> sources(files->Length());
+    for (unsigned i = 0; i < sources.size(); ++i)
+    {
+      Local<Object> file = files->Get(i)->ToObject();
+      sources[i].uri = ToUtf8(file->Get(uriKey));
+      sources[i].text = ToUtf8(file->Get(textKey));
+    }
+
+    RecordParseDocuments(sources);
+
+    std::vector<ParseResult> results;
+
+#ifdef _WIN32
+    __try {
+#endif
+      ParseDocuments(std::move(sources), results);
+
+#ifdef _WIN32
+    }
+    __except (my_handler((struct Windows::_EXCEPTION_POINTERS*)Windows::_exception_info())) {}
+#endif
+
+    //Nobody reads the log of a whole workspace, don't keep it around
+    internal_parse_stdout = "";
+
+    Local<String> errorsKey = String::NewFromUtf8(isolate, "errors");
+    Local<String> msKey = String::NewFromUtf8(isolate, "ms");
+
+    Local<Array> array = Array::New(isolate, results.size());
+    for (unsigned i = 0; i < results.size(); ++i)
+    {
+      Local<Object> result = Object::New(isolate);
+      result->Set(uriKey, files->Get(i)->ToObject()->Get(uriKey));
+      result->Set(errorsKey, Uint32::New(isolate, results[i].errors));
+      result->Set(msKey, Number::New(isolate, results[i].milliseconds));
+      array->Set(i, result);
+    }
+
+    args.GetReturnValue().Set(array);
+  }
+
+  void WatchFunction_ApplyEdits(const FunctionCallbackInfo<Value> &args)
+  {
+    ScopedTrace trace("ApplyEdits", "binding");
+    internal_parse_stdout = "";
+
+    Isolate* isolate = args.GetIsolate();
+    std::string uri = ToUtf8(args[0]);
+    int version = args[1]->ToUint32()->Int32Value();
+
+    Local<String> rangeKey = String::NewFromUtf8(isolate, "range");
+    Local<String> startKey = String::NewFromUtf8(isolate, "start");
+    Local<String> endKey = String::NewFromUtf8(isolate, "end");
+    Local<String> lineKey = String::NewFromUtf8(isolate, "line");
+    Local<String> characterKey = String::NewFromUtf8(isolate, "character");
+    Local<String> textKey = String::NewFromUtf8(isolate, "text");
+
+    Local<Array> changes = Local<Array>::Cast(args[2]);
+    std::vector<TextEdit> edits(changes->Length());
+    for (unsigned i = 0; i < edits.size(); ++i)
+    {
+      Local<Object> change = changes->Get(i)->ToObject();
+      TextEdit &edit = edits[i];
+
+      Local<Value> range = change->Get(rangeKey);
+      if (range->IsObject())
+      {
+        Local<Object> start = range->ToObject()->Get(startKey)->ToObject();
+        Local<Object> end = range->ToObject()->Get(endKey)->ToObject();
+
+        edit.hasRange = true;
+        edit.start = DocumentPosition(start->Get(lineKey)->Uint32Value(), start->Get(characterKey)->Uint32Value());
+        edit.end = DocumentPosition(end->Get(lineKey)->Uint32Value(), end->Get(characterKey)->Uint32Value());
+      }
+
+      edit.text = ToUtf8(change->Get(textKey));
+    }
+
+    RecordApplyEdits(uri, version, edits);
+
+    bool applied = false;
+
+#ifdef _WIN32
+    __try {
+#endif
+      applied = ApplyEdits(uri, version, edits);
+
+#ifdef _WIN32
+    }
+    __except (my_handler((struct Windows::_EXCEPTION_POINTERS*)Windows::_exception_info())) {}
+#endif
+
+    args.GetReturnValue().Set(Boolean::New(isolate, applied));
+  }
+
+  //StartRecording(path), every call after this one is written to path until StopRecording() (see Session_Recorder.h)
+  void WatchFunction_StartRecording(const FunctionCallbackInfo<Value> &args)
+  {
+    Isolate* isolate = args.GetIsolate();
+    bool started = StartRecording(ToUtf8(args[0]));
+    args.GetReturnValue().Set(Boolean::New(isolate, started));
+  }
+
+  void WatchFunction_StopRecording(const FunctionCallbackInfo<Value> &args)
+  {
+    StopRecording();
+  }
+
+  //GetStats() returns { phase: { calls, totalMs, maxMs, histogram }, ... } for every phase (see Phase_Stats.h),
+  //counted since the module was loaded or ResetStats() was last called
+  void WatchFunction_GetStats(const FunctionCallbackInfo<Value> &args)
+  {
+    Isolate* isolate = args.GetIsolate();
+    Local<String> callsKey = String::NewFromUtf8(isolate, "calls");
+    Local<String> totalKey = String::NewFromUtf8(isolate, "totalMs");
+    Local<String> maxKey = String::NewFromUtf8(isolate, "maxMs");
+    Local<String> histogramKey = String::NewFromUtf8(isolate, "histogram");
+
+    Local<Object> obj = Object::New(isolate);
+    for (size_t i = 0; i < (size_t)Phase::Count; ++i)
+    {
+      const PhaseStats &stats = GetPhaseStats((Phase)i);
+
+      Local<Array> histogram = Array::New(isolate, PhaseHistogramBuckets);
+      for (unsigned bucket = 0; bucket < PhaseHistogramBuckets; ++bucket)
+        histogram->Set(bucket, Uint32::New(isolate, stats.histogram[bucket]));
+
+      Local<Object> phase = Object::New(isolate);
+      phase->Set(callsKey, Number::New(isolate, (double)stats.calls));
+      phase->Set(totalKey, Number::New(isolate, stats.totalMilliseconds));
+      phase->Set(maxKey, Number::New(isolate, stats.maxMilliseconds));
+      phase->Set(histogramKey, histogram);
+      obj->Set(String::NewFromUtf8(isolate, PhaseName((Phase)i)), phase);
+    }
+
+    args.GetReturnValue().Set(obj);
+  }
+
+  void WatchFunction_ResetStats(const FunctionCallbackInfo<Value> &args)
+  {
+    ResetPhaseStats();
+  }
+
+  //GetMemoryStats() returns { enabled, liveBytes, documents: { uri: { text, tokens, tree, errors, symbols, usage, total } } }
+  //in bytes (see Memory_Accounting.h), everything is 0 unless the module was built with MEMORY_ACCOUNTING
+  void WatchFunction_GetMemoryStats(const FunctionCallbackInfo<Value> &args)
+  {
+    Isolate* isolate = args.GetIsolate();
+    Local<String> totalKey = String::NewFromUtf8(isolate, "total");
+
+    Local<Object> documents = Object::New(isolate);
+    for (auto &pair : DocumentMemories)
+    {
+      DocumentMemory &memory = *pair.second;
+
+      Local<Object> document = Object::New(isolate);
+      for (size_t i = 0; i < (size_t)MemoryCategory::Count; ++i)
+      {
+        double bytes = (double)memory.categories[i].bytes.load();
+        document->Set(String::NewFromUtf8(isolate, MemoryCategoryName((MemoryCategory)i)), Number::New(isolate, bytes));
+      }
+      document->Set(totalKey, Number::New(isolate, (double)memory.Total()));
+
+      documents->Set(String::NewFromUtf8(isolate, pair.first.c_str()), document);
+    }
+
+    Local<Object> obj = Object::New(isolate);
+    obj->Set(String::NewFromUtf8(isolate, "enabled"), Boolean::New(isolate, MemoryAccountingEnabled()));
+    obj->Set(String::NewFromUtf8(isolate, "liveBytes"), Number::New(isolate, (double)LiveBytes()));
+    obj->Set(String::NewFromUtf8(isolate, "documents"), documents);
+    args.GetReturnValue().Set(obj);
+  }
+
+  //SetDeferFunctionBodies(enabled), documents parsed afterwards leave function bodies until a completion lands in
+  //them. Opening is faster, but what those functions return and the globals they assign aren't known until then
+  //(see deferFunctionBodies in Document.h).
+  void WatchFunction_SetDeferFunctionBodies(const FunctionCallbackInfo<Value> &args)
+  {
+    deferFunctionBodies = args[0]->BooleanValue();
+  }
+
+  //StartTracing(path), spans are kept until StopTracing() writes them to path as Chrome trace events (see Tracing.h)
+  void WatchFunction_StartTracing(const FunctionCallbackInfo<Value> &args)
+  {
+    Isolate* isolate = args.GetIsolate();
+    bool started = StartTracing(ToUtf8(args[0]));
+    args.GetReturnValue().Set(Boolean::New(isolate, started));
+  }
+
+  void WatchFunction_StopTracing(const FunctionCallbackInfo<Value> &args)
+  {
+    Isolate* isolate = args.GetIsolate();
+    bool written = StopTracing();
+    args.GetReturnValue().Set(Boolean::New(isolate, written));
+  }
+
   void init(Local<Object> exports) {
-    lexer = Lexer::CreateLanguageDfa();
-    masterLibrary = CreateCoreLibrary();
+    Initialize();
 
 #ifdef _WIN32
     SetupMinidump();
@@ -235,6 +425,16 @@ namespace demo {
 
     NODE_SET_METHOD(exports, "AutoComplete", WatchFunction_AutoComplete);
     NODE_SET_METHOD(exports, "ParseDocument", WatchFunction_ParseDocument);
+    NODE_SET_METHOD(exports, "ParseDocuments", WatchFunction_ParseDocuments);
+    NODE_SET_METHOD(exports, "ApplyEdits", WatchFunction_ApplyEdits);
+    NODE_SET_METHOD(exports, "StartRecording", WatchFunction_StartRecording);
+    NODE_SET_METHOD(exports, "StopRecording", WatchFunction_StopRecording);
+    NODE_SET_METHOD(exports, "GetStats", WatchFunction_GetStats);
+    NODE_SET_METHOD(exports, "ResetStats", WatchFunction_ResetStats);
+    NODE_SET_METHOD(exports, "GetMemoryStats", WatchFunction_GetMemoryStats);
+    NODE_SET_METHOD(exports, "StartTracing", WatchFunction_StartTracing);
+    NODE_SET_METHOD(exports, "StopTracing", WatchFunction_StopTracing);
+    NODE_SET_METHOD(exports, "SetDeferFunctionBodies", WatchFunction_SetDeferFunctionBodies);
   }
 
   NODE_MODULE(addon, init)
@@ -0,0 +1,228 @@
+#include "Memory_Accounting.h"
+#include "Phase_Stats.h"
+
+#include <cstdlib>
+#include <new>
+
+static const char *CategoryNames[] = {
+  "text",
+  "tokens",
+  "tree",
+  "errors",
+  "symbols",
+  "usage",
+};
+
+static_assert(sizeof(CategoryNames) / sizeof(CategoryNames[0]) == (size_t)MemoryCategory::Count, "Every category needs a name");
+
+static const char *SiteNames[] = {
+  "other",
+  "tokenText",
+  "symbols",
+  "typeNames",
+};
+
+static_assert(sizeof(SiteNames) / sizeof(SiteNames[0]) == (size_t)AllocationSite::Count, "Every site needs a name");
+
+static std::atomic<int64_t> Live{ 0 };
+
+static AllocationCounts PhaseCounts[(size_t)Phase::Count + 1];
+static AllocationCounts SiteCounts[(size_t)AllocationSite::Count];
+
+int64_t DocumentMemory::Total() const
+{
+  int64_t total = 0;
+  for (const MemoryAccount &account : categories)
+    total += account.bytes.load(std::memory_order_relaxed);
+  return total;
+}
+
+const char *MemoryCategoryName(MemoryCategory category)
+{
+  return CategoryNames[(size_t)category];
+}
+
+bool MemoryAccountingEnabled()
+{
+#ifdef MEMORY_ACCOUNTING
+  return true;
+#else
+  return false;
+#endif
+}
+
+int64_t LiveBytes()
+{
+  return Live.load(std::memory_order_relaxed);
+}
+
+const char *AllocationSiteName(AllocationSite site)
+{
+  return SiteNames[(size_t)site];
+}
+
+const AllocationCounts &PhaseAllocations(size_t phase)
+{
+  return PhaseCounts[phase];
+}
+
+const AllocationCounts &SiteAllocations(AllocationSite site)
+{
+  return SiteCounts[(size_t)site];
+}
+
+void ResetAllocationCounts()
+{
+  for (AllocationCounts &counts : PhaseCounts)
+  {
+    counts.allocations = 0;
+    counts.frees = 0;
+    counts.bytes = 0;
+  }
+
+  for (AllocationCounts &counts : SiteCounts)
+  {
+    counts.allocations = 0;
+    counts.frees = 0;
+    counts.bytes = 0;
+  }
+}
+
+#ifdef MEMORY_ACCOUNTING
+
+//Sits in front of every allocation, padded so what follows keeps malloc's alignment
+struct AllocationHeader
+{
+  size_t size;
+  MemoryAccount *account;
+};
+
+static const size_t HeaderSize = 16;
+static_assert(sizeof(AllocationHeader) <= HeaderSize, "The header has to fit in front of the allocation");
+
+static thread_local MemoryAccount *CurrentAccount = nullptr;
+static thread_local size_t CurrentPhase = (size_t)Phase::Count;
+static thread_local AllocationSite CurrentSite = AllocationSite::Other;
+
+static void Charge(MemoryAccount *account, int64_t bytes, int64_t allocations)
+{
+  if (account != nullptr)
+  {
+    account->bytes.fetch_add(bytes, std::memory_order_relaxed);
+    account->allocations.fetch_add(allocations, std::memory_order_relaxed);
+  }
+}
+
+ScopedMemoryAccount::ScopedMemoryAccount(MemoryAccount *account) : previous(CurrentAccount)
+{
+  CurrentAccount = account;
+}
+
+ScopedMemoryAccount::~ScopedMemoryAccount()
+{
+  CurrentAccount = previous;
+}
+
+MemoryAccount *ActiveMemoryAccount()
+{
+  return CurrentAccount;
+}
+
+ScopedAllocationSite::ScopedAllocationSite(AllocationSite site) : previous(CurrentSite)
+{
+  CurrentSite = site;
+}
+
+ScopedAllocationSite::~ScopedAllocationSite()
+{
+  CurrentSite = previous;
+}
+
+size_t SetAllocationPhase(size_t phase)
+{
+  size_t previous = CurrentPhase;
+  CurrentPhase = phase;
+  return previous;
+}
+
+size_t ActiveAllocationPhase()
+{
+  return CurrentPhase;
+}
+
+static void CountAllocation(AllocationCounts &counts, size_t size)
+{
+  counts.allocations.fetch_add(1, std::memory_order_relaxed);
+  counts.bytes.fetch_add((int64_t)size, std::memory_order_relaxed);
+}
+
+void ChargeString(const std::string &text, MemoryAccount *account)
+{
+  //Short strings keep their text inside the string object, there's no allocation to move
+  const char *data = text.data();
+  const char *object = (const char *)&text;
+  if (data >= object && data < object + sizeof(std::string))
+    return;
+
+  AllocationHeader *header = (AllocationHeader *)(data - HeaderSize);
+  Charge(header->account, -(int64_t)header->size, -1);
+  Charge(account, (int64_t)header->size, 1);
+  header->account = account;
+}
+
+void *operator new(size_t size)
+{
+  char *block = (char *)std::malloc(size + HeaderSize);
+  if (block == nullptr)
+    throw std::bad_alloc();
+
+  AllocationHeader *header = (AllocationHeader *)block;
+  header->size = size;
+  header->account = CurrentAccount;
+
+  Live.fetch_add((int64_t)size, std::memory_order_relaxed);
+  Charge(CurrentAccount, (int64_t)size, 1);
+  CountAllocation(PhaseCounts[CurrentPhase], size);
+  CountAllocation(SiteCounts[(size_t)CurrentSite], size);
+  return block + HeaderSize;
+}
+
+void *operator new(size_t size, const std::nothrow_t &) noexcept
+{
+  try
+  {
+    return operator new(size);
+  }
+  catch (...)
+  {
+    return nullptr;
+  }
+}
+
+void operator delete(void *memory) noexcept
+{
+  if (memory == nullptr)
+    return;
+
+  char *block = (char *)memory - HeaderSize;
+  AllocationHeader *header = (AllocationHeader *)block;
+
+  Live.fetch_sub((int64_t)header->size, std::memory_order_relaxed);
+  Charge(header->account, -(int64_t)header->size, -1);
+  PhaseCounts[CurrentPhase].frees.fetch_add(1, std::memory_order_relaxed);
+  SiteCounts[(size_t)CurrentSite].frees.fetch_add(1, std::memory_order_relaxed);
+  std::free(block);
+}
+
+//Sized deletes are used for objects whose size is known, the header already has it
+void operator delete(void *memory, size_t) noexcept
+{
+  operator delete(memory);
+}
+
+void operator delete(void *memory, const std::nothrow_t &) noexcept
+{
+  operator delete(memory);
+}
+
+#endif
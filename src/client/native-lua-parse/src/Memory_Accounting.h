@@ -0,0 +1,125 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+// Byte accurate counts of what memory belongs to whom, done in a replacement global operator new/delete.
+// Every allocation remembers the account that was active when it was made and gives its bytes back to that
+// account when it's freed, wherever that happens.
+//
+// Only compiled in with MEMORY_ACCOUNTING defined. Without it the scopes do nothing and every count stays 0.
+// The replacement has to be the only operator new in the process (or in the DLL on Windows), which is why it
+// isn't turned on everywhere.
+
+// What a document's memory goes to
+enum class MemoryCategory
+{
+  Text,       //The piece table
+  Tokens,     //The token list, including token text stored for tokens spanning pieces
+  Tree,       //The ast
+  Errors,     //Parse errors
+  Symbols,    //What ResolveTypes made, symbols are charged to the document that created them
+  Usage,      //Identifier counts used for ranking
+  Count
+};
+
+class MemoryAccount
+{
+public:
+  std::atomic<int64_t> bytes{ 0 };
+  std::atomic<int64_t> allocations{ 0 };
+};
+
+struct DocumentMemory
+{
+  MemoryAccount categories[(size_t)MemoryCategory::Count];
+
+  MemoryAccount *Account(MemoryCategory category) { return &categories[(size_t)category]; }
+  int64_t Total() const;
+};
+
+const char *MemoryCategoryName(MemoryCategory category);
+bool MemoryAccountingEnabled();
+
+// Bytes allocated through operator new and not freed yet, whatever they were charged to
+int64_t LiveBytes();
+
+// How many allocations and frees were made (and bytes allocated) while something was running. Unlike accounts
+// these go by where new and delete are called, not by who the memory belongs to.
+struct AllocationCounts
+{
+  std::atomic<int64_t> allocations{ 0 };
+  std::atomic<int64_t> frees{ 0 };
+  std::atomic<int64_t> bytes{ 0 };
+};
+
+// Code known to allocate a lot, counted whichever phase it runs in
+enum class AllocationSite
+{
+  Other,
+  TokenText,    //Token::str()
+  Symbols,      //Creating symbols and types in the library
+  TypeNames,    //Building the names of multiple, possible and function types
+  Count
+};
+
+const char *AllocationSiteName(AllocationSite site);
+
+// Counts by phase (a Phase from Phase_Stats.h, Phase::Count is everything outside of one) and by site
+const AllocationCounts &PhaseAllocations(size_t phase);
+const AllocationCounts &SiteAllocations(AllocationSite site);
+void ResetAllocationCounts();
+
+#ifdef MEMORY_ACCOUNTING
+// Charges allocations made on this thread to account until it goes out of scope, the innermost scope wins
+class ScopedMemoryAccount
+{
+public:
+  explicit ScopedMemoryAccount(MemoryAccount *account);
+  ~ScopedMemoryAccount();
+
+private:
+  MemoryAccount *previous;
+};
+
+// The account allocations on this thread are charged to, to carry it over to threads doing part of the work
+MemoryAccount *ActiveMemoryAccount();
+
+// Moves the heap buffer of a string made somewhere else (like the text handed over by the binding) to account
+void ChargeString(const std::string &text, MemoryAccount *account);
+
+// Counts allocations made on this thread towards site until it goes out of scope
+class ScopedAllocationSite
+{
+public:
+  explicit ScopedAllocationSite(AllocationSite site);
+  ~ScopedAllocationSite();
+
+private:
+  AllocationSite previous;
+};
+
+// Used by ScopedPhase, returns the phase that was running before
+size_t SetAllocationPhase(size_t phase);
+
+// The phase allocations on this thread are counted towards, carried over to worker threads like the account
+size_t ActiveAllocationPhase();
+#else
+class ScopedMemoryAccount
+{
+public:
+  explicit ScopedMemoryAccount(MemoryAccount *account) {}
+};
+
+inline MemoryAccount *ActiveMemoryAccount() { return nullptr; }
+inline void ChargeString(const std::string &text, MemoryAccount *account) {}
+
+class ScopedAllocationSite
+{
+public:
+  explicit ScopedAllocationSite(AllocationSite site) {}
+};
+
+inline size_t SetAllocationPhase(size_t phase) { return phase; }
+inline size_t ActiveAllocationPhase() { return 0; }
+#endif
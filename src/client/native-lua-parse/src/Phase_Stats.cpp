@@ -0,0 +1,57 @@
+#include "Phase_Stats.h"
+#include "Tracing.h"
+
+static PhaseStats Stats[(size_t)Phase::Count];
+
+static const char *PhaseNames[] = {
+  "diff",
+  "lex",
+  "relex",
+  "parse",
+  "resolveTypes",
+  "release",
+  "clean",
+  "usage",
+  "resolveAutocomplete",
+  "rank",
+};
+
+static_assert(sizeof(PhaseNames) / sizeof(PhaseNames[0]) == (size_t)Phase::Count, "Every phase needs a name");
+
+const char *PhaseName(Phase phase)
+{
+  return PhaseNames[(size_t)phase];
+}
+
+const PhaseStats &GetPhaseStats(Phase phase)
+{
+  return Stats[(size_t)phase];
+}
+
+void ResetPhaseStats()
+{
+  for (PhaseStats &stats : Stats)
+    stats = PhaseStats();
+}
+
+void AddPhaseTime(Phase phase, std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end)
+{
+  if (TracingEnabled())
+    TraceSpan(PhaseName(phase), "phase", start, end);
+
+  PhaseStats &stats = Stats[(size_t)phase];
+  std::chrono::steady_clock::duration duration = end - start;
+
+  double milliseconds = std::chrono::duration<double, std::milli>(duration).count();
+  stats.calls += 1;
+  stats.totalMilliseconds += milliseconds;
+  if (milliseconds > stats.maxMilliseconds)
+    stats.maxMilliseconds = milliseconds;
+
+  uint64_t microseconds = (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(duration).count();
+  size_t bucket = 0;
+  for (; microseconds != 0 && bucket + 1 < PhaseHistogramBuckets; microseconds >>= 1)
+    ++bucket;
+
+  stats.histogram[bucket] += 1;
+}
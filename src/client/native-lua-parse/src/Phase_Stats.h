@@ -0,0 +1,63 @@
+#pragma once
+#include "Memory_Accounting.h"
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+// Time spent in each phase of updating a document and completing in it, so a slow request can be pinned on one of
+// them. Timing a phase is two reads of the monotonic clock.
+enum class Phase
+{
+  Diff,                 //Finding what changed in a full text that was sent over
+  Lex,                  //Lexing a whole document, whitespace and comments are dropped on the way
+  Relex,                //Re-lexing around a change
+  Parse,                //RecognizeTokens
+  ResolveTypes,         //ResolveTypesVisitor
+  Release,              //Letting go of a document's tree and symbols, Clean included
+  Clean,                //Library::Clean on its own
+  Usage,                //Counting identifiers for ranking
+  ResolveAutocomplete,
+  Rank,                 //RankAutocomplete
+  Count
+};
+
+// Durations go into power of two buckets of microseconds: bucket 0 is under 1us, bucket i is [2^(i-1), 2^i)us
+// and the last one takes everything longer
+const size_t PhaseHistogramBuckets = 24;
+
+struct PhaseStats
+{
+  uint64_t calls = 0;
+  double totalMilliseconds = 0;
+  double maxMilliseconds = 0;
+  uint32_t histogram[PhaseHistogramBuckets] = {};
+};
+
+const char *PhaseName(Phase phase);
+const PhaseStats &GetPhaseStats(Phase phase);
+void ResetPhaseStats();
+
+// Also shows up as a span while tracing (see Tracing.h)
+void AddPhaseTime(Phase phase, std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end);
+
+// Adds the time from construction to destruction to a phase, allocations made in the meantime are counted
+// towards it too (see Memory_Accounting.h)
+class ScopedPhase
+{
+public:
+  ScopedPhase(Phase phase)
+    : phase(phase), previousAllocationPhase(SetAllocationPhase((size_t)phase)), start(std::chrono::steady_clock::now())
+  {}
+
+  ~ScopedPhase()
+  {
+    AddPhaseTime(phase, start, std::chrono::steady_clock::now());
+    SetAllocationPhase(previousAllocationPhase);
+  }
+
+private:
+  Phase phase;
+  size_t previousAllocationPhase;
+  std::chrono::steady_clock::time_point start;
+};
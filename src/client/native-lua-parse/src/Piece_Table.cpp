@@ -0,0 +1,332 @@
+#include "Piece_Table.h"
+#include <algorithm>
+#include <cstring>
+#include <cstdint>
+#include <cstddef>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define PIECE_TABLE_SSE2
+#include <emmintrin.h>
+#endif
+
+//Appended text is packed into blocks of at least this size
+static const size_t AppendBlockSize = 64 * 1024;
+
+//Limits before NeedsCompacting asks for a fresh buffer
+static const size_t MaxPieces = 1024;
+static const size_t MaxAppendedBytes = 4 * 1024 * 1024;
+
+void TextChange::Add(size_t start, size_t end, size_t length)
+{
+  if (IsEmpty())
+  {
+    Start = start;
+    OldEnd = end;
+    NewEnd = start + length;
+    return;
+  }
+
+  //Anything past the current change maps back to the old text one to one
+  size_t currentEnd = std::max(NewEnd, end);
+  OldEnd += currentEnd - NewEnd;
+  NewEnd = currentEnd + length - (end - start);
+  Start = std::min(Start, start);
+}
+
+size_t CommonPrefixLength(const char *a, const char *b, size_t length)
+{
+  size_t i = 0;
+
+#ifdef PIECE_TABLE_SSE2
+  //Skip 16 equal bytes at a time
+  for (; i + 16 <= length; i += 16)
+  {
+    __m128i lhs = _mm_loadu_si128((const __m128i *)(a + i));
+    __m128i rhs = _mm_loadu_si128((const __m128i *)(b + i));
+    if (_mm_movemask_epi8(_mm_cmpeq_epi8(lhs, rhs)) != 0xFFFF)
+      break;
+  }
+#else
+  //Skip a word of equal bytes at a time
+  for (; i + sizeof(uint64_t) <= length; i += sizeof(uint64_t))
+  {
+    uint64_t lhs, rhs;
+    std::memcpy(&lhs, a + i, sizeof(lhs));
+    std::memcpy(&rhs, b + i, sizeof(rhs));
+    if (lhs != rhs)
+      break;
+  }
+#endif
+
+  //Find the exact byte that differs
+  while (i < length && a[i] == b[i])
+    ++i;
+
+  return i;
+}
+
+size_t CommonSuffixLength(const char *aEnd, const char *bEnd, size_t length)
+{
+  size_t i = 0;
+
+#ifdef PIECE_TABLE_SSE2
+  for (; i + 16 <= length; i += 16)
+  {
+    __m128i lhs = _mm_loadu_si128((const __m128i *)(aEnd - i - 16));
+    __m128i rhs = _mm_loadu_si128((const __m128i *)(bEnd - i - 16));
+    if (_mm_movemask_epi8(_mm_cmpeq_epi8(lhs, rhs)) != 0xFFFF)
+      break;
+  }
+#else
+  for (; i + sizeof(uint64_t) <= length; i += sizeof(uint64_t))
+  {
+    uint64_t lhs, rhs;
+    std::memcpy(&lhs, aEnd - i - sizeof(lhs), sizeof(lhs));
+    std::memcpy(&rhs, bEnd - i - sizeof(rhs), sizeof(rhs));
+    if (lhs != rhs)
+      break;
+  }
+#endif
+
+  while (i < length && *(aEnd - i - 1) == *(bEnd - i - 1))
+    ++i;
+
+  return i;
+}
+
+TextChange FindTextChange(const char *oldText, size_t oldLength, const char *newText, size_t newLength)
+{
+  size_t shortest = std::min(oldLength, newLength);
+  size_t prefix = CommonPrefixLength(oldText, newText, shortest);
+
+  //The suffix can't overlap the prefix, otherwise repeated text ("aa" -> "aaa") would be counted twice
+  size_t suffix = CommonSuffixLength(oldText + oldLength, newText + newLength, shortest - prefix);
+
+  TextChange change;
+  change.Start = prefix;
+  change.OldEnd = oldLength - suffix;
+  change.NewEnd = newLength - suffix;
+  return change;
+}
+
+void PieceTable::Reset(std::string text)
+{
+  buffers.clear();
+  pieces.clear();
+  lineStarts.assign(1, 0);
+
+  buffers.push_back(std::make_unique<std::string>(std::move(text)));
+  const std::string &original = *buffers.back();
+
+  size = original.size();
+  if (size != 0)
+    pieces.push_back({ original.data(), size });
+
+  for (size_t i = 0; i < size; ++i)
+  {
+    if (original[i] == '\n')
+      lineStarts.push_back(i + 1);
+  }
+}
+
+const char *PieceTable::Append(const char *text, size_t length)
+{
+  //Blocks are reserved up front and only ever appended to, so nothing written moves
+  if (buffers.size() < 2 || buffers.back()->capacity() - buffers.back()->size() < length)
+  {
+    buffers.push_back(std::make_unique<std::string>());
+    buffers.back()->reserve(std::max(AppendBlockSize, length));
+  }
+
+  std::string &block = *buffers.back();
+  size_t start = block.size();
+  block.append(text, length);
+  return block.data() + start;
+}
+
+const char *PieceTable::Store(const char *text, size_t length)
+{
+  return Append(text, length);
+}
+
+void PieceTable::Replace(size_t start, size_t end, const char *text, size_t length)
+{
+  end = std::min(end, size);
+  start = std::min(start, end);
+
+  Piece inserted = { length != 0 ? Append(text, length) : nullptr, length };
+
+  std::vector<Piece> result;
+  result.reserve(pieces.size() + 2);
+
+  //Typing appends to the same block, so a piece often continues right where the previous one stops
+  auto push = [&result](Piece piece)
+  {
+    if (piece.Length == 0)
+      return;
+
+    if (!result.empty() && result.back().Text + result.back().Length == piece.Text)
+      result.back().Length += piece.Length;
+    else
+      result.push_back(piece);
+  };
+
+  bool placed = false;
+  size_t offset = 0;
+  for (const Piece &piece : pieces)
+  {
+    size_t pieceStart = offset;
+    size_t pieceEnd = offset + piece.Length;
+    offset = pieceEnd;
+
+    //Part of the piece before the replaced range
+    if (pieceStart < start)
+      push({ piece.Text, std::min(pieceEnd, start) - pieceStart });
+
+    if (!placed && start <= pieceEnd)
+    {
+      push(inserted);
+      placed = true;
+    }
+
+    //Part of the piece after the replaced range
+    if (pieceEnd > end)
+    {
+      size_t from = std::max(pieceStart, end);
+      push({ piece.Text + (from - pieceStart), pieceEnd - from });
+    }
+  }
+
+  if (!placed)
+    push(inserted);
+
+  pieces.swap(result);
+  size = size - (end - start) + length;
+
+  //Line starts inside the replaced range go away, and the ones after it move
+  size_t first = std::upper_bound(lineStarts.begin(), lineStarts.end(), start) - lineStarts.begin();
+  size_t last = std::upper_bound(lineStarts.begin() + first, lineStarts.end(), end) - lineStarts.begin();
+
+  for (size_t i = last; i < lineStarts.size(); ++i)
+    lineStarts[i] = lineStarts[i] - (end - start) + length;
+
+  std::vector<size_t> added;
+  for (size_t i = 0; i < length; ++i)
+  {
+    if (text[i] == '\n')
+      added.push_back(start + i + 1);
+  }
+
+  lineStarts.erase(lineStarts.begin() + first, lineStarts.begin() + last);
+  lineStarts.insert(lineStarts.begin() + first, added.begin(), added.end());
+}
+
+TextChange PieceTable::Diff(const char *newText, size_t newLength) const
+{
+  size_t shortest = std::min(size, newLength);
+
+  //Common prefix, a piece at a time
+  size_t prefix = 0;
+  for (const Piece &piece : pieces)
+  {
+    size_t length = std::min(piece.Length, shortest - prefix);
+    size_t same = CommonPrefixLength(piece.Text, newText + prefix, length);
+    prefix += same;
+
+    if (same != piece.Length || prefix == shortest)
+      break;
+  }
+
+  //Common suffix, walking the pieces backwards
+  size_t suffix = 0;
+  size_t limit = shortest - prefix;
+  for (auto it = pieces.rbegin(); it != pieces.rend() && suffix < limit; ++it)
+  {
+    size_t length = std::min(it->Length, limit - suffix);
+    size_t same = CommonSuffixLength(it->Text + it->Length, newText + newLength - suffix, length);
+    suffix += same;
+
+    if (same != it->Length)
+      break;
+  }
+
+  TextChange change;
+  change.Start = prefix;
+  change.OldEnd = size - suffix;
+  change.NewEnd = newLength - suffix;
+  return change;
+}
+
+//Bytes in the UTF-8 sequence a lead byte starts, a stray continuation byte counts as one
+static size_t SequenceLength(unsigned char lead)
+{
+  if (lead >= 0xF0)
+    return 4;
+  if (lead >= 0xE0)
+    return 3;
+  if (lead >= 0xC0)
+    return 2;
+  return 1;
+}
+
+size_t PieceTable::Offset(unsigned line, unsigned character) const
+{
+  if (line >= lineStarts.size())
+    return size;
+
+  size_t offset = lineStarts[line];
+  size_t lineEnd = line + 1 < lineStarts.size() ? lineStarts[line + 1] - 1 : size;
+
+  //The piece the line starts in
+  size_t piece = 0;
+  size_t pieceStart = 0;
+  while (piece < pieces.size() && pieceStart + pieces[piece].Length <= offset)
+    pieceStart += pieces[piece++].Length;
+
+  auto byteAt = [&](size_t at) -> unsigned char
+  {
+    while (pieceStart + pieces[piece].Length <= at)
+      pieceStart += pieces[piece++].Length;
+    return (unsigned char)pieces[piece].Text[at - pieceStart];
+  };
+
+  //Walk the line one character at a time, counting the UTF-16 code units the editor counts. Past the end of
+  //the line clamps to the end of the line, before the \r of a \r\n.
+  unsigned units = 0;
+  while (offset < lineEnd)
+  {
+    unsigned char lead = byteAt(offset);
+    if (lead == '\r' && offset + 1 == lineEnd && lineEnd < size)
+      break;
+
+    //Characters outside the BMP are a surrogate pair, a position between the two stays before the character
+    unsigned width = lead >= 0xF0 ? 2 : 1;
+    if (units + width > character)
+      break;
+
+    units += width;
+    offset = std::min(offset + SequenceLength(lead), lineEnd);
+  }
+
+  return offset;
+}
+
+bool PieceTable::NeedsCompacting() const
+{
+  size_t appended = 0;
+  for (size_t i = 1; i < buffers.size(); ++i)
+    appended += buffers[i]->size();
+
+  return pieces.size() > MaxPieces || appended > std::max(MaxAppendedBytes, size);
+}
+
+std::string PieceTable::str() const
+{
+  std::string text;
+  text.reserve(size);
+
+  for (const Piece &piece : pieces)
+    text.append(piece.Text, piece.Length);
+
+  return text;
+}
@@ -0,0 +1,72 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <memory>
+
+// The byte range that differs between two versions of a document.
+// [Start, OldEnd) in the old text was replaced by [Start, NewEnd) in the new text.
+struct TextChange
+{
+  size_t Start = 0;
+  size_t OldEnd = 0;
+  size_t NewEnd = 0;
+
+  bool IsEmpty() const { return OldEnd == Start && NewEnd == Start; }
+
+  // Grows the change to also cover [start, end) of the new text being replaced by length bytes
+  void Add(size_t start, size_t end, size_t length);
+};
+
+// Number of leading bytes a and b have in common, looking at no more than length bytes
+size_t CommonPrefixLength(const char *a, const char *b, size_t length);
+
+// Number of trailing bytes the ranges ending at aEnd and bEnd have in common, looking at no more than length bytes
+size_t CommonSuffixLength(const char *aEnd, const char *bEnd, size_t length);
+
+// Finds the common prefix and suffix of both texts and returns the range between them
+TextChange FindTextChange(const char *oldText, size_t oldLength, const char *newText, size_t newLength);
+
+// Text of a document kept as a list of pieces pointing into buffers that are never changed once written.
+// Edits only touch the piece list, and tokens (and the ast built from them) can keep pointing into the
+// buffers until the table is Reset.
+class PieceTable
+{
+public:
+  struct Piece
+  {
+    const char *Text;
+    size_t Length;
+  };
+
+  // Replaces all of the text, taking over the string's buffer
+  void Reset(std::string text);
+
+  // Replaces the bytes [start, end) with text
+  void Replace(size_t start, size_t end, const char *text, size_t length);
+
+  // The change that turns this text into newText
+  TextChange Diff(const char *newText, size_t newLength) const;
+
+  // Byte offset of a line/character position. Characters are counted in UTF-16 code units, the way the editor
+  // sends them, so a line with anything but ASCII before the position is walked to find the byte.
+  size_t Offset(unsigned line, unsigned character) const;
+
+  // Copies bytes somewhere that stays valid until the next Reset (used for tokens that span pieces)
+  const char *Store(const char *text, size_t length);
+
+  // Past a point, reading lots of small pieces costs more than starting over from a single buffer
+  bool NeedsCompacting() const;
+
+  std::string str() const;
+  size_t Size() const { return size; }
+  const std::vector<Piece>& Pieces() const { return pieces; }
+
+private:
+  const char *Append(const char *text, size_t length);
+
+  // buffers[0] is the text given to Reset, the rest hold appended text
+  std::vector<std::unique_ptr<std::string>> buffers;
+  std::vector<Piece> pieces;
+  std::vector<size_t> lineStarts = { 0 };
+  size_t size = 0;
+};
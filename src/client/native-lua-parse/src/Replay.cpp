@@ -0,0 +1,190 @@
+// Replays a session recorded by the binding (see Session_Recorder.h) outside of node and reports how long each
+// kind of call took.
+//
+// g++ -std=c++14 -O2 -DNODE_PRINT -fno-delete-null-pointer-checks -o replay Replay.cpp Session_Recorder.cpp Document.cpp AST_Nodes.cpp AutoComplete.cpp Descent_Parser.cpp Lexer_DFA.cpp Incremental_Lexer.cpp Piece_Table.cpp Token.cpp TypeSystem.cpp FuzzyMatch.cpp Phase_Stats.cpp Memory_Accounting.cpp Tracing.cpp
+//
+// replay [--json] [--trace trace.json] [--defer-function-bodies] session.rec
+// Calls are made one after another as fast as they can go, the time between them in the recording is ignored.
+// The time every phase took over the whole replay is printed after the calls (see Phase_Stats.h).
+// --trace writes the replay as Chrome trace events (see Tracing.h).
+// --defer-function-bodies replays it the way the binding runs after SetDeferFunctionBodies(true).
+
+#include "Document.h"
+#include "Session_Recorder.h"
+#include "Phase_Stats.h"
+#include "Tracing.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+extern std::string internal_parse_stdout;
+
+static const char *CallNames[] = { "", "ParseDocument", "ParseDocuments", "ApplyEdits", "AutoComplete" };
+static const size_t CallKinds = sizeof(CallNames) / sizeof(CallNames[0]);
+
+//Nearest rank, times have to be sorted
+static double Percentile(const std::vector<double> &times, double percent)
+{
+  size_t rank = (size_t)(percent / 100 * times.size() + 0.5);
+  rank = std::min(std::max(rank, (size_t)1), times.size());
+  return times[rank - 1];
+}
+
+//Makes the call the binding would have made for it, returns how long it took in milliseconds
+static double Replay(demo::RecordedCall &call)
+{
+  ScopedTrace trace(CallNames[(size_t)call.kind], "binding");
+  auto start = std::chrono::high_resolution_clock::now();
+
+  switch (call.kind)
+  {
+  case demo::RecordedCallKind::ParseDocument:
+    demo::ParseDocument(call.uri, std::move(call.text), call.version);
+    break;
+
+  case demo::RecordedCallKind::ParseDocuments:
+  {
+    std::vector<demo::ParseResult> results;
+    demo::ParseDocuments(std::move(call.files), results);
+    break;
+  }
+
+  case demo::RecordedCallKind::ApplyEdits:
+    demo::ApplyEdits(call.uri, call.version, call.edits);
+    break;
+
+  case demo::RecordedCallKind::AutoComplete:
+  {
+    if (!call.hasPrefix)
+      call.prefix = demo::CompletionPrefix(call.uri, call.line, call.character);
+
+    std::vector<AutoCompleteEntry> entries;
+    demo::AutoComplete(call.uri, call.line, call.character, call.prefix, call.maxEntries, entries);
+    break;
+  }
+  }
+
+  auto end = std::chrono::high_resolution_clock::now();
+  internal_parse_stdout.clear();
+  return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+int main(int argc, char **argv)
+{
+  bool json = false;
+  const char *path = nullptr;
+  const char *tracePath = nullptr;
+  for (int i = 1; i < argc; ++i)
+  {
+    if (std::strcmp(argv[i], "--json") == 0)
+      json = true;
+    else if (std::strcmp(argv[i], "--trace") == 0 && i + 1 < argc)
+      tracePath = argv[++i];
+    else if (std::strcmp(argv[i], "--defer-function-bodies") == 0)
+      demo::deferFunctionBodies = true;
+    else
+      path = argv[i];
+  }
+
+  if (path == nullptr)
+  {
+    fprintf(stderr, "usage: replay [--json] [--trace trace.json] [--defer-function-bodies] session.rec\n");
+    return 1;
+  }
+
+  demo::SessionReader reader;
+  if (!reader.Open(path))
+  {
+    fprintf(stderr, "%s\n", reader.error.c_str());
+    return 1;
+  }
+
+  demo::Initialize();
+
+  if (tracePath != nullptr)
+    StartTracing(tracePath);
+
+  std::vector<double> times[CallKinds];
+  uint64_t recorded = 0;
+
+  demo::RecordedCall call;
+  while (reader.Next(call))
+  {
+    recorded = call.microseconds;
+    times[(size_t)call.kind].push_back(Replay(call));
+  }
+
+  if (tracePath != nullptr && !StopTracing())
+    fprintf(stderr, "Can't write %s\n", tracePath);
+
+  if (!reader.error.empty())
+  {
+    fprintf(stderr, "%s\n", reader.error.c_str());
+    return 1;
+  }
+
+  if (json)
+    printf("{\n  \"recorded_seconds\": %.3f,\n  \"calls\": [\n", recorded / 1e6);
+  else
+    printf("%-16s %8s %10s %10s %10s %10s %12s\n", "call", "count", "p50 ms", "p95 ms", "p99 ms", "max ms", "total ms");
+
+  bool first = true;
+  for (size_t kind = 1; kind < CallKinds; ++kind)
+  {
+    std::vector<double> &kindTimes = times[kind];
+    if (kindTimes.empty())
+      continue;
+
+    std::sort(kindTimes.begin(), kindTimes.end());
+    double total = 0;
+    for (double time : kindTimes)
+      total += time;
+
+    if (json)
+    {
+      printf("%s    { \"name\": \"%s\", \"count\": %zu, \"p50\": %.6g, \"p95\": %.6g, \"p99\": %.6g, \"max\": %.6g, \"total\": %.6g }",
+        first ? "" : ",\n", CallNames[kind], kindTimes.size(), Percentile(kindTimes, 50), Percentile(kindTimes, 95),
+        Percentile(kindTimes, 99), kindTimes.back(), total);
+    }
+    else
+    {
+      printf("%-16s %8zu %10.3f %10.3f %10.3f %10.3f %12.3f\n", CallNames[kind], kindTimes.size(), Percentile(kindTimes, 50),
+        Percentile(kindTimes, 95), Percentile(kindTimes, 99), kindTimes.back(), total);
+    }
+    first = false;
+  }
+
+  if (json)
+    printf("\n  ],\n  \"phases\": [\n");
+  else
+    printf("\n%-20s %8s %12s %10s\n", "phase", "count", "total ms", "max ms");
+
+  first = true;
+  for (size_t i = 0; i < (size_t)Phase::Count; ++i)
+  {
+    const PhaseStats &stats = GetPhaseStats((Phase)i);
+    if (stats.calls == 0)
+      continue;
+
+    if (json)
+    {
+      printf("%s    { \"name\": \"%s\", \"count\": %llu, \"total\": %.6g, \"max\": %.6g }", first ? "" : ",\n",
+        PhaseName((Phase)i), (unsigned long long)stats.calls, stats.totalMilliseconds, stats.maxMilliseconds);
+    }
+    else
+    {
+      printf("%-20s %8llu %12.3f %10.3f\n", PhaseName((Phase)i), (unsigned long long)stats.calls, stats.totalMilliseconds,
+        stats.maxMilliseconds);
+    }
+    first = false;
+  }
+
+  if (json)
+    printf("\n  ]\n}\n");
+
+  return 0;
+}
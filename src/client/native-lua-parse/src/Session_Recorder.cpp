@@ -0,0 +1,413 @@
+#include "Session_Recorder.h"
+#include "Piece_Table.h"
+
+#include <algorithm>
+#include <chrono>
+#include <memory>
+
+namespace demo
+{
+  static const char RecordingMagic[8] = { 'L', 'U', 'A', 'R', 'E', 'C', '0', '1' };
+
+  //FNV-1a
+  static uint64_t HashText(const std::string &text)
+  {
+    uint64_t hash = 14695981039346656037ull;
+    for (char c : text)
+    {
+      hash ^= (unsigned char)c;
+      hash *= 1099511628211ull;
+    }
+    return hash;
+  }
+
+  static uint32_t ZigZag(int value)
+  {
+    return ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+  }
+
+  static int UnZigZag(uint64_t value)
+  {
+    return (int)((uint32_t)(value >> 1) ^ (0u - (uint32_t)(value & 1)));
+  }
+
+  class SessionRecorder
+  {
+  public:
+    std::ofstream file;
+    std::chrono::steady_clock::time_point last;
+
+    std::string buffer;
+    std::unordered_map<std::string, uint64_t> uris;
+
+    //The last text recorded for every uri, what the next one gets stored as a change from
+    std::unordered_map<std::string, std::string> texts;
+
+    void Begin(RecordedCallKind kind)
+    {
+      auto now = std::chrono::steady_clock::now();
+      uint64_t elapsed = (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(now - last).count();
+      last = now;
+
+      buffer.clear();
+      buffer += (char)kind;
+      Varint(elapsed);
+    }
+
+    //Written out as a whole so a crash doesn't leave half a record behind
+    void End()
+    {
+      file.write(buffer.data(), buffer.size());
+      file.flush();
+    }
+
+    void Varint(uint64_t value)
+    {
+      while (value >= 0x80)
+      {
+        buffer += (char)(value | 0x80);
+        value >>= 7;
+      }
+      buffer += (char)value;
+    }
+
+    void String(const char *data, size_t length)
+    {
+      Varint(length);
+      buffer.append(data, length);
+    }
+
+    void String(const std::string &value)
+    {
+      String(value.data(), value.size());
+    }
+
+    void Uri(const std::string &uri)
+    {
+      auto it = uris.find(uri);
+      if (it != uris.end())
+      {
+        Varint(it->second);
+        return;
+      }
+
+      uint64_t index = uris.size();
+      uris.emplace(uri, index);
+      Varint(index);
+      String(uri);
+    }
+
+    void Text(const std::string &uri, const std::string &text)
+    {
+      std::string &previous = texts[uri];
+      TextChange change = FindTextChange(previous.data(), previous.size(), text.data(), text.size());
+
+      uint64_t hash = HashText(text);
+      for (int i = 0; i < 8; ++i)
+        buffer += (char)(hash >> (i * 8));
+
+      Varint(change.Start);
+      Varint(change.OldEnd);
+      String(text.data() + change.Start, change.NewEnd - change.Start);
+
+      previous = text;
+    }
+  };
+
+  static std::unique_ptr<SessionRecorder> recorder;
+
+  bool StartRecording(const std::string &path)
+  {
+    std::unique_ptr<SessionRecorder> started = std::make_unique<SessionRecorder>();
+    started->file.open(path, std::ios::binary | std::ios::trunc);
+    if (!started->file)
+      return false;
+
+    started->file.write(RecordingMagic, sizeof(RecordingMagic));
+    started->last = std::chrono::steady_clock::now();
+    recorder = std::move(started);
+    return true;
+  }
+
+  void StopRecording()
+  {
+    recorder = nullptr;
+  }
+
+  bool IsRecording()
+  {
+    return recorder != nullptr;
+  }
+
+  void RecordParseDocument(const std::string &uri, const std::string &text, int version)
+  {
+    if (recorder == nullptr)
+      return;
+
+    recorder->Begin(RecordedCallKind::ParseDocument);
+    recorder->Uri(uri);
+    recorder->Varint(ZigZag(version));
+    recorder->Text(uri, text);
+    recorder->End();
+  }
+
+  void RecordParseDocuments(const std::vector<DocumentSource> &files)
+  {
+    if (recorder == nullptr)
+      return;
+
+    recorder->Begin(RecordedCallKind::ParseDocuments);
+    recorder->Varint(files.size());
+    for (const DocumentSource &file : files)
+    {
+      recorder->Uri(file.uri);
+      recorder->Text(file.uri, file.text);
+    }
+    recorder->End();
+  }
+
+  void RecordApplyEdits(const std::string &uri, int version, const std::vector<TextEdit> &edits)
+  {
+    if (recorder == nullptr)
+      return;
+
+    recorder->Begin(RecordedCallKind::ApplyEdits);
+    recorder->Uri(uri);
+    recorder->Varint(ZigZag(version));
+    recorder->Varint(edits.size());
+    for (const TextEdit &edit : edits)
+    {
+      recorder->buffer += (char)edit.hasRange;
+      if (edit.hasRange)
+      {
+        recorder->Varint(edit.start.Line);
+        recorder->Varint(edit.start.Character);
+        recorder->Varint(edit.end.Line);
+        recorder->Varint(edit.end.Character);
+      }
+      recorder->String(edit.text);
+    }
+    recorder->End();
+
+    //Working out the edited text would take a piece table of its own, the next full text is stored whole instead
+    recorder->texts.erase(uri);
+  }
+
+  void RecordAutoComplete(const std::string &uri, unsigned line, unsigned character, unsigned maxEntries, const std::string *prefix)
+  {
+    if (recorder == nullptr)
+      return;
+
+    recorder->Begin(RecordedCallKind::AutoComplete);
+    recorder->Uri(uri);
+    recorder->Varint(line);
+    recorder->Varint(character);
+    recorder->Varint(maxEntries);
+    recorder->buffer += (char)(prefix != nullptr);
+    if (prefix != nullptr)
+      recorder->String(*prefix);
+    recorder->End();
+  }
+
+  bool SessionReader::Open(const std::string &path)
+  {
+    file.open(path, std::ios::binary);
+    if (!file)
+    {
+      error = "Can't open " + path;
+      return false;
+    }
+
+    char magic[sizeof(RecordingMagic)];
+    if (!file.read(magic, sizeof(magic)) || !std::equal(magic, magic + sizeof(magic), RecordingMagic))
+    {
+      error = path + " isn't a recording";
+      return false;
+    }
+
+    return true;
+  }
+
+  static bool ReadByte(std::ifstream &file, uint8_t &value)
+  {
+    char c;
+    if (!file.get(c))
+      return false;
+
+    value = (uint8_t)c;
+    return true;
+  }
+
+  static bool ReadVarint(std::ifstream &file, uint64_t &value)
+  {
+    value = 0;
+    for (unsigned shift = 0; shift < 64; shift += 7)
+    {
+      uint8_t byte;
+      if (!ReadByte(file, byte))
+        return false;
+
+      value |= (uint64_t)(byte & 0x7F) << shift;
+      if ((byte & 0x80) == 0)
+        return true;
+    }
+    return false;
+  }
+
+  static bool ReadUnsigned(std::ifstream &file, unsigned &value)
+  {
+    uint64_t read;
+    if (!ReadVarint(file, read))
+      return false;
+
+    value = (unsigned)read;
+    return true;
+  }
+
+  static bool ReadString(std::ifstream &file, std::string &value)
+  {
+    uint64_t length;
+    if (!ReadVarint(file, length))
+      return false;
+
+    value.resize((size_t)length);
+    return length == 0 || file.read(&value[0], (std::streamsize)length);
+  }
+
+  bool SessionReader::ReadUri(std::string &uri)
+  {
+    uint64_t index;
+    if (!ReadVarint(file, index))
+      return false;
+
+    if (index == uris.size())
+    {
+      if (!ReadString(file, uri))
+        return false;
+      uris.push_back(uri);
+      return true;
+    }
+
+    if (index > uris.size())
+    {
+      error = "Uri index out of range";
+      return false;
+    }
+
+    uri = uris[(size_t)index];
+    return true;
+  }
+
+  bool SessionReader::ReadText(const std::string &uri, std::string &text)
+  {
+    uint64_t hash = 0;
+    for (int i = 0; i < 8; ++i)
+    {
+      uint8_t byte;
+      if (!ReadByte(file, byte))
+        return false;
+      hash |= (uint64_t)byte << (i * 8);
+    }
+
+    uint64_t start, oldEnd;
+    std::string inserted;
+    if (!ReadVarint(file, start) || !ReadVarint(file, oldEnd) || !ReadString(file, inserted))
+      return false;
+
+    std::string &previous = texts[uri];
+    if (start > oldEnd || oldEnd > previous.size())
+    {
+      error = "Change out of range for " + uri;
+      return false;
+    }
+
+    previous.replace((size_t)start, (size_t)(oldEnd - start), inserted);
+    if (HashText(previous) != hash)
+    {
+      error = "Text of " + uri + " doesn't match what was recorded";
+      return false;
+    }
+
+    text = previous;
+    return true;
+  }
+
+  bool SessionReader::Next(RecordedCall &call)
+  {
+    uint8_t kind;
+    if (!ReadByte(file, kind))
+      return false;
+
+    call = RecordedCall();
+    call.kind = (RecordedCallKind)kind;
+
+    uint64_t elapsed;
+    if (!ReadVarint(file, elapsed))
+    {
+      error = "Recording is cut off";
+      return false;
+    }
+
+    microseconds += elapsed;
+    call.microseconds = microseconds;
+
+    bool read = false;
+    uint64_t value = 0, count = 0;
+    switch (call.kind)
+    {
+    case RecordedCallKind::ParseDocument:
+      read = ReadUri(call.uri) && ReadVarint(file, value) && ReadText(call.uri, call.text);
+      call.version = UnZigZag(value);
+      break;
+
+    case RecordedCallKind::ParseDocuments:
+      read = ReadVarint(file, count);
+      for (uint64_t i = 0; read && i < count; ++i)
+      {
+        call.files.emplace_back();
+        read = ReadUri(call.files.back().uri) && ReadText(call.files.back().uri, call.files.back().text);
+      }
+      break;
+
+    case RecordedCallKind::ApplyEdits:
+      read = ReadUri(call.uri) && ReadVarint(file, value) && ReadVarint(file, count);
+      call.version = UnZigZag(value);
+      for (uint64_t i = 0; read && i < count; ++i)
+      {
+        call.edits.emplace_back();
+        TextEdit &edit = call.edits.back();
+
+        uint8_t hasRange = 0;
+        read = ReadByte(file, hasRange);
+        edit.hasRange = hasRange != 0;
+        if (read && edit.hasRange)
+        {
+          read = ReadUnsigned(file, edit.start.Line) && ReadUnsigned(file, edit.start.Character) &&
+                 ReadUnsigned(file, edit.end.Line) && ReadUnsigned(file, edit.end.Character);
+        }
+        read = read && ReadString(file, edit.text);
+      }
+      texts.erase(call.uri);
+      break;
+
+    case RecordedCallKind::AutoComplete:
+    {
+      uint8_t hasPrefix = 0;
+      read = ReadUri(call.uri) && ReadUnsigned(file, call.line) && ReadUnsigned(file, call.character) &&
+             ReadUnsigned(file, call.maxEntries) && ReadByte(file, hasPrefix);
+      call.hasPrefix = hasPrefix != 0;
+      if (read && call.hasPrefix)
+        read = ReadString(file, call.prefix);
+      break;
+    }
+
+    default:
+      error = "Unknown record kind " + std::to_string(kind);
+      return false;
+    }
+
+    if (!read && error.empty())
+      error = "Recording is cut off";
+    return read;
+  }
+}
@@ -0,0 +1,101 @@
+#pragma once
+#include "Document.h"
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+// Records every call made into the binding to a file, so a slow editing session can be replayed later on
+// (see Replay.cpp). Texts are stored as the change from the last text recorded for the same uri, plus a hash
+// of the whole text to check the replayed one against.
+//
+// Every record is
+//   uint8 kind, varint microseconds since the previous record
+// followed by, for each kind
+//   ParseDocument:  uri, zigzag version, text
+//   ParseDocuments: varint count, then count times uri, text
+//   ApplyEdits:     uri, zigzag version, varint count, then count times uint8 hasRange, [4 varint range], string
+//   AutoComplete:   uri, varint line, varint character, varint maxEntries, uint8 hasPrefix, [string prefix]
+// where
+//   uri is a varint index into the uris seen so far, a new one is the next index followed by its string
+//   text is uint64 hash, varint start, varint old end, then the string replacing [start, old end)
+//   a string is its varint length and the bytes
+namespace demo
+{
+  enum class RecordedCallKind : uint8_t
+  {
+    ParseDocument = 1,
+    ParseDocuments,
+    ApplyEdits,
+    AutoComplete,
+  };
+
+  // One call read back from a recording, with the texts put back together
+  struct RecordedCall
+  {
+    RecordedCallKind kind;
+
+    //Since the recording started
+    uint64_t microseconds = 0;
+
+    //Every kind but ParseDocuments
+    std::string uri;
+
+    //ParseDocument and ApplyEdits
+    int version = -1;
+
+    //ParseDocument
+    std::string text;
+
+    //ParseDocuments
+    std::vector<DocumentSource> files;
+
+    //ApplyEdits
+    std::vector<TextEdit> edits;
+
+    //AutoComplete, without a prefix the binding took the identifier in front of the cursor
+    unsigned line = 0;
+    unsigned character = 0;
+    unsigned maxEntries = 0;
+    bool hasPrefix = false;
+    std::string prefix;
+  };
+
+  // Starts writing to path, replacing whatever was there. Returns false if it can't be opened.
+  bool StartRecording(const std::string &path);
+  void StopRecording();
+  bool IsRecording();
+
+  // Nothing happens unless a recording was started. Calls are recorded before they're made, so a session that
+  // crashes can still be replayed.
+  void RecordParseDocument(const std::string &uri, const std::string &text, int version);
+  void RecordParseDocuments(const std::vector<DocumentSource> &files);
+  void RecordApplyEdits(const std::string &uri, int version, const std::vector<TextEdit> &edits);
+  void RecordAutoComplete(const std::string &uri, unsigned line, unsigned character, unsigned maxEntries, const std::string *prefix);
+
+  // Reads a recording one call at a time
+  class SessionReader
+  {
+  public:
+    bool Open(const std::string &path);
+
+    // False at the end of the file, or if it's cut off or a text doesn't come out the way it was recorded
+    // (error says which)
+    bool Next(RecordedCall &call);
+
+    std::string error;
+
+  private:
+    bool ReadUri(std::string &uri);
+    bool ReadText(const std::string &uri, std::string &text);
+
+    std::ifstream file;
+    uint64_t microseconds = 0;
+    std::vector<std::string> uris;
+
+    //The last text of every uri, what the next one is a change from
+    std::unordered_map<std::string, std::string> texts;
+  };
+}
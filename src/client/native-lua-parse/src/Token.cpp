@@ -1,4 +1,5 @@
 #include "Token.h"
+#include "Memory_Accounting.h"
 #include <stdarg.h>
 #include <cstring>
 
@@ -11,11 +12,11 @@ const char* TokenNames[] =
 };
 
 Token::Token() 
-: Text(""), Length(0), TokenType(0)
+: Text(""), Length(0), Offset(0), ScanLength(0), TokenType(0)
 {}
 
 Token::Token(const char* text, size_t length, int type) 
-  : Text(text), Length(length), TokenType(type)
+  : Text(text), Length((unsigned)length), Offset(0), ScanLength(0), TokenType(type)
 {}
 
 std::ostream& operator<<(std::ostream& out, const Token& token)
@@ -29,6 +30,7 @@ std::string Token::str() const
   if (Text == nullptr || Length <= 0)
     return std::string();
 
+  ScopedAllocationSite site(AllocationSite::TokenText);
   return std::string(Text, Length);
 }
 
@@ -50,6 +52,8 @@ void my_log(const char* format, ...)
   vsnprintf(buffer, sizeof(buffer) - 1, format, argptr);
   va_end(argptr);
 
+  //The log belongs to nobody, don't let it count towards whatever is being parsed
+  ScopedMemoryAccount account(nullptr);
   internal_parse_stdout += std::string(buffer);
 }
 
@@ -36,9 +36,18 @@ public:
   Token();
   Token(const char* str, size_t length, int type);
   const char* Text;
-  size_t Length;
+  unsigned Length;
+
+  // Byte offset of the token within its document
+  unsigned Offset;
+
   DocumentPosition Position;
 
+  // How many bytes from Text the lexer had to look at to produce this token. ParseStream also folds in
+  // the bytes looked at for any whitespace/comments right before it, so incremental lexing knows what
+  // an edit can invalidate.
+  unsigned ScanLength;
+
   // A convenience function to get a sliced version of the string
   std::string str() const;
 
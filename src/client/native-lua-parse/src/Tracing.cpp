@@ -0,0 +1,156 @@
+#include "Tracing.h"
+#include "Memory_Accounting.h"
+
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+std::atomic<bool> TracingActive{ false };
+
+namespace
+{
+  struct TraceEvent
+  {
+    const char *name;
+    const char *category;
+    int64_t start;      //Nanoseconds since tracing started
+    int64_t duration;
+    int64_t line;
+  };
+
+  const size_t RingSize = 1 << 16;
+
+  //Only its own thread writes to a ring, 'written' is what the writer of the trace goes by
+  struct TraceRing
+  {
+    uint32_t thread;
+    std::atomic<uint64_t> written{ 0 };
+    TraceEvent events[RingSize];
+  };
+
+  std::mutex ringsLock;
+  std::vector<std::unique_ptr<TraceRing>> rings;
+
+  //Rings of threads that have exited. The lexer and parser start new threads for every large file, so the
+  //next thread takes one of these (spans and all) instead of adding a ring, and there are only ever as many
+  //rings as threads that ran at the same time.
+  std::vector<TraceRing *> freeRings;
+
+  std::string tracePath;
+  std::chrono::steady_clock::time_point traceStart;
+
+  //Gives the ring back when its thread exits
+  struct RingOwner
+  {
+    TraceRing *ring = nullptr;
+
+    ~RingOwner()
+    {
+      if (ring == nullptr)
+        return;
+
+      std::lock_guard<std::mutex> lock(ringsLock);
+      freeRings.push_back(ring);
+    }
+  };
+
+  thread_local RingOwner threadRing;
+
+  TraceRing *ThreadRing()
+  {
+    if (threadRing.ring != nullptr)
+      return threadRing.ring;
+
+    //Taken once per thread, not once per span
+    ScopedMemoryAccount account(nullptr);
+    std::lock_guard<std::mutex> lock(ringsLock);
+    if (!freeRings.empty())
+    {
+      threadRing.ring = freeRings.back();
+      freeRings.pop_back();
+      return threadRing.ring;
+    }
+
+    rings.push_back(std::make_unique<TraceRing>());
+    threadRing.ring = rings.back().get();
+    threadRing.ring->thread = (uint32_t)rings.size();
+    return threadRing.ring;
+  }
+}
+
+bool StartTracing(const std::string &path)
+{
+  if (TracingEnabled())
+    return false;
+
+  {
+    std::lock_guard<std::mutex> lock(ringsLock);
+    for (auto &ring : rings)
+      ring->written.store(0, std::memory_order_relaxed);
+  }
+
+  //The calling thread's ring is made now rather than in the middle of the first span
+  ThreadRing();
+
+  tracePath = path;
+  traceStart = std::chrono::steady_clock::now();
+  TracingActive.store(true, std::memory_order_release);
+  return true;
+}
+
+void TraceSpan(const char *name, const char *category, std::chrono::steady_clock::time_point start,
+  std::chrono::steady_clock::time_point end, int64_t line)
+{
+  TraceRing *ring = ThreadRing();
+  uint64_t index = ring->written.load(std::memory_order_relaxed);
+
+  TraceEvent &event = ring->events[index & (RingSize - 1)];
+  event.name = name;
+  event.category = category;
+  event.start = std::chrono::duration_cast<std::chrono::nanoseconds>(start - traceStart).count();
+  event.duration = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+  event.line = line;
+
+  ring->written.store(index + 1, std::memory_order_release);
+}
+
+bool StopTracing()
+{
+  if (!TracingEnabled())
+    return false;
+
+  TracingActive.store(false, std::memory_order_release);
+
+  std::ofstream file(tracePath, std::ios::binary | std::ios::trunc);
+  if (!file)
+    return false;
+
+  file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+
+  std::lock_guard<std::mutex> lock(ringsLock);
+  bool first = true;
+  char line[512];
+  for (auto &ring : rings)
+  {
+    uint64_t written = ring->written.load(std::memory_order_acquire);
+    uint64_t begin = written > RingSize ? written - RingSize : 0;
+
+    for (uint64_t i = begin; i < written; ++i)
+    {
+      const TraceEvent &event = ring->events[i & (RingSize - 1)];
+      int length = snprintf(line, sizeof(line), "%s{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f",
+        first ? "" : ",\n", event.name, event.category, ring->thread, event.start / 1000.0, event.duration / 1000.0);
+      file.write(line, length);
+
+      if (event.line >= 0)
+        file << ",\"args\":{\"line\":" << event.line << "}";
+      file << "}";
+      first = false;
+    }
+  }
+
+  file << "\n]}\n";
+  return (bool)file;
+}
@@ -0,0 +1,54 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+// Spans written out as Chrome trace events (chrome://tracing, Perfetto), so a slow session can be looked at on a
+// timeline. Every thread records into a ring of its own without taking a lock, when a ring is full the oldest
+// spans are overwritten. A ring outlives its thread and is taken over by the next thread that starts.
+//
+// Phases (see Phase_Stats.h), the top-level statements ResolveTypes goes through and binding calls are traced.
+
+extern std::atomic<bool> TracingActive;
+
+inline bool TracingEnabled()
+{
+  return TracingActive.load(std::memory_order_relaxed);
+}
+
+// Starts recording spans, the trace is written to path when it's stopped
+bool StartTracing(const std::string &path);
+
+// Writes the trace. Has to be called while nothing is being traced (between binding calls), a span that's being
+// recorded at the same time could come out garbled. Returns false if there was no trace or it couldn't be written.
+bool StopTracing();
+
+// name and category have to stay valid until the trace is written (string literals). line is shown as an
+// argument of the span, unless it's negative.
+void TraceSpan(const char *name, const char *category, std::chrono::steady_clock::time_point start,
+  std::chrono::steady_clock::time_point end, int64_t line = -1);
+
+// Traces the time from construction to destruction, nothing happens with a null name or while tracing is off
+class ScopedTrace
+{
+public:
+  ScopedTrace(const char *name, const char *category, int64_t line = -1)
+    : name(TracingEnabled() ? name : nullptr), category(category), line(line)
+  {
+    if (this->name != nullptr)
+      start = std::chrono::steady_clock::now();
+  }
+
+  ~ScopedTrace()
+  {
+    if (name != nullptr)
+      TraceSpan(name, category, start, std::chrono::steady_clock::now(), line);
+  }
+
+private:
+  const char *name;
+  const char *category;
+  int64_t line;
+  std::chrono::steady_clock::time_point start;
+};
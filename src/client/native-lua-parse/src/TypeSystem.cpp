@@ -4,6 +4,13 @@
 #include <stack>
 #include <functional>
 #include <cmath>
+#include <cctype>
+#include <algorithm>
+#include <cstdint>
+#include "FuzzyMatch.h"
+#include "Phase_Stats.h"
+#include "Memory_Accounting.h"
+#include "Tracing.h"
 
 static LibraryReference coreLibRef;
 
@@ -225,6 +232,8 @@ void AddReference(Library *library, Symbol *sym)
 template<typename T>
 T* CreateBlankSymbol(Library *library, const std::string& name, bool isGlobal)
 {
+  ScopedAllocationSite site(AllocationSite::Symbols);
+
   std::unique_ptr<T> type = std::make_unique<T>();
 
   type->Owner = library;
@@ -243,6 +252,8 @@ T* CreateBlankSymbol(Library *library, const std::string& name, bool isGlobal)
 template<typename T>
 T* CreateSymbol(Library *library, const std::string& name, bool isGlobal)
 {
+  ScopedAllocationSite site(AllocationSite::Symbols);
+
   //Find a value with the same name? Treat them the same!
   if (isGlobal)
   {
@@ -267,8 +278,10 @@ T* CreateSymbol(Library *library, const std::string& name, bool isGlobal)
 
   if (isGlobal)
   {
+    typePtr->IsGlobal = true;
     library->Globals.push_back(typePtr);
     library->GlobalsByName.insert(std::make_pair(name, typePtr));
+    library->GlobalNames.Add(typePtr, name);
   }
 
   AddReference(library, typePtr);
@@ -276,21 +289,41 @@ T* CreateSymbol(Library *library, const std::string& name, bool isGlobal)
   return typePtr;
 }
 
+uint64_t TypeLink::Epoch = 1;
+
 Type *Symbol::GetResolvedType() const
 {
   if (this == nullptr)
     return nullptr;
 
+  const uint64_t epoch = TypeLink::Epoch;
+  if (resolvedEpoch == epoch)
+    return resolvedCache;
+
+  //Follow the links until a type that resolves to itself, or one that already knows where its chain ends
   Type *resolvedType = this->ResolvedType;
 
   while (resolvedType != nullptr)
   {
+    if (resolvedType->resolvedEpoch == epoch)
+    {
+      resolvedType = resolvedType->resolvedCache;
+      break;
+    }
+
     if (resolvedType == resolvedType->ResolvedType)
       break;
 
     resolvedType = resolvedType->ResolvedType;
   }
 
+  //Everything walked over ends up at the same type
+  for (const Symbol *sym = this; sym != nullptr && sym->resolvedEpoch != epoch; sym = sym->ResolvedType)
+  {
+    sym->resolvedCache = resolvedType;
+    sym->resolvedEpoch = epoch;
+  }
+
   return resolvedType;
 }
 
@@ -342,6 +375,7 @@ Type* Library::CreateMultipleType(std::vector<Type *> const &types, bool isGloba
     return types[0];
   }
 
+  ScopedAllocationSite site(AllocationSite::TypeNames);
   std::string normalizedName = "MultipleType(";
 
   bool first = true;
@@ -392,6 +426,7 @@ Type* Library::AddPossibleType(Type *baseType, Type *newType, bool isGlobal)
   }
 
   //Create new normalized name
+  ScopedAllocationSite site(AllocationSite::TypeNames);
   std::string normalizedName = "PossibleType(";
   bool first = true;
   for (Type * t : baseType->PossibleTypes)
@@ -412,8 +447,9 @@ Type* Library::AddPossibleType(Type *baseType, Type *newType, bool isGlobal)
   return baseType;
 }
 
-Type *Library::CreateFunctionType(FunctionNode *function)
+std::string Library::FunctionTypeName(FunctionNode *function)
 {
+  ScopedAllocationSite site(AllocationSite::TypeNames);
   std::string normalizedName = "Function(";
 
   //@TODO add parameters
@@ -421,14 +457,106 @@ Type *Library::CreateFunctionType(FunctionNode *function)
   normalizedName += ") - ";
   normalizedName += function->SYM_ReturnType->GetResolvedType()->Name;
 
-  Type *functionType = CreateType(normalizedName, false);
+  return normalizedName;
+}
+
+Type *Library::CreateFunctionType(FunctionNode *function)
+{
+  Type *functionType = CreateType(FunctionTypeName(function), false);
   functionType->ReturnType = function->SYM_ReturnType;
 
   return functionType;
 }
 
+void NameIndex::Add(Symbol *sym, const std::string &name)
+{
+  for (size_t i = 0; i < name.size(); ++i)
+  {
+    if (IsWordStart(name.c_str(), i))
+      entries.push_back({ (char)std::tolower((unsigned char)name[i]), sym });
+  }
+}
+
+void NameIndex::Find(char c, std::vector<Symbol *> &found)
+{
+  auto less = [](const Entry &lhs, const Entry &rhs) { return lhs.Key < rhs.Key; };
+
+  //Sort in the names added since the last search
+  if (sorted != entries.size())
+  {
+    auto added = entries.begin() + sorted;
+    std::sort(added, entries.end(), less);
+    std::inplace_merge(entries.begin(), added, entries.end(), less);
+    sorted = entries.size();
+  }
+
+  Entry key = { (char)std::tolower((unsigned char)c), nullptr };
+  auto range = std::equal_range(entries.begin(), entries.end(), key, less);
+  for (auto it = range.first; it != range.second; ++it)
+    found.push_back(it->Sym);
+}
+
+void NameIndex::RemoveUnreferenced()
+{
+  size_t kept = 0;
+  size_t sortedKept = 0;
+  for (size_t i = 0; i < entries.size(); ++i)
+  {
+    if (entries[i].Sym->ReferenceCount == 0)
+      continue;
+
+    if (i < sorted)
+      ++sortedKept;
+    entries[kept++] = entries[i];
+  }
+
+  entries.resize(kept);
+  sorted = sortedKept;
+}
+
+void Library::FindGlobals(char c, std::vector<Symbol *> &found)
+{
+  GlobalNames.Find(c, found);
+}
+
+void Library::FindGlobalTableMembers(char c, std::vector<Symbol *> &found)
+{
+  IndexGlobalTable();
+  GlobalTableNames.Find(c, found);
+}
+
+void Library::IndexGlobalTable()
+{
+  //Members are only ever added on the end, Clean is the only thing that reorders them
+  Type *table = globalTable ? globalTable->GetResolvedType() : nullptr;
+  if (table == nullptr)
+    return;
+
+  std::vector<Variable *> &members = table->Members;
+  for (; IndexedTableMembers < members.size(); ++IndexedTableMembers)
+  {
+    Variable *var = members[IndexedTableMembers];
+    if (var->IsGlobal)
+      continue;
+
+    TableData *tableData = SymbolCast<TableData>(var);
+    if (tableData)
+    {
+      if (tableData->Index.Type == ExpressionType::String)
+        GlobalTableNames.Add(var, tableData->Index.Data.String);
+    }
+    else
+      GlobalTableNames.Add(var, var->Name);
+  }
+}
+
 void Library::Clean()
 {
+  ScopedPhase timer(Phase::Clean);
+
+  //Cleaning reorders the global table, so what's left gets indexed while the order still matches
+  IndexGlobalTable();
+
   for (auto &sym : AllSymbols)
   {
     sym->hasClearedRefs = false;
@@ -470,6 +598,16 @@ void Library::Clean()
     GlobalsByName.erase(sym->Name);
   }
 
+  //Take their names out of the indexes too
+  GlobalNames.RemoveUnreferenced();
+  GlobalTableNames.RemoveUnreferenced();
+  //_G goes with the core library's reference, when that's released it's freed below
+  if (globalTable && globalTable->ReferenceCount == 0)
+    globalTable = nullptr;
+
+  Type *table = globalTable ? globalTable->GetResolvedType() : nullptr;
+  IndexedTableMembers = table ? table->Members.size() : 0;
+
   CleanMembers(AllSymbols);
   CleanMembers(TempSymbols);
 }
@@ -482,6 +620,13 @@ public:
   std::stack<BlockNode *> blockStack;
   std::vector<Symbol *> parentStack;
 
+  //How many members of each symbol in parentStack can be seen, so a deferred body doesn't see the locals
+  //declared after its function
+  std::vector<size_t> visibleMembers;
+
+  //Leave the bodies of functions for ResolveTypesAt
+  bool deferFunctions = false;
+
   Type *GetBaseType(std::string const &name)
   {
     auto it = lib->BaseTypesByName.find(name);
@@ -490,7 +635,7 @@ public:
     }
     else
     {
-      if (dynamic_cast<Type *>(it->second))
+      if (SymbolCast<Type>(it->second))
         return (Type *)it->second;
     }
 
@@ -499,6 +644,52 @@ public:
     return nullptr;
   }
 
+  //Where each name first shows up in the members of a scope that's searched a lot. Members are only ever added
+  //on the end while resolving, so the ones before Indexed are in already.
+  struct MemberIndex
+  {
+    size_t Scanned = 0;
+    size_t Indexed = 0;
+    std::unordered_map<std::string, size_t> First;
+  };
+  std::unordered_map<std::vector<Variable *> *, MemberIndex> memberIndexes;
+
+  //Scopes smaller than this are faster to search one by one
+  static const size_t IndexedScopeSize = 64;
+
+  //Position of the first member called name, members.size() if there isn't one. A scope is searched one by one
+  //until that has cost a few times what indexing it would, so a file that only looks up a couple of globals
+  //doesn't index the whole global table.
+  size_t FindMember(std::vector<Variable *> &members, std::string const &name)
+  {
+    bool scan = members.size() < IndexedScopeSize;
+    MemberIndex *index = nullptr;
+    if (!scan)
+    {
+      index = &memberIndexes[&members];
+      scan = index->Indexed == 0 && index->Scanned < members.size() * 4;
+      if (scan)
+        index->Scanned += members.size();
+    }
+
+    if (scan)
+    {
+      for (size_t m = 0; m < members.size(); ++m)
+      {
+        if (members[m]->Name == name)
+          return m;
+      }
+
+      return members.size();
+    }
+
+    for (; index->Indexed < members.size(); ++index->Indexed)
+      index->First.insert(std::make_pair(members[index->Indexed]->Name, index->Indexed));
+
+    auto it = index->First.find(name);
+    return it != index->First.end() ? it->second : members.size();
+  }
+
   Variable *GetVariable(std::string const &name)
   {
     if (name == "_G")
@@ -507,21 +698,25 @@ public:
     //Traverse stack in reverse for variable
     for (int i = parentStack.size() - 1; i >= 0; i--)
     {
-      Symbol *sym = parentStack[i];
-      for (Variable *var : sym->Members)
-      {
-        if (var->Name == name)
-          return var;
-      }
+      std::vector<Variable *> &members = parentStack[i]->Members;
+      size_t found = FindMember(members, name);
+      if (found < std::min(visibleMembers[i], members.size()))
+        return members[found];
     }
 
     //Traverse global stack for variable
-    for(Symbol *sym : lib->globalTable->GetResolvedType()->Members)
+    std::vector<Variable *> &globals = lib->globalTable->GetResolvedType()->Members;
+    size_t found = FindMember(globals, name);
+    if (found == globals.size())
+      return nullptr;
+    if (SymbolCast<Variable>(globals[found]) != nullptr)
+      return globals[found];
+
+    //Only variables count, the first one of that name might not be
+    for (Symbol *sym : globals)
     {
-      if (sym->Name == name && dynamic_cast<Variable *>(sym) != nullptr)
-      {
-          return dynamic_cast<Variable *>(sym);
-      }
+      if (sym->Name == name && SymbolCast<Variable>(sym) != nullptr)
+        return SymbolCast<Variable>(sym);
     }
 
     return nullptr;
@@ -715,10 +910,13 @@ public:
 
   virtual VisitResult Visit(BlockNode* node)
   {
+    //Every statement of the file gets a span of its own while tracing
+    const char *traceName = blockStack.empty() ? "statement" : nullptr;
     blockStack.push(node);
 
     for (auto &child : node->Statements)
     {
+      ScopedTrace trace(traceName, "resolve", child->Position.Line);
       child->Walk(this);
     }
 
@@ -844,7 +1042,7 @@ public:
             ValueData newIndex;
             bool isValid = true;
 
-            IdentifiedIndexNode *identityNode = dynamic_cast<IdentifiedIndexNode *>(node->Index.get());
+            IdentifiedIndexNode *identityNode = NodeCast<IdentifiedIndexNode>(node->Index.get());
             if (identityNode)
             {
               newIndex.Type = ExpressionType::String;
@@ -854,7 +1052,7 @@ public:
                 isValid = false;
             }
 
-            ExpressionIndexNode *expressionNode = dynamic_cast<ExpressionIndexNode *>(node->Index.get());
+            ExpressionIndexNode *expressionNode = NodeCast<ExpressionIndexNode>(node->Index.get());
             if (expressionNode)
             {
               newIndex = expressionNode->Expression->SEM_Value;
@@ -866,7 +1064,7 @@ public:
               TableData *existingData = nullptr;
               for (Variable *var : node->SEM_ResolvedSymbol->Members)
               {
-                TableData *tblData = dynamic_cast<TableData *>(var);
+                TableData *tblData = SymbolCast<TableData>(var);
                 if (tblData && tblData->Index == newIndex)
                 {
                   existingData = tblData;
@@ -929,7 +1127,7 @@ public:
           return VisitResult::Stop;
         }
 
-        IdentifiedIndexNode *identityNode = dynamic_cast<IdentifiedIndexNode *>(node->Index.get());
+        IdentifiedIndexNode *identityNode = NodeCast<IdentifiedIndexNode>(node->Index.get());
         if (identityNode)
         {
           for (Variable *var : node->SEM_ResolvedSymbol->Members)
@@ -984,7 +1182,7 @@ public:
         }
         else
         {
-          ExpressionIndexNode *expressionNode = dynamic_cast<ExpressionIndexNode *>(node->Index.get());
+          ExpressionIndexNode *expressionNode = NodeCast<ExpressionIndexNode>(node->Index.get());
           if (expressionNode)
           {
             for (Variable *var : node->SEM_ResolvedSymbol->Members)
@@ -1017,7 +1215,7 @@ public:
 
         node->SEM_ResolvedSymbol = parentPrediction;
 
-        IdentifiedIndexNode *identityNode = dynamic_cast<IdentifiedIndexNode *>(node->Index.get());
+        IdentifiedIndexNode *identityNode = NodeCast<IdentifiedIndexNode>(node->Index.get());
         if (identityNode)
         {
           ValueData newIndex;
@@ -1126,7 +1324,7 @@ public:
 
     for (Variable *var : node->SEM_ResolvedSymbol->Members)
     {
-      TableData *tblData = dynamic_cast<TableData *>(var);
+      TableData *tblData = SymbolCast<TableData>(var);
       if (tblData && tblData->Index == name)
       {
         node->SEM_ResolvedSymbol = tblData->GetResolvedType();
@@ -1147,23 +1345,15 @@ public:
     return VisitResult::Stop;
   }
 
+  //Resolved as they're walked
   virtual VisitResult Visit(ExpressionArgumentNode* node)
   {
-    for (auto &e_node : node->ExpressionList)
-    {
-      e_node->Walk(this);
-    }
-
-    return VisitResult::Stop;
+    return VisitResult::Continue;
   }
 
   virtual VisitResult Visit(TableArgumentNode* node)
   {
-
-
-    node->Table->Walk(this);
-
-    return VisitResult::Stop;
+    return VisitResult::Continue;
   }
 
   virtual VisitResult Visit(StringArgumentNode* node)
@@ -1189,9 +1379,7 @@ public:
 
   virtual VisitResult Visit(ExpressionIndexNode* node)
   {
-    node->Expression->Walk(this);
-
-    return VisitResult::Stop;
+    return VisitResult::Continue;
   }
 
   virtual VisitResult Visit(BreakNode* node)
@@ -1202,20 +1390,23 @@ public:
   }
 
   virtual VisitResult Visit(ReturnNode* node)
+  {
+    return VisitResult::Continue;
+  }
+
+  //Once the values are resolved
+  virtual void Leave(ReturnNode* node)
   {
     std::vector<Type *> returnTypes;
 
     for (auto &r_node : node->ReturnValues)
     {
-      r_node->Walk(this);
       returnTypes.push_back(r_node->SEM_ResolvedType);
     }
 
     Type *returnType = lib->CreateMultipleType(returnTypes);
 
     lib->AddPossibleType(functionStack.top()->SYM_ReturnType, returnType);
-
-    return VisitResult::Stop;
   }
 
   virtual VisitResult Visit(ValueNode* node)
@@ -1288,16 +1479,12 @@ public:
 
   virtual VisitResult Visit(TableNode* node)
   {
-    for (auto &i_node : node->Indicies)
-    {
-      i_node->Walk(this);
-    }
-
-    for (auto &v_node : node->Values)
-    {
-      v_node->Walk(this);
-    }
+    return VisitResult::Continue;
+  }
 
+  //Once the indicies and values are resolved, nested tables don't recurse
+  virtual void Leave(TableNode* node)
+  {
     Type *tableType = lib->CreateBlankType("Table");
 
     int arrayIndex = 1;
@@ -1317,7 +1504,7 @@ public:
         }
         else
         {
-          IdentifiedIndexNode *identityNode = dynamic_cast<IdentifiedIndexNode *>(node->FullIndicies[i]);
+          IdentifiedIndexNode *identityNode = NodeCast<IdentifiedIndexNode>(node->FullIndicies[i]);
           if (identityNode)
           {
             tableVar->Index.Data.String = identityNode->Name.str();
@@ -1325,7 +1512,7 @@ public:
           }
           else
           {
-            ExpressionIndexNode *expressionNode = dynamic_cast<ExpressionIndexNode *>(node->FullIndicies[i]);
+            ExpressionIndexNode *expressionNode = NodeCast<ExpressionIndexNode>(node->FullIndicies[i]);
             if (expressionNode)
             {
               tableVar->Index = expressionNode->Expression->SEM_Value;
@@ -1341,17 +1528,16 @@ public:
     }
 
     node->SEM_ResolvedType = tableType;
-
-    return VisitResult::Stop;
   }
 
   virtual VisitResult Visit(FunctionExpressionNode* node)
   {
-    node->Function->Walk(this);
+    return VisitResult::Continue;
+  }
 
+  virtual void Leave(FunctionExpressionNode* node)
+  {
     node->SEM_ResolvedType = node->Function->SYM_Variable->GetResolvedType();
-
-    return VisitResult::Stop;
   }
 
   virtual VisitResult Visit(FunctionCallNode* node)
@@ -1394,19 +1580,21 @@ public:
 
   virtual VisitResult Visit(UnaryOperatorNode* node)
   {
-
-
-    node->Right->Walk(this);
-
-    return VisitResult::Stop;
+    return VisitResult::Continue;
   }
 
+  //Both sides are evaluated first, long chains like a .. b .. c don't recurse
   virtual VisitResult Visit(BinaryOperatorNode* node)
   {
-    //Evaluate both sides
-    node->Left->Walk(this);
-    node->Right->Walk(this);
-    
+    return VisitResult::Continue;
+  }
+
+  virtual void Leave(BinaryOperatorNode* node)
+  {
+    //Broken code can leave a side out
+    if (node->Left == nullptr || node->Right == nullptr)
+      return;
+
     Type *NumberType = GetBaseType("Number");
     Type *StringType = GetBaseType("String");
 
@@ -1455,13 +1643,13 @@ public:
           }
         }
 
-        return VisitResult::Stop;
+        return;
       }
 
       //Not numeric, need to handle with metatable
       //@TODO Handle metatable
 
-      return VisitResult::Stop;
+      return;
     }
 
     
@@ -1474,7 +1662,7 @@ public:
         node->SEM_ResolvedType = GetBaseType("String");
 
         //@TODO Handle const values
-        return VisitResult::Stop;
+        return;
       }
       else
       {
@@ -1492,14 +1680,14 @@ public:
         //@REM Should be false
 
         node->SEM_ResolvedType = GetBaseType("Boolean");
-        return VisitResult::Stop;
+        return;
       }
 
       if (node->Left->SEM_ResolvedType == node->Right->SEM_ResolvedType)
       {
         //@REM Should be compared
         node->SEM_ResolvedType = GetBaseType("Boolean");
-        return VisitResult::Stop;
+        return;
       }
 
       //Otherwise, metamethod
@@ -1513,14 +1701,14 @@ public:
       if (node->Left->SEM_ResolvedType == NumberType && node->Right->SEM_ResolvedType == NumberType)
       {
         node->SEM_ResolvedType = GetBaseType("Boolean");
-        return VisitResult::Stop;
+        return;
       }
 
       //If both are strings, do lexicographic comp
       if (node->Left->SEM_ResolvedType == StringType && node->Right->SEM_ResolvedType == StringType)
       {
         node->SEM_ResolvedType = GetBaseType("Boolean");
-        return VisitResult::Stop;
+        return;
       }
 
       //Otherwise, metamethod
@@ -1534,14 +1722,14 @@ public:
       if (node->Left->SEM_ResolvedType == NumberType && node->Right->SEM_ResolvedType == NumberType)
       {
         node->SEM_ResolvedType = GetBaseType("Boolean");
-        return VisitResult::Stop;
+        return;
       }
 
       //If both are strings, do lexicographic comp
       if (node->Left->SEM_ResolvedType == StringType && node->Right->SEM_ResolvedType == StringType)
       {
         node->SEM_ResolvedType = GetBaseType("Boolean");
-        return VisitResult::Stop;
+        return;
       }
 
       //Otherwise, metamethod
@@ -1557,12 +1745,9 @@ public:
       if (node->Left->SEM_ResolvedType == BooleanType && node->Right->SEM_ResolvedType == BooleanType)
       {
         node->SEM_ResolvedType = GetBaseType("Boolean");
-        return VisitResult::Stop;
+        return;
       }
     }
-
-
-    return VisitResult::Stop;
   }
 
   virtual VisitResult Visit(FunctionNode* node)
@@ -1709,7 +1894,11 @@ public:
       }
     }
 
+    if (!parentStack.empty())
+      node->SEM_VisibleMembers = parentStack.back()->Members.size();
+
     parentStack.push_back(node->SYM_Variable);
+    visibleMembers.push_back(SIZE_MAX);
 
     //Push the parameters as local vars, predict their types
     //@TODO: Fully develop function type resolution
@@ -1731,11 +1920,18 @@ public:
     node->SYM_ReturnType = lib->CreateBlankType("");
     node->SYM_ReturnType->ResolvedType = GetBaseType("Nil");
 
-    functionStack.push(node);
-    node->Block->Walk(this);
-    functionStack.pop();
+    //Everything but the main chunk can wait
+    if (deferFunctions && parentStack.size() > 1)
+      node->SEM_Deferred = true;
+    else
+    {
+      functionStack.push(node);
+      node->Block->Walk(this);
+      functionStack.pop();
+    }
 
     parentStack.pop_back();
+    visibleMembers.pop_back();
 
     Type *functionType = lib->CreateFunctionType(node);
     node->SYM_Variable->ResolvedType = functionType;
@@ -1743,6 +1939,30 @@ public:
     return VisitResult::Stop;
   }
 
+  //Resolves the body Visit(FunctionNode) left for later. The function's enclosing functions are on parentStack,
+  //block is the one its declaration is in.
+  void ResolveDeferred(FunctionNode *node, BlockNode *block)
+  {
+    node->SEM_Deferred = false;
+
+    parentStack.push_back(node->SYM_Variable);
+    visibleMembers.push_back(SIZE_MAX);
+    blockStack.push(block);
+    functionStack.push(node);
+
+    node->Block->Walk(this);
+
+    functionStack.pop();
+    blockStack.pop();
+    parentStack.pop_back();
+    visibleMembers.pop_back();
+
+    //The type was named before anything was returned
+    Type *functionType = node->SYM_Variable->ResolvedType;
+    if (functionType != nullptr && functionType->ReturnType == node->SYM_ReturnType)
+      functionType->Name = Library::FunctionTypeName(node);
+  }
+
   virtual VisitResult Visit(WhileNode* node)
   {
 
@@ -1908,52 +2128,44 @@ public:
   }
 };
 
-class PrintTypeVisitor : public Visitor
+class PrintTypeVisitor : public TreePrinter
 {
 public:
   virtual VisitResult Visit(AbstractNode* node)
   {
-    NodePrinter printer;
+    NodePrinter &printer = Open();
     printer << "AbstractNode";
 
-    node->Walk(this, false);
-
-    return VisitResult::Stop;
+    return VisitResult::Continue;
   }
 
   virtual VisitResult Visit(BlockNode* node)
   {
-    NodePrinter printer;
+    NodePrinter &printer = Open();
     printer << "BlockNode";
 
-    node->Walk(this, false);
-
-    return VisitResult::Stop;
+    return VisitResult::Continue;
   }
 
   virtual VisitResult Visit(StatementNode* node)
   {
-    NodePrinter printer;
+    NodePrinter &printer = Open();
     printer << "StatementNode";
 
-    node->Walk(this, false);
-
-    return VisitResult::Stop;
+    return VisitResult::Continue;
   }
 
   virtual VisitResult Visit(TypeNode* node)
   {
-    NodePrinter printer;
+    NodePrinter &printer = Open();
     printer << "TypeNode(" << node->Name << ")";
 
-    node->Walk(this, false);
-
-    return VisitResult::Stop;
+    return VisitResult::Continue;
   }
 
   virtual VisitResult Visit(AssignmentNode* node)
   {
-    NodePrinter printer;
+    NodePrinter &printer = Open();
     printer << "AssignmentNode [" << node->Operator << "](";
 
     for (auto &token : node->Names)
@@ -1973,256 +2185,206 @@ public:
 
     typePrinter << ")";
 
-    node->Walk(this, false);
-
-    return VisitResult::Stop;
+    return VisitResult::Continue;
   }
 
   virtual VisitResult Visit(VariableNode* node)
   {
-    NodePrinter printer;
+    NodePrinter &printer = Open();
     printer << "VariableNode" << " - " << node->SEM_ResolvedSymbol;
 
-    node->Walk(this, false);
-
-    return VisitResult::Stop;
+    return VisitResult::Continue;
   }
 
   virtual VisitResult Visit(VariableStatementNode* node)
   {
-    NodePrinter printer;
+    NodePrinter &printer = Open();
     printer << "VariableStatementNode" << " - " << node->SEM_ResolvedSymbol;
 
-    node->Walk(this, false);
-
-    return VisitResult::Stop;
+    return VisitResult::Continue;
   }
 
   virtual VisitResult Visit(IdentifiedVariableNode* node)
   {
-    NodePrinter printer;
+    NodePrinter &printer = Open();
     printer << "IdentifiedVariableNode(" << node->Name << ")" << " - " << node->SEM_ResolvedSymbol;
 
-    node->Walk(this, false);
-
-    return VisitResult::Stop;
+    return VisitResult::Continue;
   }
 
   virtual VisitResult Visit(ExpressionVariableNode* node)
   {
-    NodePrinter printer;
+    NodePrinter &printer = Open();
     printer << "ExpressionVariableNode" << " - " << node->SEM_ResolvedSymbol;
 
-    node->Walk(this, false);
-
-    return VisitResult::Stop;
+    return VisitResult::Continue;
   }
 
   virtual VisitResult Visit(VariableSuffixNode* node)
   {
-    NodePrinter printer;
+    NodePrinter &printer = Open();
     printer << "VariableSuffixNode" << " - " << node->SEM_ResolvedSymbol;
 
-    node->Walk(this, false);
-
-    return VisitResult::Stop;
+    return VisitResult::Continue;
   }
 
   virtual VisitResult Visit(CallNode* node)
   {
-    NodePrinter printer;
+    NodePrinter &printer = Open();
     printer << "CallNode";
 
-    node->Walk(this, false);
-
-    return VisitResult::Stop;
+    return VisitResult::Continue;
   }
 
   virtual VisitResult Visit(MemberCallNode* node)
   {
-    NodePrinter printer;
+    NodePrinter &printer = Open();
     printer << "MemberCallNode(" << node->Name << ")";
 
-    node->Walk(this, false);
-
-    return VisitResult::Stop;
+    return VisitResult::Continue;
   }
 
   virtual VisitResult Visit(ArgumentNode* node)
   {
-    NodePrinter printer;
+    NodePrinter &printer = Open();
     printer << "ArgumentNode";
 
-    node->Walk(this, false);
-
-    return VisitResult::Stop;
+    return VisitResult::Continue;
   }
 
   virtual VisitResult Visit(ExpressionArgumentNode* node)
   {
-    NodePrinter printer;
+    NodePrinter &printer = Open();
     printer << "ExpressionArgumentNode";
 
-    node->Walk(this, false);
-
-    return VisitResult::Stop;
+    return VisitResult::Continue;
   }
 
   virtual VisitResult Visit(TableArgumentNode* node)
   {
-    NodePrinter printer;
+    NodePrinter &printer = Open();
     printer << "TableArgumentNode";
 
-    node->Walk(this, false);
-
-    return VisitResult::Stop;
+    return VisitResult::Continue;
   }
 
   virtual VisitResult Visit(StringArgumentNode* node)
   {
-    NodePrinter printer;
+    NodePrinter &printer = Open();
     printer << "StringArgumentNode(" << node->String << ")";
 
-    node->Walk(this, false);
-
-    return VisitResult::Stop;
+    return VisitResult::Continue;
   }
 
 
   virtual VisitResult Visit(IndexNode* node)
   {
-    NodePrinter printer;
+    NodePrinter &printer = Open();
     printer << "IndexNode";
 
-    node->Walk(this, false);
-
-    return VisitResult::Stop;
+    return VisitResult::Continue;
   }
 
   virtual VisitResult Visit(IdentifiedIndexNode* node)
   {
-    NodePrinter printer;
+    NodePrinter &printer = Open();
     printer << "IdentifiedIndexNode(" << node->Name << ")";
 
-    node->Walk(this, false);
-
-    return VisitResult::Stop;
+    return VisitResult::Continue;
   }
 
   virtual VisitResult Visit(ExpressionIndexNode* node)
   {
-    NodePrinter printer;
+    NodePrinter &printer = Open();
     printer << "ExpressionIndexNode";
 
-    node->Walk(this, false);
-
-    return VisitResult::Stop;
+    return VisitResult::Continue;
   }
 
 
   virtual VisitResult Visit(BreakNode* node)
   {
-    NodePrinter printer;
+    NodePrinter &printer = Open();
     printer << "BreakNode";
 
-    node->Walk(this, false);
-
-    return VisitResult::Stop;
+    return VisitResult::Continue;
   }
 
   virtual VisitResult Visit(ReturnNode* node)
   {
-    NodePrinter printer;
+    NodePrinter &printer = Open();
     printer << "ReturnNode";
 
-    node->Walk(this, false);
-
-    return VisitResult::Stop;
+    return VisitResult::Continue;
   }
 
   virtual VisitResult Visit(ExpressionNode* node)
   {
-    NodePrinter printer;
+    NodePrinter &printer = Open();
     printer << "ExpressionNode(" << node->SEM_ResolvedType << ")";
 
-    node->Walk(this, false);
-
-    return VisitResult::Stop;
+    return VisitResult::Continue;
   }
 
   virtual VisitResult Visit(ValueNode* node)
   {
-    NodePrinter printer;
+    NodePrinter &printer = Open();
     printer << "ValueNode(" << node->Expression << ")" << " - " << node->SEM_ResolvedType << " : " << node->SEM_Value;
 
-    node->Walk(this, false);
-
-    return VisitResult::Stop;
+    return VisitResult::Continue;
   }
 
   virtual VisitResult Visit(TableNode* node)
   {
-    NodePrinter printer;
+    NodePrinter &printer = Open();
     printer << "TableNode" << " - " << node->SEM_ResolvedType;
 
-    node->Walk(this, false);
-
-    return VisitResult::Stop;
+    return VisitResult::Continue;
   }
 
   virtual VisitResult Visit(FunctionExpressionNode* node)
   {
-    NodePrinter printer;
+    NodePrinter &printer = Open();
     printer << "FunctionExpressionNode" << " - " << node->SEM_ResolvedType;
 
-    node->Walk(this, false);
-
-    return VisitResult::Stop;
+    return VisitResult::Continue;
   }
 
   virtual VisitResult Visit(FunctionCallNode* node)
   {
-    NodePrinter printer;
+    NodePrinter &printer = Open();
     printer << "FunctionCallNode" << " - " << node->SEM_ResolvedType;
 
-    node->Walk(this, false);
-
-    return VisitResult::Stop;
+    return VisitResult::Continue;
   }
 
   virtual VisitResult Visit(PrefixExpressionNode* node)
   {
-    NodePrinter printer;
+    NodePrinter &printer = Open();
     printer << "PrefixExpressionNode" << " - " << node->SEM_ResolvedType << " : " << node->SEM_Value;
 
-    node->Walk(this, false);
-
-    return VisitResult::Stop;
+    return VisitResult::Continue;
   }
 
   virtual VisitResult Visit(UnaryOperatorNode* node)
   {
-    NodePrinter printer;
+    NodePrinter &printer = Open();
     printer << "UnaryOperatorNode(" << node->Operator << ")" << " - " << node->SEM_ResolvedType << " : " << node->SEM_Value;
 
-    node->Walk(this, false);
-
-    return VisitResult::Stop;
+    return VisitResult::Continue;
   }
 
   virtual VisitResult Visit(BinaryOperatorNode* node)
   {
-    NodePrinter printer;
+    NodePrinter &printer = Open();
     printer << "BinaryOperatorNode(" << node->Operator << ")" << " - " << node->SEM_ResolvedType << " : " << node->SEM_Value;
 
-    node->Walk(this, false);
-
-    return VisitResult::Stop;
+    return VisitResult::Continue;
   }
 
   virtual VisitResult Visit(FunctionNode* node)
   {
-    NodePrinter printer;
+    NodePrinter &printer = Open();
     printer << "FunctionNode" << " - " << node->SYM_ReturnType;
 
     for (auto &token : node->ParameterList)
@@ -2230,54 +2392,44 @@ public:
       printer << " | " << token;
     }
 
-    node->Walk(this, false);
-
-    return VisitResult::Stop;
+    return VisitResult::Continue;
   }
 
   virtual VisitResult Visit(FunctionNameNode* node)
   {
-    NodePrinter printer;
+    NodePrinter &printer = Open();
     printer << "FunctionNameNode(" << node->Name << "," << node->IsMemberFunc << ")";
 
-    node->Walk(this, false);
-
-    return VisitResult::Stop;
+    return VisitResult::Continue;
   }
 
   virtual VisitResult Visit(WhileNode* node)
   {
-    NodePrinter printer;
+    NodePrinter &printer = Open();
     printer << "WhileNode";
 
-    node->Walk(this, false);
-
-    return VisitResult::Stop;
+    return VisitResult::Continue;
   }
 
   virtual VisitResult Visit(IfNode* node)
   {
-    NodePrinter printer;
+    NodePrinter &printer = Open();
     printer << "IfNode";
 
-    node->Walk(this, false);
-
-    return VisitResult::Stop;
+    return VisitResult::Continue;
   }
 
   virtual VisitResult Visit(ForNode* node)
   {
-    NodePrinter printer;
+    NodePrinter &printer = Open();
     printer << "ForNode";
 
-    node->Walk(this, false);
-
-    return VisitResult::Stop;
+    return VisitResult::Continue;
   }
 
   virtual VisitResult Visit(GenericForNode* node)
   {
-    NodePrinter printer;
+    NodePrinter &printer = Open();
     printer << "GenericForNode";
 
     for (auto &token : node->Names)
@@ -2285,34 +2437,28 @@ public:
       printer << " | " << token;
     }
 
-    node->Walk(this, false);
-
-    return VisitResult::Stop;
+    return VisitResult::Continue;
   }
 
   virtual VisitResult Visit(NumericForNode* node)
   {
-    NodePrinter printer;
+    NodePrinter &printer = Open();
     printer << "NumericForNode";
 
-    node->Walk(this, false);
-
-    return VisitResult::Stop;
+    return VisitResult::Continue;
   }
 
   virtual VisitResult Visit(RepeatNode* node)
   {
-    NodePrinter printer;
+    NodePrinter &printer = Open();
     printer << "RepeatNode";
 
-    node->Walk(this, false);
-
-    return VisitResult::Stop;
+    return VisitResult::Continue;
   }
 
   virtual VisitResult Visit(LocalVariableNode* node)
   {
-    NodePrinter printer;
+    NodePrinter &printer = Open();
     printer << "LocalVariableNode";
 
     for (auto &token : node->Names)
@@ -2327,307 +2473,126 @@ public:
       printer << expr->SEM_ResolvedType->GetResolvedType() << " ";
     }
 
-    node->Walk(this, false);
-
-    return VisitResult::Stop;
+    return VisitResult::Continue;
   }
 };
 
-//Parent Resolver
-class ParentVisitor : public Visitor
+LibraryReference::~LibraryReference()
 {
-public:
-  virtual VisitResult Visit(BlockNode* node)
-  {
-    for (auto &child : node->Statements)
-    {
-      child->Parent = node;
-    }
-
-    //Short circuit the parent for correct autocomplete.
-    if(node->End)
-      node->End->Parent = node->Parent;
-
-    return VisitResult::Continue;
-  }
-
-  virtual VisitResult Visit(AssignmentNode* node)
-  {
-    for (auto &child : node->LeftVariables)
-    {
-      child->Parent = node;
-    }
-
-    for (auto &child : node->RightExpressions)
-    {
-      child->Parent = node;
-    }
-
-    return VisitResult::Continue;
-  }
-
-  virtual VisitResult Visit(VariableStatementNode* node)
-  {
-    node->Variable->Parent = node;
-
-    if (node->Suffix)
-    {
-      node->Suffix->Parent = node;
-    }
-
-    return VisitResult::Continue;
-  }
-
-  virtual VisitResult Visit(ExpressionVariableNode* node)
-  {
-    node->Expression->Parent = node;
-
-    if (node->Suffix)
-    {
-      node->Suffix->Parent = node;
-    }
-
-    return VisitResult::Continue;
-  }
-
-  virtual VisitResult Visit(VariableSuffixNode* node)
-  {
-    if (node->LeftSuffix)
-    {
-      node->LeftSuffix->Parent = node;
-    }
-
-    for (auto &child : node->CallNodes)
-    {
-      child->Parent = node;
-    }
-
-    if (node->Index)
-    {
-      node->Index->Parent = node;
-    }
-
-    return VisitResult::Continue;
-  }
-
-  virtual VisitResult Visit(CallNode* node)
-  {
-    if(node->Argument)
-      node->Argument->Parent = node;
-
-    return VisitResult::Continue;
-  }
-
-  virtual VisitResult Visit(ExpressionArgumentNode* node)
-  {
-    for (auto &child : node->ExpressionList)
-    {
-      child->Parent = node;
-    }
-
-    return VisitResult::Continue;
-  }
-
-  virtual VisitResult Visit(TableArgumentNode* node)
-  {
-    node->Table->Parent = node;
-
-    return VisitResult::Continue;
-  }
-
-  virtual VisitResult Visit(ExpressionIndexNode* node)
-  {
-    node->Expression->Parent = node;
-
-    return VisitResult::Continue;
-  }
-
-  virtual VisitResult Visit(ReturnNode* node)
-  {
-    for (auto &child : node->ReturnValues)
-    {
-      child->Parent = node;
-    }
-
-    return VisitResult::Continue;
-  }
-
-  virtual VisitResult Visit(TableNode* node)
-  {
-    for (auto &child : node->Indicies)
-    {
-      child->Parent = node;
-    }
-
-    for (auto &child : node->Values)
-    {
-      child->Parent = node;
-    }
-
-    return VisitResult::Continue;
-  }
-
-  virtual VisitResult Visit(FunctionExpressionNode* node)
-  {
-    node->Function->Parent = node;
-
-    return VisitResult::Continue;
-  }
-
-  virtual VisitResult Visit(FunctionCallNode* node)
-  {
-    node->Variable->Parent = node;
-
-    for (auto &child : node->Calls)
-    {
-      child->Parent = node;
-    }
-
-    return VisitResult::Continue;
-  }
+  Release();
+}
 
-  virtual VisitResult Visit(PrefixExpressionNode* node)
+void LibraryReference::Release()
+{
+  //First reduce all reference counts we own
+  for (auto &pair : SymbolReferences)
   {
-    node->LeftVar->Parent = node;
-
-    for (auto &child : node->RightCalls)
-    {
-      child->Parent = node;
-    }
-
-    return VisitResult::Continue;
+    if(pair.first->ReferenceCount > 0)
+      pair.first->ReferenceCount -= 1;
   }
+  SymbolReferences.clear();
 
-  virtual VisitResult Visit(UnaryOperatorNode* node)
-  {
-    node->Right->Parent = node;
+  if (library)
+    library->Clean();
+}
 
-    return VisitResult::Continue;
-  }
+void ResolveTypes(AbstractNode *ast, Library *lib, LibraryReference *libRef, bool deferFunctions)
+{
+  lib->currentRef = libRef;
+  libRef->library = lib;
 
-  virtual VisitResult Visit(BinaryOperatorNode* node)
+  //Parents are set by the parser, so resolving is a single walk
   {
-    node->Left->Parent = node;
-    node->Right->Parent = node;
+    ScopedPhase timer(Phase::ResolveTypes);
+    ResolveTypesVisitor resTypes;
+    resTypes.lib = lib;
+    resTypes.deferFunctions = deferFunctions;
 
-    return VisitResult::Continue;
+    ast->Walk(&resTypes);
   }
 
-  virtual VisitResult Visit(FunctionNode* node)
-  {
-    for (auto &child : node->Name)
-    {
-      child->Parent = node;
-    }
-
-    node->Block->Parent = node;
+  lib->currentRef = nullptr;
+}
 
-    return VisitResult::Continue;
-  }
+//Walks down to position, resolving the deferred bodies on the way. Functions that don't have position inside them
+//aren't walked into, so only the statements of the main chunk and the bodies around position are visited.
+class ResolveAtVisitor : public Visitor
+{
+public:
+  ResolveAtVisitor(ResolveTypesVisitor &resolver, DocumentPosition position)
+    : resolver(resolver), position(position)
+  {}
 
-  virtual VisitResult Visit(WhileNode* node)
+  VisitResult Visit(BlockNode *node) override
   {
-    node->Condition->Parent = node;
-    node->Block->Parent = node;
-
+    blocks.push_back(node);
     return VisitResult::Continue;
   }
 
-  virtual VisitResult Visit(RepeatNode* node)
+  void Leave(BlockNode *node) override
   {
-    node->Block->Parent = node;
-    node->Condition->Parent = node;
-
-    return VisitResult::Continue;
+    blocks.pop_back();
   }
 
-  virtual VisitResult Visit(IfNode* node)
+  VisitResult Visit(FunctionNode *node) override
   {
-    if (node->Condition)
-    {
-      node->Condition->Parent = node;
-    }
+    //Functions ResolveTypes never got to have no symbols to resolve their bodies with
+    if (!Contains(node) || node->SYM_Variable == nullptr || node->Block == nullptr)
+      return VisitResult::Stop;
 
-    node->Block->Parent = node;
+    std::vector<Symbol *> &parents = resolver.parentStack;
+    if (!parents.empty())
+      resolver.visibleMembers.back() = node->SEM_VisibleMembers;
 
-    if (node->Else)
+    if (node->SEM_Deferred && !blocks.empty())
     {
-      node->Else->Parent = node;
+      ScopedTrace trace("function", "resolve", node->Position.Line);
+      resolver.ResolveDeferred(node, blocks.back());
     }
 
-    return VisitResult::Continue;
-  }
-
-  virtual VisitResult Visit(ForNode* node)
-  {
-    node->Block->Parent = node;
+    parents.push_back(node->SYM_Variable);
+    resolver.visibleMembers.push_back(SIZE_MAX);
 
     return VisitResult::Continue;
   }
 
-  virtual VisitResult Visit(NumericForNode* node)
+  void Leave(FunctionNode *node) override
   {
-    node->Var->Parent = node;
-    node->Limit->Parent = node;
-
-    if (node->Step)
-    {
-      node->Step->Parent = node;
-    }
-
-    node->Block->Parent = node;
-
-    return VisitResult::Continue;
+    resolver.parentStack.pop_back();
+    resolver.visibleMembers.pop_back();
   }
 
-  virtual VisitResult Visit(GenericForNode* node)
+private:
+  //A function runs from its name to the end of its body, the main chunk is everything
+  bool Contains(FunctionNode *node)
   {
-    for (auto &child : node->ExpressionList)
-    {
-      child->Parent = node;
-    }
+    if (node->Parent == nullptr)
+      return true;
 
-    node->Block->Parent = node;
+    if (position < node->Position)
+      return false;
 
-    return VisitResult::Continue;
+    AbstractNode *end = node->Block->End.get();
+    return end == nullptr || !(end->Position < position);
   }
 
-  virtual VisitResult Visit(LocalVariableNode* node)
-  {
-    for (auto &child : node->ExpressionList)
-    {
-      child->Parent = node;
-    }
-    return VisitResult::Continue;
-  }
+  ResolveTypesVisitor &resolver;
+  DocumentPosition position;
+  std::vector<BlockNode *> blocks;
 };
 
-LibraryReference::~LibraryReference()
-{
-  int a = 5;
-
-  //First reduce all reference counts we own
-  for (auto &pair : SymbolReferences)
-  {
-    if(pair.first->ReferenceCount > 0)
-      pair.first->ReferenceCount -= 1;
-  }
-
-  library->Clean();
-}
-
-void ResolveTypes(AbstractNode *ast, Library *lib, LibraryReference *libRef)
+void ResolveTypesAt(AbstractNode *ast, DocumentPosition position, Library *lib, LibraryReference *libRef)
 {
+  ScopedPhase timer(Phase::ResolveTypes);
   lib->currentRef = libRef;
   libRef->library = lib;
 
   ResolveTypesVisitor resTypes;
   resTypes.lib = lib;
+  resTypes.deferFunctions = true;
 
-  ast->Walk(&resTypes);
-
-  ParentVisitor parentResolve;
-  ast->Walk(&parentResolve);
+  ResolveAtVisitor visitor(resTypes, position);
+  ast->Walk(&visitor);
 
   lib->currentRef = nullptr;
 }
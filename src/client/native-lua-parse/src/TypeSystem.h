@@ -1,4 +1,5 @@
 #pragma once
+#include <cstdint>
 #include <string>
 #include <vector>
 #include <unordered_map>
@@ -65,10 +66,49 @@ void RemoveUnreferencedElements(V &symVec)
   }
 }
 
+// A symbol's ResolvedType. Every write moves Epoch on, which is what tells GetResolvedType that the ends of the
+// chains it remembered may have changed.
+class TypeLink
+{
+public:
+  TypeLink(Type *type = nullptr) : type(type) {}
+
+  TypeLink &operator=(Type *linked)
+  {
+    type = linked;
+    ++Epoch;
+    return *this;
+  }
+
+  TypeLink &operator=(const TypeLink &link) { return *this = link.type; }
+
+  operator Type *() const { return type; }
+  Type *operator->() const { return type; }
+
+  static uint64_t Epoch;
+
+private:
+  Type *type;
+};
+
+// Which kind of symbol it is, a kind is followed by the ones derived from it (see SymbolCast)
+enum class SymbolKind : unsigned char
+{
+  Symbol,
+  Variable,
+  TableData,
+  Type
+};
+
 // A symbol is anything that must be identified by name
 class Symbol
 {
 public:
+  static const SymbolKind FirstKind = SymbolKind::Symbol;
+  static const SymbolKind LastKind = SymbolKind::Type;
+
+  Symbol() : Kind(SymbolKind::Symbol) {}
+
   virtual ~Symbol()
   {}
 
@@ -76,20 +116,28 @@ public:
   std::string Name; 
   
   //Type symbol resolves to
-  Type *ResolvedType; 
+  TypeLink ResolvedType; 
   
   //Parent of symbol (i.e type inside a class, table, or function)
-  Symbol *Parent;
+  Symbol *Parent = nullptr;
 
   std::vector<Variable *> Members;
 
   //Library symbol is apart of
-  Library* Owner;
+  Library* Owner = nullptr;
 
   unsigned ReferenceCount = 0;
   
   bool hasClearedRefs = true;
 
+  //Created as a global (it's in the library's Globals)
+  bool IsGlobal = false;
+
+  //Kept with the flags above so it doesn't need padding of its own
+  const SymbolKind Kind;
+
+  //The end of the ResolvedType chain. Every symbol on the way is made to remember it, so asking again (of this
+  //symbol or any of them) is one lookup until a link anywhere changes.
   Type *GetResolvedType() const;
 
   virtual void Clean()
@@ -100,12 +148,30 @@ public:
     hasClearedRefs = true;
 
     Parent = CleanSymbol(Parent);
-    ResolvedType = CleanSymbol(ResolvedType);
+    ResolvedType = CleanSymbol<Type>(ResolvedType);
 
     CleanMembers(Members);
   }
+
+protected:
+  Symbol(SymbolKind kind) : Kind(kind) {}
+
+private:
+  //What GetResolvedType found, good while resolvedEpoch is TypeLink::Epoch
+  mutable Type *resolvedCache = nullptr;
+  mutable uint64_t resolvedEpoch = 0;
 };
 
+// The symbol as a T if it is one (or derives from one), null otherwise
+template<typename T>
+T *SymbolCast(Symbol *sym)
+{
+  if (sym == nullptr || sym->Kind < T::FirstKind || sym->Kind > T::LastKind)
+    return nullptr;
+
+  return static_cast<T *>(sym);
+}
+
 std::ostream& operator<<(std::ostream& stream, const Symbol* symbol);
 std::ostream& operator<<(std::ostream& stream, const Symbol& symbol);
 
@@ -164,15 +230,20 @@ std::ostream& operator<<(std::ostream& stream, const ValueData& symbol);
 class Variable : public Symbol
 {
 public:
-  VariableType Type;
+  static const SymbolKind FirstKind = SymbolKind::Variable;
+  static const SymbolKind LastKind = SymbolKind::TableData;
+
+  Variable() : Symbol(SymbolKind::Variable) {}
+
+  VariableType Type = VariableType::Default;
   bool Predictive = false;
 
   //Value of variable
-  ValueData Value;
+  ValueData Value{};
   VariableType ValueType = VariableType::Default;
 
   // Whether or not this variable is a parameter
-  bool IsParameter;
+  bool IsParameter = false;
 
   virtual void Clean()
   {
@@ -183,12 +254,20 @@ public:
     if (Value.Type == ExpressionType::Reference)
       Value.Data.Reference = CleanSymbol(Value.Data.Reference);
   }
+
+protected:
+  Variable(SymbolKind kind) : Symbol(kind) {}
 };
 
 class TableData : public Variable
 {
 public:
-  ValueData Index;
+  static const SymbolKind FirstKind = SymbolKind::TableData;
+  static const SymbolKind LastKind = SymbolKind::TableData;
+
+  TableData() : Variable(SymbolKind::TableData) {}
+
+  ValueData Index{};
   bool indexExpression = false;
 
   virtual void Clean()
@@ -205,6 +284,11 @@ public:
 class Type : public Symbol
 {
 public:
+  static const SymbolKind FirstKind = SymbolKind::Type;
+  static const SymbolKind LastKind = SymbolKind::Type;
+
+  Type() : Symbol(SymbolKind::Type) {}
+
   //If the type is comprised of multiple types
   std::vector<Type *> MultipleTypes;
 
@@ -214,7 +298,7 @@ public:
   bool Predictive = false;
 
   //If type is a function, it needs a return type
-  Type *ReturnType;
+  Type *ReturnType = nullptr;
 
   void CopyType(Type *newType)
   {
@@ -247,12 +331,40 @@ public:
   }
 };
 
+//Symbols under the lowercased first character of each word start of their name, so "getValue" is under both
+//'g' and 'v'. That's all a completion needs to narrow down the candidates before the fuzzy match scores them.
+//New names go on the end and get sorted in the next time it's searched.
+class NameIndex
+{
+public:
+  void Add(Symbol *sym, const std::string &name);
+
+  //Every symbol with a word starting with c (ignoring case), once for every word that does
+  void Find(char c, std::vector<Symbol *> &found);
+
+  //Takes out symbols with no references left, without changing the order of what's left
+  void RemoveUnreferenced();
+
+private:
+  struct Entry
+  {
+    char Key;
+    Symbol *Sym;
+  };
+
+  std::vector<Entry> entries;
+  size_t sorted = 0;
+};
+
 class LibraryReference
 {
 public:
   ~LibraryReference();
 
-  Library *library;
+  //Drops every reference held, so the symbols only this owner used get cleaned
+  void Release();
+
+  Library *library = nullptr;
   std::unordered_map<Symbol *, unsigned> SymbolReferences;
 };
 
@@ -271,6 +383,12 @@ public:
 
   std::unordered_map<std::string, Symbol*> BaseTypesByName;
 
+  //The globals, and the members of the global table that aren't globals themselves (fields set through _G).
+  //Members are indexed when they're searched, the ones before IndexedTableMembers already are.
+  NameIndex GlobalNames;
+  NameIndex GlobalTableNames;
+  size_t IndexedTableMembers = 0;
+
   LibraryReference *currentRef;
   
   //Used for un-named types
@@ -285,6 +403,18 @@ public:
   Type*     AddPossibleType(Type *baseType, Type *newType, bool isGlobal = false);
   Variable* CreateVariable(const std::string& name, bool isGlobal = false);
 
+  //What CreateFunctionType names the type of a function, after the type it returns
+  static std::string FunctionTypeName(class FunctionNode *node);
+
+  //Globals with a word starting with c (ignoring case), a global shows up once for every word that does
+  void FindGlobals(char c, std::vector<Symbol *> &found);
+
+  //The same for members of the global table that aren't globals
+  void FindGlobalTableMembers(char c, std::vector<Symbol *> &found);
+
+  //Adds the members of the global table from IndexedTableMembers on to GlobalTableNames
+  void IndexGlobalTable();
+
   void Clean();
 };
 
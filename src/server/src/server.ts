@@ -9,10 +9,10 @@ let lua_parser : any = null;
 
 import {
     IPCMessageReader, IPCMessageWriter,
-	createConnection, IConnection,
-	TextDocuments, TextDocument, Diagnostic, DiagnosticSeverity,
+	createConnection, IConnection, TextDocumentSyncKind,
+	DidOpenTextDocumentParams, DidChangeTextDocumentParams, Diagnostic, DiagnosticSeverity,
 	InitializeParams, InitializeResult,
-	TextDocumentPositionParams, CompletionItem, CompletionItemKind, CompletionOptions, RequestType
+	TextDocumentPositionParams, CompletionItem, CompletionItemKind, CompletionList, CompletionOptions, RequestType
 } from 'vscode-languageserver';
 
 namespace InitializeRequest {
@@ -50,12 +50,33 @@ let print_con: IConnection = createConnection(new IPCMessageReader(process), new
 // Create a connection for the server. The connection uses Node's IPC as a transport
 let connection: IConnection = createConnection(new IPCMessageReader(process), new IPCMessageWriter(process));
 
-// Create a simple text document manager. The text document manager
-// supports full document sync only
-let documents: TextDocuments = new TextDocuments();
-// Make the text document manager listen on the connection
-// for open, change and close text document events
-documents.listen(connection);
+// Open documents live in the native module, which is loaded later on. Anything the
+// editor sends before then is replayed once it is.
+let pendingDocumentUpdates: (() => void)[] = [];
+
+function updateDocument(update: () => void)
+{
+    if(lua_parser == null)
+        pendingDocumentUpdates.push(update);
+    else
+        update();
+}
+
+connection.onDidOpenTextDocument((params: DidOpenTextDocumentParams) =>
+{
+    let doc = params.textDocument;
+    updateDocument(() => {
+        lua_parser.ParseDocument(doc.uri, doc.text, doc.version);
+    });
+});
+
+// Only the edited ranges are sent over, the native side applies them to its own copy
+connection.onDidChangeTextDocument((params: DidChangeTextDocumentParams) =>
+{
+    updateDocument(() => {
+        lua_parser.ApplyEdits(params.textDocument.uri, params.textDocument.version, params.contentChanges);
+    });
+});
 
 // After the server has started the client sends an initialize request. The server receives
 // in the passed params the rootPath of the workspace plus the client capabilities. 
@@ -65,8 +86,8 @@ connection.onInitialize((params): InitializeResult => {
     
 	return {
 		capabilities: {
-				// Tell the client that the server works in FULL text document sync mode
-				textDocumentSync: documents.syncKind,
+				// Tell the client that the server works in INCREMENTAL text document sync mode
+				textDocumentSync: TextDocumentSyncKind.Incremental,
 
 				// Tell the client that the server support code complete
 				completionProvider: {
@@ -77,21 +98,41 @@ connection.onInitialize((params): InitializeResult => {
 		}
 });
 
+// Most completions the native module hands back per request. They are filtered by what is typed in
+// front of the cursor and ranked natively, VS Code asks again as the user keeps typing.
+const maxCompletions = 100;
+
+// Completions come back packed into one ArrayBuffer (see WatchFunction_AutoComplete):
+// uint32 count, uint32 total, uint32 labelEnds[count], uint32 kinds[count], then the UTF-8 labels
+function unpackCompletions(buffer: ArrayBuffer): CompletionList
+{
+    let header = new Uint32Array(buffer, 0, 2);
+    let count = header[0];
+    let labelEnds = new Uint32Array(buffer, 8, count);
+    let kinds = new Uint32Array(buffer, 8 + 4 * count, count);
+    let labels = new Buffer(new Uint8Array(buffer, 8 + 8 * count));
+
+    let items: CompletionItem[] = [];
+    let labelStart = 0;
+    for(let i = 0; i < count; ++i)
+    {
+        items.push({ label: labels.toString('utf8', labelStart, labelEnds[i]), kind: kinds[i], data: i });
+        labelStart = labelEnds[i];
+    }
+
+    return { isIncomplete: count < header[1], items: items };
+}
+
 // This handler provides the initial list of the completion items.
-connection.onCompletion((textDocumentPosition: TextDocumentPositionParams): CompletionItem[] => 
+connection.onCompletion((textDocumentPosition: TextDocumentPositionParams): CompletionList => 
 {
     if(lua_parser == null)
-        return [];
+        return { isIncomplete: false, items: [] };
     
-    // The pass parameter contains the position of the text document in 
-    // which code complete got requested. For the example we ignore this
-    // info and always provide the same completion items.
-	var currentDoc = documents.get(textDocumentPosition.textDocument.uri);
-    lua_parser.ParseDocument(currentDoc.uri, currentDoc.getText());
-
-	var ret = lua_parser.AutoComplete(currentDoc.uri, textDocumentPosition.position.line, textDocumentPosition.position.character);
+	var uri = textDocumentPosition.textDocument.uri;
+	var ret = lua_parser.AutoComplete(uri, textDocumentPosition.position.line, textDocumentPosition.position.character, maxCompletions);
     
-    return ret.completion_items;
+    return unpackCompletions(ret.completions);
 });
 
 // This handler resolve additional information for the item selected in
@@ -100,6 +141,12 @@ connection.onCompletionResolve((item: CompletionItem): CompletionItem => {
     return item;
 });
 
+connection.onShutdown(() =>
+{
+    if(lua_parser != null)
+        lua_parser.StopTracing();
+});
+
 connection.onDidChangeConfiguration(() =>
 {
 });
@@ -117,6 +164,29 @@ connection.onRequest(InitializeRequest.type, () =>
         return;
     }
 
+    // Set LUA_INTELLISENSE_RECORD to a file to record every native call, so the session can be replayed
+    let recording = process.env.LUA_INTELLISENSE_RECORD;
+    if(recording)
+    {
+        if(lua_parser.StartRecording(recording))
+            print_con.console.log("Recording native calls to " + recording);
+        else
+            print_con.console.log("Can't record native calls to " + recording);
+    }
+
+    // Set LUA_INTELLISENSE_TRACE to a file to get a Chrome trace of the native side, written on shutdown
+    let tracing = process.env.LUA_INTELLISENSE_TRACE;
+    if(tracing && lua_parser.StartTracing(tracing))
+        print_con.console.log("Tracing native calls to " + tracing);
+
+    // Set LUA_INTELLISENSE_DEFER_FUNCTIONS to resolve function bodies only once a completion lands in them. Files
+    // open faster, but completions outside a function don't see what it returns or the globals it assigns until then.
+    if(process.env.LUA_INTELLISENSE_DEFER_FUNCTIONS)
+        lua_parser.SetDeferFunctionBodies(true);
+
+    pendingDocumentUpdates.forEach((update) => update());
+    pendingDocumentUpdates = [];
+
     print_con.console.log("Server initialized!");
     connection.sendRequest(PushDocumentsRequest.type).then();
 })
@@ -130,10 +200,19 @@ connection.onRequest(ReceiveDocumentRequest.type, (doc : RecievedDocument) =>
 
     if(newDocs.length == allFileNum)
     {
-        newDocs.forEach((v : RecievedDocument) => {
-            lua_parser.ParseDocument(v.name, v.text);
-        })
-        print_con.console.log("Done parsing all files in the workspace.");
+        // One native call for the whole workspace
+        let results = lua_parser.ParseDocuments(newDocs.map((v : RecievedDocument) => {
+            return { uri: v.name, text: v.text };
+        }));
+        newDocs = [];
+
+        let errors = 0;
+        let ms = 0;
+        results.forEach((result : any) => {
+            errors += result.errors;
+            ms += result.ms;
+        });
+        print_con.console.log("Done parsing all files in the workspace (" + results.length + " files, " + errors + " errors, " + ms.toFixed(1) + "ms).");
         parsedAllFiles = true
     }
 })